@@ -1,13 +1,38 @@
 let socket;
 let chart;
 let dataPoints = [];
+// sequence number of the last record in dataPoints, -1 when there is none
+let lastSequence = -1;
+
+// live pulses come as binary frames with this subprotocol, see PulseFrame.h
+const binaryProtocol = "energy.pulses.v1";
+const jsonProtocol = "energy.json.v1";
 
 function deleteDataLogFile() {
     socket.send(JSON.stringify({ request: "deleteDataLogFile" }));
     dataPoints = [];
+    lastSequence = -1;
     updateChart();
 }
 
+function decodePulses(buffer) {
+    let view = new DataView(buffer);
+    let pulses = [];
+    if (view.byteLength < 12 || view.getUint8(0) !== 1) {
+        return pulses;
+    }
+    let count = view.getUint8(1);
+    let time = view.getUint32(4, true);
+    let value = view.getInt32(8, true);
+    for (let i = 0; i < count && 12 + (i + 1) * 8 <= view.byteLength; i++) {
+        let offset = 12 + i * 8;
+        time += view.getUint16(offset + 4, true);
+        value += view.getUint16(offset + 6, true);
+        pulses.push({ sequence: view.getUint32(offset, true), accumulatedValue: value, time: time });
+    }
+    return pulses;
+}
+
 function downloadDataLogFile() {
     fetch('/download')
         .then(response => response.blob())
@@ -35,31 +60,57 @@ function enterConfigMode() {
         .catch(error => console.error('Error entering configuration mode:', error));
 }
 
-document.addEventListener("DOMContentLoaded", function () {
-    socket = new WebSocket(`ws://${window.location.hostname}/ws`);
+// adds live pulses, skipping the ones already in dataPoints
+function addPulses(pulses) {
+    for (let pulse of pulses) {
+        if (pulse.sequence > lastSequence) {
+            dataPoints.push(pulse);
+            lastSequence = pulse.sequence;
+        }
+    }
+}
+
+function connect() {
+    socket = new WebSocket(`ws://${window.location.hostname}/ws`, [binaryProtocol, jsonProtocol]);
+    socket.binaryType = "arraybuffer";
 
     socket.onopen = function () {
         console.log("WebSocket connection established");
-        socket.send(JSON.stringify({ request: "wholeLog" }));
+        // the chart only needs the raw pulses
+        socket.send(JSON.stringify({ request: "subscribe", topics: ["pulses"] }));
+        // after a reconnect only ask for the records that were missed
+        if (lastSequence >= 0) {
+            let last = dataPoints[dataPoints.length - 1];
+            socket.send(JSON.stringify({ request: "resume", sequence: lastSequence, time: last.time }));
+        } else {
+            socket.send(JSON.stringify({ request: "wholeLog" }));
+        }
     };
 
-    document.getElementById("deleteBtn").addEventListener("click", function () {
-        deleteDataLogFile();
-    });
-
-    document.getElementById("downloadBtn").addEventListener("click", function () {
-        downloadDataLogFile();
-    });
-
-    document.getElementById("configBtn").addEventListener("click", function () {
-        enterConfigMode();
-    });
-
     socket.onmessage = function (event) {
+        if (event.data instanceof ArrayBuffer) {
+            addPulses(decodePulses(event.data));
+            return;
+        }
         let data = JSON.parse(event.data);
         // console.log("Data received: ", data);
         if (data.log && Array.isArray(data.log)) {
-            dataPoints = data.log;
+            // from 0 is the whole log, anything else follows what we have
+            let from = data.from || 0;
+            if (from === 0) {
+                dataPoints = data.log;
+            } else {
+                dataPoints.push(...data.log);
+            }
+            if (data.log.length > 0) {
+                lastSequence = from + data.log.length - 1;
+            } else if (from === 0) {
+                lastSequence = -1;
+            }
+        } else if (data.pulses && Array.isArray(data.pulses)) {
+            addPulses(data.pulses);
+        } else if (data.sequence !== undefined) {
+            addPulses([data]);
         } else {
             dataPoints.push(data);
         }
@@ -67,7 +118,24 @@ document.addEventListener("DOMContentLoaded", function () {
 
     socket.onclose = function () {
         console.log("WebSocket connection closed");
+        setTimeout(connect, 2000);
     };
+}
+
+document.addEventListener("DOMContentLoaded", function () {
+    connect();
+
+    document.getElementById("deleteBtn").addEventListener("click", function () {
+        deleteDataLogFile();
+    });
+
+    document.getElementById("downloadBtn").addEventListener("click", function () {
+        downloadDataLogFile();
+    });
+
+    document.getElementById("configBtn").addEventListener("click", function () {
+        enterConfigMode();
+    });
 
     chart = Highcharts.chart('container', {
       chart: {
@@ -0,0 +1,119 @@
+#ifndef LOGJSON_H_
+#define LOGJSON_H_
+
+#include "LogStore.h"
+#include <memory>
+#include <vector>
+
+/**
+ * @brief JSON of `LogJsonCache::CHUNK_RECORDS` records in a row, as `LogJsonWriter` writes them.
+ *
+ * Every record starts with a comma, so chunks can follow each other and the
+ * first record of the log just skips it. A chunk doesn't change once it is made.
+ */
+struct LogJsonChunk {
+  uint32_t first;      // index of the first record
+  uint32_t truncates;  // truncates of the store when the chunk was made
+  std::vector<char> json;
+};
+
+/**
+ * @brief Hit and miss counters kept by `LogJsonCache`.
+ */
+struct LogJsonCacheStats {
+  uint32_t hits;       // chunks found in the cache
+  uint32_t builds;     // chunks serialized
+  uint32_t evictions;
+};
+
+/**
+ * @brief Keeps the JSON of recently sent records, for all writers.
+ *
+ * When several pages connect at once, e.g. after a WiFi drop, they all ask for
+ * about the same records. The cache serializes `CHUNK_RECORDS` records once and
+ * hands the same chunk to every writer that needs them. Chunks are shared by
+ * `shared_ptr`, so one that is dropped to make room stays alive until the last
+ * writer using it is done.
+ *
+ * Only whole chunks are kept, so appends just add chunks and never change one.
+ * The chunks of a store that was truncated or rotated since are made again.
+ */
+class LogJsonCache {
+  public:
+    static const size_t CHUNK_RECORDS = 64;
+
+    LogJsonCache(LogStore *store, size_t chunks = 8);
+    ~LogJsonCache();
+    /**
+     * The chunk starting at record `first`, which has to be a multiple of
+     * `CHUNK_RECORDS`. Serializes it if it isn't cached. Returns nullptr if the
+     * store doesn't have all its records yet, or they couldn't be read.
+     */
+    std::shared_ptr<const LogJsonChunk> get(uint32_t first);
+    void clear();
+    LogJsonCacheStats stats();
+
+  private:
+    struct Entry {
+      std::shared_ptr<const LogJsonChunk> chunk;
+      uint32_t used;   // value of _clock when the entry was last used
+    };
+    std::shared_ptr<const LogJsonChunk> _build(uint32_t first, uint32_t truncates);
+    void _lock();
+    void _unlock();
+
+    LogStore *_store;
+    std::vector<Entry> _entries;
+    uint32_t _clock;
+    LogJsonCacheStats _stats;
+#ifdef ARDUINO
+    SemaphoreHandle_t _mutex;
+#else
+    std::mutex _mutex;
+#endif
+};
+
+/**
+ * @brief Writes records from a `LogStore` as the JSON the web page expects.
+ *
+ * The output is `{"log":[{"accumulatedValue":1,"time":1700000000},...]}`, the
+ * format dataLog.json used to be stored in. It is produced a piece at a time by
+ * `fill()`, so the whole log never has to be in memory at once.
+ *
+ * With `withFrom` set, the index of the first record is written ahead of the
+ * log as `{"from":120,"log":[...]}`, so a WebSocket client knows the sequence
+ * numbers of the records it got.
+ *
+ * With `setCache()`, whole chunks of records are copied from a `LogJsonCache`
+ * instead of being formatted again for every writer.
+ */
+class LogJsonWriter {
+  public:
+    LogJsonWriter(LogStore *store, uint32_t from = 0, bool withFrom = false);
+    /** Fills `buffer` with up to `maxLen` bytes of JSON. Returns 0 once everything is written. */
+    size_t fill(uint8_t *buffer, size_t maxLen);
+    bool done() const { return _state == DONE; }
+    /** Stops before the record at `end`, even if the store has more by then. */
+    void limit(uint32_t end){ _end = end; }
+    /** Takes whole chunks of records from `cache`. */
+    void setCache(LogJsonCache *cache){ _cache = cache; }
+
+  private:
+    enum State { HEADER, RECORDS, FOOTER, DONE };
+    bool _nextPiece();
+
+    LogCursor _cursor;
+    LogJsonCache *_cache;
+    std::shared_ptr<const LogJsonChunk> _chunk;  // chunk the current piece is in, if any
+    State _state;
+    uint32_t _from;
+    uint32_t _end;
+    bool _withFrom;
+    bool _first;
+    char _piece[64];
+    const char *_pieceData;  // _piece, or the JSON of _chunk
+    size_t _pieceLen;
+    size_t _piecePos;
+};
+
+#endif /* LOGJSON_H_ */
@@ -0,0 +1,320 @@
+#ifndef LOGSTORE_H_
+#define LOGSTORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#ifdef ARDUINO
+#include <FS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#else
+#include <string>
+#include <mutex>
+#endif
+
+/**
+ * @brief One entry in the data log, as it is stored.
+ *
+ * Records are 16 bytes so they never straddle a 512 byte sector. `sequence` is
+ * the position of the record in the log and is set by the store, as is `crc`.
+ */
+struct LogRecord {
+  uint32_t sequence;
+  int32_t accumulatedValue;
+  uint32_t time;
+  uint32_t crc;
+};
+
+/**
+ * @brief Counters kept by every `LogStore`, for the status page and benchmarks.
+ */
+struct LogStoreStats {
+  uint32_t records;       // records in the log
+  uint32_t bytes;         // size of the log
+  uint32_t appends;       // calls to appendBatch()
+  uint32_t recordsWritten;
+  uint32_t reads;         // calls to read()
+  uint32_t recordsRead;
+  uint32_t truncates;
+  uint32_t errors;        // failed reads and writes
+};
+
+uint32_t logRecordCrc(const LogRecord &record);
+bool logRecordValid(const LogRecord &record);
+
+class LogCursor;
+class LogBlockCache;
+
+/**
+ * @brief Append-only store for the data log.
+ *
+ * A store holds fixed size `LogRecord`s in the order they were appended. The
+ * backends only have to implement reading, appending and truncating; cursors,
+ * seeking by time and stats work the same on all of them, so the firmware and
+ * host benchmarks can run the same code against SD, LittleFS, RAM or a file.
+ */
+class LogStore {
+  public:
+    virtual ~LogStore(){}
+
+    /** Opens the store, creating it if needed. Returns false if it can't be used. */
+    virtual bool begin() = 0;
+    /** Number of records in the store. */
+    virtual uint32_t count() = 0;
+    /** Reads up to `count` records starting at `index`. Returns the number read. */
+    virtual size_t read(uint32_t index, LogRecord *records, size_t count) = 0;
+    /** Keeps the first `count` records and drops the rest. */
+    virtual bool truncate(uint32_t count) = 0;
+
+    /** Appends one record, setting its sequence and crc. */
+    bool append(LogRecord &record){ return appendBatch(&record, 1) == 1; }
+    /**
+     * Appends `count` records in one write, setting their sequence and crc.
+     * Returns the number appended, which is 0 or `count`.
+     */
+    size_t appendBatch(LogRecord *records, size_t count);
+
+    /** Reads through the block cache set with `setCache()`, if there is one. */
+    size_t readCached(uint32_t index, LogRecord *records, size_t count);
+    /** Lets cursors, `seekTime()` and `last()` read through `cache`. */
+    void setCache(LogBlockCache *cache){ _cache = cache; }
+
+    /** Returns a cursor positioned at `index`. Set `cached` to false to always read the store itself. */
+    LogCursor cursor(uint32_t index = 0, bool cached = true);
+    /** Index of the first record with a time of at least `time`, or count() if there is none. */
+    uint32_t seekTime(uint32_t time);
+    /** Reads the last record. Returns false if the store is empty. */
+    bool last(LogRecord &record);
+    LogStoreStats stats();
+
+  protected:
+    /** Writes already sealed records to the end of the store. */
+    virtual bool _write(const LogRecord *records, size_t count) = 0;
+    LogStoreStats _stats = {};
+    LogBlockCache *_cache = nullptr;
+};
+
+/**
+ * @brief Reads a store from front to back, a few records at a time.
+ */
+class LogCursor {
+  public:
+    static const size_t BUFFERED_RECORDS = 32;
+
+    LogCursor(LogStore *store, uint32_t index = 0, bool cached = true);
+    /** Reads the next record. Returns false at the end of the store. */
+    bool next(LogRecord &record);
+    void seek(uint32_t index);
+    /** Index of the record next() will return. */
+    uint32_t position() const { return _index; }
+
+  private:
+    LogStore *_store;
+    bool _cached;
+    uint32_t _index;
+    uint32_t _bufferStart;
+    size_t _buffered;
+    LogRecord _buffer[BUFFERED_RECORDS];
+};
+
+/**
+ * @brief Hit and miss counters kept by `LogBlockCache`.
+ */
+struct LogCacheStats {
+  uint32_t hits;        // blocks found in the cache
+  uint32_t misses;      // blocks read from the store
+  uint32_t readAheads;  // blocks read before they were asked for
+  uint32_t evictions;
+};
+
+/**
+ * @brief Keeps recently read 4 KB blocks of a store in RAM, for all readers.
+ *
+ * Every web client that asks for the log reads mostly the same, most recent
+ * records. The cache holds `blocks` blocks of `BLOCK_RECORDS` records and drops
+ * the least recently used one when it needs room. When a reader moves on to
+ * the next block, the block after that is read too, so a reader going through
+ * the whole log always has one block read ahead.
+ *
+ * Blocks are only kept while the store isn't truncated or rotated, and a block that was
+ * read before it was full is read again when records past its end are needed.
+ * Call `clear()` if the store is opened again.
+ */
+class LogBlockCache {
+  public:
+    static const size_t BLOCK_RECORDS = 256;
+
+    LogBlockCache(LogStore *store, size_t blocks = 8);
+    ~LogBlockCache();
+    /** Reads up to `count` records starting at `index`. Returns the number read. */
+    size_t read(uint32_t index, LogRecord *records, size_t count);
+    void clear();
+    LogCacheStats stats();
+
+  private:
+    struct Entry {
+      uint32_t block;
+      size_t filled;   // records in the block, 0 if the entry is empty
+      uint32_t used;   // value of _clock when the entry was last used
+      LogRecord *records;
+    };
+    Entry *_find(uint32_t block);
+    Entry *_load(uint32_t block, Entry *entry, const Entry *keep);
+    void _lock();
+    void _unlock();
+
+    LogStore *_store;
+    Entry *_entries;
+    size_t _blocks;
+    uint32_t _clock;
+    uint32_t _lastBlock;   // block read last, to spot readers going through the log
+    uint32_t _truncates;   // truncates of the store when the cache was filled
+    LogCacheStats _stats;
+#ifdef ARDUINO
+    SemaphoreHandle_t _mutex;
+#else
+    std::mutex _mutex;
+#endif
+};
+
+#ifdef ARDUINO
+/**
+ * @brief Store kept in a file on an Arduino filesystem, e.g. `SD` or `LittleFS`.
+ */
+class FsLogStore : public LogStore {
+  public:
+    FsLogStore(fs::FS &fs, const char *path);
+    bool begin() override;
+    uint32_t count() override { return _count; }
+    size_t read(uint32_t index, LogRecord *records, size_t count) override;
+    bool truncate(uint32_t count) override;
+    /** Renames the log to `path` and starts an empty one, however long the log is. */
+    virtual bool rotate(const char *path);
+    const char *path() const { return _path; }
+
+  protected:
+    bool _write(const LogRecord *records, size_t count) override;
+    size_t _readFile(uint32_t index, LogRecord *records, size_t count);
+    fs::FS &_fs;
+    const char *_path;
+    char _tmpPath[32];
+    uint32_t _count;
+};
+
+/**
+ * @brief Flush counters kept by `BufferedFsLogStore`.
+ */
+struct LogWriterStats {
+  uint32_t flushes;
+  uint32_t bytesAppended;   // bytes of records appended
+  uint32_t bytesWritten;    // bytes written to the card, including rewritten sectors
+  uint32_t bytesPreallocated;
+  uint32_t lastFlushMicros;
+  uint32_t maxFlushMicros;
+  uint32_t totalFlushMicros;
+  uint32_t stalls;          // appends that had to wait for a flush
+};
+
+/**
+ * @brief `FsLogStore` that collects records in RAM and writes whole blocks.
+ *
+ * Appending a few bytes at a time through `File::write` and closing the file
+ * makes the SD card read and rewrite partial sectors and update the FAT on every
+ * record. This store keeps two `BLOCK_SIZE` buffers that line up with 4 KB
+ * blocks of the file: records go into one while the other is written by
+ * `flush()`, and the file is kept open between flushes.
+ *
+ * Records are only on the card once `flush()` has been called, but they can be
+ * read right away. Records that couldn't be flushed are kept when `begin()` opens
+ * the file again, and appended to it then. With `preallocate()` the file is grown ahead of the records
+ * with zeroed blocks, so appends don't have to allocate clusters. The zeroed
+ * records have a bad crc, which is how `begin()` finds the end of the log.
+ */
+class BufferedFsLogStore : public FsLogStore {
+  public:
+    static const size_t BLOCK_SIZE = 4096;
+    static const size_t BLOCK_RECORDS = BLOCK_SIZE / sizeof(LogRecord);
+
+    BufferedFsLogStore(fs::FS &fs, const char *path);
+    ~BufferedFsLogStore();
+    bool begin() override;
+    size_t read(uint32_t index, LogRecord *records, size_t count) override;
+    bool truncate(uint32_t count) override;
+    bool rotate(const char *path) override;
+
+    /** Grows the file by `bytes` of zeroes whenever the records reach its end. 0 turns it off. */
+    void preallocate(size_t bytes){ _preallocate = bytes; }
+    /**
+     * Writes buffered records to the card. A full buffer is always written, the
+     * one being filled only if `partial` is set. Returns false if a write failed.
+     */
+    bool flush(bool partial = true);
+    /** True when a full buffer is waiting for `flush()`. */
+    bool needsFlush();
+    /** Number of records that have been written to the card. */
+    uint32_t flushedCount();
+    LogWriterStats writerStats();
+
+  protected:
+    bool _write(const LogRecord *records, size_t count) override;
+    int _flushBuffer(bool partial);
+    size_t _copyBuffered(uint32_t index, LogRecord *records, size_t count);
+    bool _preallocateTo(uint32_t size);
+    bool _open();
+
+    LogRecord *_buffers[2];
+    uint32_t _block[2];   // block of the file each buffer holds
+    size_t _filled[2];    // records in each buffer
+    size_t _synced[2];    // records of each buffer already on the card
+    int _active;          // buffer records are appended to
+    uint32_t _flushed;
+    uint32_t _allocated;  // size of the file, including preallocated blocks
+    size_t _preallocate;
+    File _file;
+    SemaphoreHandle_t _lock;       // guards the buffers
+    SemaphoreHandle_t _flushLock;  // only one flush at a time
+    LogWriterStats _writerStats;
+    std::vector<LogRecord> _unflushed;  // records to append once begin() has opened the file
+};
+#else
+/**
+ * @brief Store kept in a plain file, for running the storage code on a host.
+ */
+class PosixLogStore : public LogStore {
+  public:
+    PosixLogStore(const char *path);
+    ~PosixLogStore();
+    bool begin() override;
+    uint32_t count() override { return _count; }
+    size_t read(uint32_t index, LogRecord *records, size_t count) override;
+    bool truncate(uint32_t count) override;
+
+  protected:
+    bool _write(const LogRecord *records, size_t count) override;
+    std::string _path;
+    int _fd;
+    uint32_t _count;
+};
+#endif
+
+/**
+ * @brief Store kept in RAM. Everything is lost on restart.
+ *
+ * With a `capacity` other than 0, appends fail once the store is full.
+ */
+class RamLogStore : public LogStore {
+  public:
+    RamLogStore(size_t capacity = 0) : _capacity(capacity){}
+    bool begin() override { return true; }
+    uint32_t count() override { return _records.size(); }
+    size_t read(uint32_t index, LogRecord *records, size_t count) override;
+    bool truncate(uint32_t count) override;
+
+  protected:
+    bool _write(const LogRecord *records, size_t count) override;
+    std::vector<LogRecord> _records;
+    size_t _capacity;
+};
+
+#endif /* LOGSTORE_H_ */
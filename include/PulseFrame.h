@@ -0,0 +1,57 @@
+#ifndef PULSEFRAME_H_
+#define PULSEFRAME_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Packs live pulses into one binary WebSocket frame.
+ *
+ * Sent to clients that agree on the binary subprotocol instead of one JSON
+ * text frame per pulse. All numbers are little endian.
+ *
+ * Header, 12 bytes:
+ * - `uint8`  type, `TYPE_PULSES`
+ * - `uint8`  number of records
+ * - `uint16` reserved, 0
+ * - `uint32` time of the first record
+ * - `int32`  accumulated value of the first record
+ *
+ * Then one 8 byte record per pulse:
+ * - `uint32` sequence number of the record in the data log
+ * - `uint16` seconds since the record before it
+ * - `uint16` increase of the accumulated value since the record before it
+ *
+ * The first record has deltas of 0, so a client adds up the deltas starting
+ * from the time and value in the header.
+ */
+class PulseFrame {
+  public:
+    static const uint8_t TYPE_PULSES = 1;
+    static const size_t HEADER_SIZE = 12;
+    static const size_t RECORD_SIZE = 8;
+    static const size_t MAX_RECORDS = 255;
+
+    PulseFrame(){ clear(); }
+    void clear();
+    /**
+     * Adds a pulse. Returns false if the frame is full, or if the pulse is too
+     * far from the one before it to fit in a record; it then goes in the next frame.
+     */
+    bool add(uint32_t sequence, uint32_t time, int32_t value);
+    size_t count() const { return _count; }
+    bool empty() const { return _count == 0; }
+    const uint8_t *data() const { return _data; }
+    size_t length() const { return HEADER_SIZE + _count * RECORD_SIZE; }
+
+  private:
+    void _put16(size_t pos, uint16_t value);
+    void _put32(size_t pos, uint32_t value);
+
+    uint8_t _data[HEADER_SIZE + MAX_RECORDS * RECORD_SIZE];
+    size_t _count;
+    uint32_t _lastTime;
+    int32_t _lastValue;
+};
+
+#endif /* PULSEFRAME_H_ */
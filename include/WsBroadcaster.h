@@ -0,0 +1,141 @@
+#ifndef WSBROADCASTER_H_
+#define WSBROADCASTER_H_
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include <vector>
+#include "PulseFrame.h"
+
+/**
+ * @brief Collects live pulses and sends them to WebSocket clients at a limited rate.
+ *
+ * Pulses are kept in a ring of the last `capacity` pulses. `run()` is called
+ * every `minInterval` ms and sends each client everything it hasn't had yet in
+ * one frame: a `PulseFrame` to clients on the binary subprotocol, and JSON to
+ * the others. A single pulse goes out as `{"sequence":1,"accumulatedValue":1,"time":1}`,
+ * several as `{"pulses":[...]}`.
+ *
+ * Clients that are sent the same pulses in the same format share one message:
+ * it is serialized once into a buffer from `AsyncWebSocket::reserveBuffer()`
+ * and that buffer is queued to each of them.
+ *
+ * Each client has its own interval. While a client still has messages queued,
+ * it is skipped and its interval doubles, up to `maxInterval`. Once it has
+ * caught up the interval halves again, down to `minInterval`. A client that
+ * falls more than `capacity` pulses behind misses the oldest ones.
+ *
+ * Clients only get the topics they subscribed to, raw pulses if they never did.
+ * Besides the pulses there are, all as JSON:
+ * - `TOPIC_SECONDS`: `{"topic":"seconds","time":1,"pulses":3,"accumulatedValue":1}` for every second with pulses.
+ * - `TOPIC_MINUTES`: the same for every minute with pulses, as `"topic":"minutes"`.
+ * - `TOPIC_POWER`: `{"topic":"power","time":1,"pulsesPerHour":1}` every second, from the last `POWER_WINDOW` seconds.
+ * - `TOPIC_HEALTH`: whatever is handed to `publish()`.
+ * Each of them is built once per run, and only if a client subscribed to it.
+ * Power and health are latest values, so a slow client only gets the newest one.
+ *
+ * With `setEventSource()` the same messages also go out as Server-Sent Events,
+ * to every client of the event source. Pulses are sent as a `pulses` event with
+ * the sequence number of the last pulse as its id, the topics as events named
+ * after them. The JSON is the one built for the WebSocket clients, and the event
+ * is formatted once for all clients of the event source.
+ */
+class WsBroadcaster {
+  public:
+    static const uint8_t TOPIC_PULSES = 0x01;
+    static const uint8_t TOPIC_SECONDS = 0x02;
+    static const uint8_t TOPIC_MINUTES = 0x04;
+    static const uint8_t TOPIC_POWER = 0x08;
+    static const uint8_t TOPIC_HEALTH = 0x10;
+    static const uint32_t POWER_WINDOW = 10;  // seconds
+
+    /** Topic with the name a client subscribes with, 0 if there is none. */
+    static uint8_t topic(const char *name);
+    /** Name of a single topic, nullptr if there is none. */
+    static const char *topicName(uint8_t topic);
+
+    WsBroadcaster(AsyncWebSocket *ws, const char *binaryProtocol, size_t capacity = 256);
+    /** Limits each client to one frame per `minInterval` ms, or one per `maxInterval` ms when it is slow. */
+    void setInterval(uint32_t minInterval, uint32_t maxInterval);
+    uint32_t interval() const { return _minInterval; }
+    /** Sends pulses and all topics to the clients of `events` as well. */
+    void setEventSource(AsyncEventSource *events){ _events = events; }
+
+    /**
+     * Starts sending pulses to a client, from the first pulse with a sequence
+     * number of at least `sequence` that is still in the ring.
+     */
+    void addClient(uint32_t id, uint32_t sequence);
+    void removeClient(uint32_t id);
+    /** Replaces the topics a client gets. */
+    void subscribe(uint32_t id, uint8_t topics);
+    /** True if any client subscribed to `topic`. */
+    bool subscribed(uint8_t topic);
+    /** Serializes `doc` once and queues it to the clients that subscribed to `topic`. */
+    void publish(uint8_t topic, JsonDocument &doc, AwsMessageClass messageClass = WS_MSG_DEFAULT);
+    /** Adds a pulse for the next `run()`. */
+    void add(uint32_t sequence, uint32_t time, int32_t value);
+    /** Drops the pending pulses, for when the log was reset. */
+    void reset();
+    /** Sends the pending pulses to the clients that are due. */
+    void run();
+
+  private:
+    struct Pulse {
+      uint32_t sequence;
+      uint32_t time;
+      int32_t value;
+    };
+    struct Message {
+      uint32_t from;      // index of the first pulse in the message
+      std::vector<AsyncWebSocketMessageBuffer *> buffers;  // a binary message can take several frames
+    };
+    struct Bucket {
+      uint32_t start;    // time of the first second in the bucket
+      uint32_t pulses;
+      int32_t value;     // accumulated value at the last pulse
+    };
+    struct ClientState {
+      uint32_t id;
+      uint8_t topics;
+      bool synced;        // sent the log, so pulses can follow it
+      uint32_t next;      // index in the ring of the next pulse to send, counting from the first ever added
+      uint32_t interval;  // ms between frames to this client
+      uint32_t due;       // millis() at which the next frame may be sent
+    };
+
+    ClientState *_find(uint32_t id);
+    void _remove(uint32_t id);
+    bool _subscribed(uint8_t topic);
+    void _publish(uint8_t topic, JsonDocument &doc, AwsMessageClass messageClass);
+    void _count(Bucket &bucket, std::vector<Bucket> &done, uint32_t period, const Pulse &pulse);
+    void _close(Bucket &bucket, std::vector<Bucket> &done, uint32_t period, uint32_t now);
+    void _publishBuckets(uint8_t topic, const char *name, std::vector<Bucket> &done);
+    void _publishPower(uint32_t now);
+    void _sendEvents(uint32_t oldest);
+    void _send(AsyncWebSocketClient *client, uint32_t from);
+    void _buildBinary(Message &message, uint32_t from);
+    void _buildJson(Message &message, uint32_t from);
+    void _release(Message &message);
+
+    AsyncWebSocket *_ws;
+    String _binaryProtocol;
+    std::vector<Pulse> _pulses;
+    uint32_t _added;       // pulses added since the last reset
+    std::vector<ClientState> _clients;
+    AsyncEventSource *_events;
+    uint32_t _eventsNext;  // index in the ring of the next pulse to send as an event
+    uint32_t _minInterval;
+    uint32_t _maxInterval;
+    Bucket _second;
+    Bucket _minute;
+    std::vector<Bucket> _seconds;   // finished seconds waiting for `run()`
+    std::vector<Bucket> _minutes;
+    uint32_t _lastPower;            // time power was last published
+    PulseFrame _frame;
+    Message _json;
+    Message _binary;
+    SemaphoreHandle_t _lock;
+};
+
+#endif /* WSBROADCASTER_H_ */
@@ -118,8 +118,17 @@ AsyncEventSourceMessage::AsyncEventSourceMessage(const char * data, size_t len)
   }
 }
 
+AsyncEventSourceMessage::AsyncEventSourceMessage(const AsyncEventSourceBuffer& buffer)
+: _data(nullptr), _len(0), _sent(0), _acked(0), _buffer(buffer)
+{
+  if(_buffer){
+    _data = (uint8_t*)_buffer->c_str();
+    _len = _buffer->length();
+  }
+}
+
 AsyncEventSourceMessage::~AsyncEventSourceMessage() {
-     if(_data != NULL)
+     if(_data != NULL && !_buffer)
         free(_data);
 }
 
@@ -156,6 +165,7 @@ AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, A
 {
   _client = request->client();
   _server = server;
+  _clientId = _server->_getNextId();
   _lastId = 0;
   if(request->hasHeader("Last-Event-ID"))
     _lastId = atoi(request->getHeader("Last-Event-ID")->value().c_str());
@@ -180,6 +190,7 @@ AsyncEventSourceClient::~AsyncEventSourceClient(){
 void AsyncEventSourceClient::_queueMessage(AsyncEventSourceMessage *dataMessage){
   if(dataMessage == NULL)
     return;
+  AsyncWebLockGuard l(_lockmq);
   if(!connected()){
     delete dataMessage;
     return;
@@ -195,6 +206,7 @@ void AsyncEventSourceClient::_queueMessage(AsyncEventSourceMessage *dataMessage)
 }
 
 void AsyncEventSourceClient::_onAck(size_t len, uint32_t time){
+  AsyncWebLockGuard l(_lockmq);
   while(len && !_messageQueue.isEmpty()){
     len = _messageQueue.front()->ack(len, time);
     if(_messageQueue.front()->finished())
@@ -205,6 +217,7 @@ void AsyncEventSourceClient::_onAck(size_t len, uint32_t time){
 }
 
 void AsyncEventSourceClient::_onPoll(){
+  AsyncWebLockGuard l(_lockmq);
   if(!_messageQueue.isEmpty()){
     _runQueue();
   }
@@ -229,6 +242,10 @@ void AsyncEventSourceClient::write(const char * message, size_t len){
   _queueMessage(new AsyncEventSourceMessage(message, len));
 }
 
+void AsyncEventSourceClient::write(const AsyncEventSourceBuffer& buffer){
+  _queueMessage(new AsyncEventSourceMessage(buffer));
+}
+
 void AsyncEventSourceClient::send(const char *message, const char *event, uint32_t id, uint32_t reconnect){
   String ev = generateEventMessage(message, event, id, reconnect);
   _queueMessage(new AsyncEventSourceMessage(ev.c_str(), ev.length()));
@@ -253,6 +270,7 @@ AsyncEventSource::AsyncEventSource(const String& url)
   : _url(url)
   , _clients(LinkedList<AsyncEventSourceClient *>([](AsyncEventSourceClient *c){ delete c; }))
   , _connectcb(NULL)
+  , _cNextId(1)
 {}
 
 AsyncEventSource::~AsyncEventSource(){
@@ -277,16 +295,20 @@ void AsyncEventSource::_addClient(AsyncEventSourceClient * client){
     free(temp);
   }*/
   
+  //held through the callback, so whatever it sends goes out before the next event
+  AsyncWebLockGuard l(_lock);
   _clients.add(client);
   if(_connectcb)
     _connectcb(client);
 }
 
 void AsyncEventSource::_handleDisconnect(AsyncEventSourceClient * client){
+  AsyncWebLockGuard l(_lock);
   _clients.remove(client);
 }
 
 void AsyncEventSource::close(){
+  AsyncWebLockGuard l(_lock);
   for(const auto &c: _clients){
     if(c->connected())
       c->close();
@@ -295,6 +317,7 @@ void AsyncEventSource::close(){
 
 // pmb fix
 size_t AsyncEventSource::avgPacketsWaiting() const {
+  AsyncWebLockGuard l(_lock);
   if(_clients.isEmpty())
     return 0;
   
@@ -312,17 +335,31 @@ size_t AsyncEventSource::avgPacketsWaiting() const {
 }
 
 void AsyncEventSource::send(const char *message, const char *event, uint32_t id, uint32_t reconnect){
-
-
-  String ev = generateEventMessage(message, event, id, reconnect);
+  AsyncWebLockGuard l(_lock);
+  if(_clients.isEmpty())
+    return;
+  //formatted once, every client queues the same buffer
+  AsyncEventSourceBuffer ev = std::make_shared<String>(generateEventMessage(message, event, id, reconnect));
   for(const auto &c: _clients){
     if(c->connected()) {
-      c->write(ev.c_str(), ev.length());
+      c->write(ev);
+    }
+  }
+}
+
+bool AsyncEventSource::send(uint32_t client, const char *message, const char *event, uint32_t id){
+  AsyncWebLockGuard l(_lock);
+  for(const auto &c: _clients){
+    if(c->id() == client && c->connected()) {
+      c->send(message, event, id);
+      return true;
     }
   }
+  return false;
 }
 
 size_t AsyncEventSource::count() const {
+  AsyncWebLockGuard l(_lock);
   return _clients.count_if([](AsyncEventSourceClient *c){
     return c->connected();
   });
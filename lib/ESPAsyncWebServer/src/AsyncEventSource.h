@@ -21,6 +21,7 @@
 #define ASYNCEVENTSOURCE_H_
 
 #include <Arduino.h>
+#include <memory>
 #ifdef ESP32
 #include <AsyncTCP.h>
 #define SSE_MAX_QUEUED_MESSAGES 32
@@ -49,6 +50,8 @@ class AsyncEventSource;
 class AsyncEventSourceResponse;
 class AsyncEventSourceClient;
 typedef std::function<void(AsyncEventSourceClient *client)> ArEventHandlerFunction;
+//an event formatted once and shared by the messages of every client it is sent to
+typedef std::shared_ptr<String> AsyncEventSourceBuffer;
 
 class AsyncEventSourceMessage {
   private:
@@ -57,8 +60,10 @@ class AsyncEventSourceMessage {
     size_t _sent;
     //size_t _ack;
     size_t _acked; 
+    AsyncEventSourceBuffer _buffer;
   public:
     AsyncEventSourceMessage(const char * data, size_t len);
+    AsyncEventSourceMessage(const AsyncEventSourceBuffer& buffer);
     ~AsyncEventSourceMessage();
     size_t ack(size_t len, uint32_t time __attribute__((unused)));
     size_t send(AsyncClient *client);
@@ -70,8 +75,10 @@ class AsyncEventSourceClient {
   private:
     AsyncClient *_client;
     AsyncEventSource *_server;
+    uint32_t _clientId;
     uint32_t _lastId;
     LinkedList<AsyncEventSourceMessage *> _messageQueue;
+    AsyncWebLock _lockmq;
     void _queueMessage(AsyncEventSourceMessage *dataMessage);
     void _runQueue();
 
@@ -83,8 +90,10 @@ class AsyncEventSourceClient {
     AsyncClient* client(){ return _client; }
     void close();
     void write(const char * message, size_t len);
+    void write(const AsyncEventSourceBuffer& buffer);
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
     bool connected() const { return (_client != NULL) && _client->connected(); }
+    uint32_t id() const { return _clientId; }
     uint32_t lastId() const { return _lastId; }
     size_t  packetsWaiting() const { return _messageQueue.length(); }
 
@@ -100,6 +109,8 @@ class AsyncEventSource: public AsyncWebHandler {
     String _url;
     LinkedList<AsyncEventSourceClient *> _clients;
     ArEventHandlerFunction _connectcb;
+    AsyncWebLock _lock;
+    uint32_t _cNextId;
   public:
     AsyncEventSource(const String& url);
     ~AsyncEventSource();
@@ -108,10 +119,14 @@ class AsyncEventSource: public AsyncWebHandler {
     void close();
     void onConnect(ArEventHandlerFunction cb);
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
+    //sends to one client, found and sent to with the client list locked, so it can be
+    //called from any task while the client disconnects. false if it is gone
+    bool send(uint32_t client, const char *message, const char *event=NULL, uint32_t id=0);
     size_t count() const; //number clinets connected
     size_t  avgPacketsWaiting() const;
 
     //system callbacks (do not call)
+    uint32_t _getNextId(){ return _cNextId++; }
     void _addClient(AsyncEventSourceClient * client);
     void _handleDisconnect(AsyncEventSourceClient * client);
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
@@ -0,0 +1,62 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "ESPAsyncWebServer.h"
+#include "AsyncWebBufferPool.h"
+
+AsyncWebBufferPool::AsyncWebBufferPool(size_t size)
+  :_size(size)
+{
+  for(size_t i = 0; i < WEB_SEND_BUFFERS; i++){
+    _buffers[i] = NULL;
+    _used[i] = false;
+  }
+}
+
+AsyncWebBufferPool::~AsyncWebBufferPool(){
+  for(size_t i = 0; i < WEB_SEND_BUFFERS; i++)
+    free(_buffers[i]);
+}
+
+uint8_t * AsyncWebBufferPool::take(){
+  AsyncWebLockGuard l(_lock);
+  for(size_t i = 0; i < WEB_SEND_BUFFERS; i++){
+    if(_used[i])
+      continue;
+    if(_buffers[i] == NULL){
+      _buffers[i] = (uint8_t *)malloc(_size);
+      if(_buffers[i] == NULL)
+        return NULL;
+    }
+    _used[i] = true;
+    return _buffers[i];
+  }
+  return NULL;
+}
+
+void AsyncWebBufferPool::give(uint8_t * buffer){
+  AsyncWebLockGuard l(_lock);
+  for(size_t i = 0; i < WEB_SEND_BUFFERS; i++){
+    if(_buffers[i] == buffer){
+      _used[i] = false;
+      return;
+    }
+  }
+}
@@ -0,0 +1,61 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBBUFFERPOOL_H_
+#define ASYNCWEBBUFFERPOOL_H_
+
+#include <Arduino.h>
+#include "AsyncWebSynchronization.h"
+
+//bytes of a response written to a connection at a time
+#ifndef WEB_SEND_BUFFER_SIZE
+#define WEB_SEND_BUFFER_SIZE 2920
+#endif
+
+//send buffers a server keeps, one for each response being written at the same time
+#ifndef WEB_SEND_BUFFERS
+#define WEB_SEND_BUFFERS 2
+#endif
+
+/*
+ * Buffers of one size, allocated the first time they are needed and kept.
+ *
+ * Responses fill a buffer and hand it to the connection, which copies it, so a buffer is
+ * only held while one ack is answered and a few are enough for a server. Once they are
+ * all allocated, sending allocates nothing, and the heap isn't cut up by buffers the size
+ * of the send window coming and going with every segment.
+ */
+class AsyncWebBufferPool {
+  private:
+    size_t _size;
+    uint8_t * _buffers[WEB_SEND_BUFFERS];
+    bool _used[WEB_SEND_BUFFERS];
+    AsyncWebLock _lock;
+
+  public:
+    AsyncWebBufferPool(size_t size = WEB_SEND_BUFFER_SIZE);
+    ~AsyncWebBufferPool();
+    size_t size() const { return _size; }
+    //a free buffer of size() bytes, NULL if all are in use or it can't be allocated
+    uint8_t * take();
+    void give(uint8_t * buffer);
+};
+
+#endif /* ASYNCWEBBUFFERPOOL_H_ */
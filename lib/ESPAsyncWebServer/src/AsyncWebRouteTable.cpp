@@ -0,0 +1,164 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "ESPAsyncWebServer.h"
+#include "AsyncWebRouteTable.h"
+
+#define ROUTE_NONE 0xFFFF
+
+AsyncWebRouteTable::AsyncWebRouteTable(){
+  clear();
+}
+
+void AsyncWebRouteTable::clear(){
+  _nodes.clear();
+  _others.clear();
+  _count = 0;
+  //the root, the empty name before the first slash
+  _nodes.push_back(Node());
+}
+
+//compares a segment of a url, which isn't terminated, with a node's name like strcmp
+static int compareSegment(const String& name, const char * segment, size_t len){
+  int cmp = strncmp(name.c_str(), segment, len);
+  if(cmp == 0 && name.length() != len)
+    cmp = (name.length() < len)?-1:1;
+  return cmp;
+}
+
+uint16_t AsyncWebRouteTable::_child(uint16_t node, const char * segment, size_t len) const {
+  const std::vector<uint16_t>& children = _nodes[node].children;
+  size_t low = 0;
+  size_t high = children.size();
+  while(low < high){
+    size_t mid = (low + high) / 2;
+    int cmp = compareSegment(_nodes[children[mid]].segment, segment, len);
+    if(cmp == 0)
+      return children[mid];
+    if(cmp < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return ROUTE_NONE;
+}
+
+uint16_t AsyncWebRouteTable::_addChild(uint16_t node, const char * segment, size_t len){
+  uint16_t child = _child(node, segment, len);
+  if(child != ROUTE_NONE)
+    return child;
+  child = _nodes.size();
+  _nodes.push_back(Node());
+  _nodes[child].segment = String(segment).substring(0, len);
+  std::vector<uint16_t>& children = _nodes[node].children;
+  auto it = children.begin();
+  while(it != children.end() && compareSegment(_nodes[*it].segment, segment, len) < 0)
+    ++it;
+  children.insert(it, child);
+  return child;
+}
+
+void AsyncWebRouteTable::add(AsyncWebHandler* handler){
+  Route route;
+  route.handler = handler;
+  route.method = HTTP_ANY;
+  route.order = _count++;
+
+  String uri;
+  if(!handler->route(uri, route.method)){
+    _others.push_back(route);
+    return;
+  }
+  //one node for each segment after a slash, "/" is the empty segment under the root
+  uint16_t node = 0;
+  const char * segment = uri.c_str() + 1;
+  while(true){
+    const char * end = strchr(segment, '/');
+    size_t len = end?(end - segment):strlen(segment);
+    node = _addChild(node, segment, len);
+    if(!end)
+      break;
+    segment = end + 1;
+  }
+  _nodes[node].routes.push_back(route);
+}
+
+size_t AsyncWebRouteTable::match(const char * url, uint8_t method, const Route ** found, size_t max) const {
+  size_t count = 0;
+  if(url[0] != '/')
+    return 0;
+  uint16_t node = 0;
+  const char * segment = url + 1;
+  while(true){
+    const char * end = strchr(segment, '/');
+    size_t len = end?(end - segment):strlen(segment);
+    node = _child(node, segment, len);
+    if(node == ROUTE_NONE)
+      break;
+    for(const Route& r : _nodes[node].routes){
+      if(!(r.method & method))
+        continue;
+      if(count < max){
+        //insertion sort, there are only ever a few
+        size_t i = count;
+        while(i > 0 && found[i - 1]->order > r.order){
+          found[i] = found[i - 1];
+          i--;
+        }
+        found[i] = &r;
+      }
+      count++;
+    }
+    if(!end)
+      break;
+    segment = end + 1;
+  }
+  return count;
+}
+
+bool AsyncWebRouteTable::find(AsyncWebServerRequest *request, AsyncWebHandler** handler) const {
+  const Route * routes[WEB_ROUTE_MAX_MATCHES];
+  size_t count = match(request->url().c_str(), request->method(), routes, WEB_ROUTE_MAX_MATCHES);
+  if(count > WEB_ROUTE_MAX_MATCHES)
+    return false;
+
+  //the routes and the other handlers merged back into the server's order
+  *handler = NULL;
+  size_t next = 0;
+  for(const Route& other : _others){
+    for(; next < count && routes[next]->order < other.order; next++){
+      if(routes[next]->handler->filter(request) && routes[next]->handler->canHandle(request)){
+        *handler = routes[next]->handler;
+        return true;
+      }
+    }
+    if(other.handler->filter(request) && other.handler->canHandle(request)){
+      *handler = other.handler;
+      return true;
+    }
+  }
+  for(; next < count; next++){
+    if(routes[next]->handler->filter(request) && routes[next]->handler->canHandle(request)){
+      *handler = routes[next]->handler;
+      return true;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,82 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBROUTETABLE_H_
+#define ASYNCWEBROUTETABLE_H_
+
+#include <Arduino.h>
+#include <vector>
+
+class AsyncWebHandler;
+class AsyncWebServerRequest;
+
+//routes found for one url before they are sorted, more make the server scan every handler
+#ifndef WEB_ROUTE_MAX_MATCHES
+#define WEB_ROUTE_MAX_MATCHES 8
+#endif
+
+/*
+ * The handlers of a server frozen into a tree of path segments.
+ *
+ * Handlers for a plain uri, like on("/data", ...), match the uri and everything below it,
+ * so they are stored in the node of their last segment and a request collects the routes
+ * of every node on its path, one segment at a time, with no string built or compared
+ * against handlers it can't match. Every other handler (wildcards, regexes, static files,
+ * WebSockets) is kept in a list and still asked in turn.
+ *
+ * A handler is only picked when no handler added before it takes the request, the same
+ * as when the server walks its list, so the routes of a server with its static files
+ * added last are found without touching the filesystem.
+ */
+class AsyncWebRouteTable {
+  public:
+    struct Route {
+      AsyncWebHandler* handler;
+      uint8_t method;
+      uint16_t order;   //position of the handler in the server's list
+    };
+
+  private:
+    struct Node {
+      String segment;
+      std::vector<uint16_t> children;   //sorted by segment
+      std::vector<Route> routes;
+    };
+    std::vector<Node> _nodes;
+    std::vector<Route> _others;         //handlers that aren't a plain uri, in order
+    uint16_t _count;
+
+    uint16_t _child(uint16_t node, const char * segment, size_t len) const;
+    uint16_t _addChild(uint16_t node, const char * segment, size_t len);
+
+  public:
+    AsyncWebRouteTable();
+    void clear();
+    //handlers have to be added in the order the server asks them
+    void add(AsyncWebHandler* handler);
+    //routes for url and method, in order. returns how many, more than max if they didn't fit
+    size_t match(const char * url, uint8_t method, const Route ** found, size_t max) const;
+    //sets handler to the one the server would pick for request, NULL if none.
+    //returns false if too many routes matched and the server has to look itself
+    bool find(AsyncWebServerRequest *request, AsyncWebHandler** handler) const;
+    size_t nodes() const { return _nodes.size(); }
+};
+
+#endif /* ASYNCWEBROUTETABLE_H_ */
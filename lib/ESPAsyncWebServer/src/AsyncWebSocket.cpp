@@ -63,13 +63,11 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
 
   if(len > space) len = space;
 
-  uint8_t *buf = (uint8_t*)malloc(headLen);
-  if(buf == NULL){
-    //os_printf("could not malloc %u bytes for frame header\n", headLen);
-    return 0;
-  }
+  //2 bytes, and at most 2 of length and 4 of mask. the client copies them
+  uint8_t buf[8];
 
-  buf[0] = opcode & 0x0F;
+  //keeps RSV1, which marks the first frame of a compressed message
+  buf[0] = opcode & 0x4F;
   if(final)
     buf[0] |= 0x80;
   if(len < 126)
@@ -85,10 +83,8 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
   }
   if(client->add((const char *)buf, headLen) != headLen){
     //os_printf("error adding %lu header bytes\n", headLen);
-    free(buf);
     return 0;
   }
-  free(buf);
 
   if(len){
     if(len && mask){
@@ -457,15 +453,156 @@ AsyncWebSocketMultiMessage::~AsyncWebSocketMultiMessage() {
 }
 
 
+/*
+ * AsyncWebSocketStreamMessage Message
+ */
+
+
+AsyncWebSocketStreamMessage::AsyncWebSocketStreamMessage(AwsResponseFiller callback, uint8_t opcode, bool mask, uint8_t windowBits)
+  :_content(callback)
+  ,_windowBits(windowBits)
+  ,_deflater(NULL)
+  ,_input(NULL)
+  ,_len(0)
+  ,_pos(0)
+  ,_index(0)
+  ,_ack(0)
+  ,_acked(0)
+  ,_first(true)
+  ,_done(false)
+{
+  _opcode = opcode & 0x07;
+  _mask = mask;
+  _class = WS_MSG_BULK;
+  //the frame buffer is only allocated once the message is being sent, so queued messages cost next to nothing
+  _data = NULL;
+  _status = _content?WS_MSG_SENDING:WS_MSG_ERROR;
+}
+
+
+AsyncWebSocketStreamMessage::~AsyncWebSocketStreamMessage() {
+  if(_data != NULL)
+    free(_data);
+  if(_input != NULL)
+    free(_input);
+  if(_deflater != NULL)
+    delete _deflater;
+}
+
+ void AsyncWebSocketStreamMessage::ack(size_t len, uint32_t time)  {
+   (void)time;
+  _acked += len;
+  if(_done && _acked >= _ack){
+    _status = WS_MSG_SENT;
+  }
+}
+ size_t AsyncWebSocketStreamMessage::send(AsyncClient *client)  {
+  if(_status != WS_MSG_SENDING)
+    return 0;
+  if(_acked < _ack){
+    return 0;
+  }
+  if(_done){
+    _status = WS_MSG_SENT;
+    return 0;
+  }
+
+  size_t window = webSocketSendFrameWindow(client);
+  if(!window)
+    return 0;
+
+  if(_data == NULL){
+    _data = (uint8_t*)malloc(WS_STREAM_FRAME_SIZE);
+    if(_windowBits){
+      _deflater = new AsyncWebSocketDeflater(_windowBits);
+      _input = (uint8_t*)malloc(WS_STREAM_INPUT_SIZE);
+    }
+    if(_data == NULL || (_windowBits && (_input == NULL || _deflater == NULL || !_deflater->valid()))){
+      _status = WS_MSG_ERROR;
+      return 0;
+    }
+  }
+
+  //fill the next frame, unless the last one could not be sent in full
+  if(_pos == _len){
+    size_t space = (window < WS_STREAM_FRAME_SIZE)?window:WS_STREAM_FRAME_SIZE;
+    _len = _deflater?_deflate(space):_fill(space);
+    if(_status != WS_MSG_SENDING)
+      return 0;
+    _pos = 0;
+  }
+
+  size_t toSend = _len - _pos;
+  if(window < toSend) {
+      toSend = window;
+  }
+
+  //an empty frame ends the message
+  bool final = (_len == 0);
+  uint8_t opCode = _first?_opcode:(uint8_t)WS_CONTINUATION;
+  if(_first && _deflater)
+    opCode |= 0x40;
+
+  size_t sent = webSocketSendFrame(client, final, opCode, _mask, _data + _pos, toSend);
+  if(toSend && !sent){
+    return 0;
+  }
+  _first = false;
+  _pos += sent;
+  _ack += sent + ((sent < 126)?2:4) + ((sent && _mask) * 4);
+  if(final){
+    _done = true;
+  }
+  return sent;
+}
+
+size_t AsyncWebSocketStreamMessage::_fill(size_t space){
+  size_t len = _content(_data, space, _index);
+  if(len > space){
+    _status = WS_MSG_ERROR;
+    return 0;
+  }
+  _index += len;
+  return len;
+}
+
+//compresses input from the callback until there is a frame of output, or the input ends
+size_t AsyncWebSocketStreamMessage::_deflate(size_t space){
+  while(_deflater->available() < space && !_deflater->finished()){
+    size_t room = _deflater->writable();
+    if(room > WS_STREAM_INPUT_SIZE)
+      room = WS_STREAM_INPUT_SIZE;
+    if(!room)
+      break;
+    size_t len = _content(_input, room, _index);
+    if(len > room){
+      _status = WS_MSG_ERROR;
+      return 0;
+    }
+    _index += len;
+    if(len)
+      _deflater->write(_input, len);
+    else
+      _deflater->finish();
+  }
+  return _deflater->read(_data, space);
+}
+
+
 /*
  * Async WebSocket Client
  */
  const char * AWSC_PING_PAYLOAD = "ESPAsyncWebServer-PING";
  const size_t AWSC_PING_PAYLOAD_LEN = 22;
 
-AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server)
+AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server, const String& protocol, bool deflate)
   : _controlQueue(LinkedList<AsyncWebSocketControl *>([](AsyncWebSocketControl *c){ delete  c; }))
   , _messageQueue(LinkedList<AsyncWebSocketMessage *>([](AsyncWebSocketMessage *m){ delete  m; }))
+  , _protocol(protocol)
+  , _deflate(deflate)
+  , _pcompressed(false)
+  , _pbuffer(NULL)
+  , _pbufferLen(0)
   , _tempObject(NULL)
 {
   _client = request->client();
@@ -474,7 +611,10 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
   _status = WS_CONNECTED;
   _pstate = 0;
   _lastMessageTime = millis();
-  _keepAlivePeriod = 0;
+  _keepAlivePeriod = _server->keepAlivePeriod() * 1000;
+  _pongTimeout = _server->pongTimeout() * 1000;
+  _pingTime = 0;
+  _pongPending = false;
   _client->setRxTimeout(0);
   _client->onError([](void *r, AsyncClient* c, int8_t error){ (void)c; ((AsyncWebSocketClient*)(r))->_onError(error); }, this);
   _client->onAck([](void *r, AsyncClient* c, size_t len, uint32_t time){ (void)c; ((AsyncWebSocketClient*)(r))->_onAck(len, time); }, this);
@@ -488,41 +628,64 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
 }
 
 AsyncWebSocketClient::~AsyncWebSocketClient(){
-  _messageQueue.free();
-  _controlQueue.free();
+  {
+    AsyncWebLockGuard l(_lockmq);
+    _messageQueue.free();
+    _controlQueue.free();
+  }
+  free(_pbuffer);
   _server->_handleEvent(this, WS_EVT_DISCONNECT, NULL, NULL, 0);
 }
 
 void AsyncWebSocketClient::_onAck(size_t len, uint32_t time){
   _lastMessageTime = millis();
-  if(!_controlQueue.isEmpty()){
-    auto head = _controlQueue.front();
-    if(head->finished()){
-      len -= head->len();
-      if(_status == WS_DISCONNECTING && head->opcode() == WS_DISCONNECT){
+  bool closing = false;
+  {
+    AsyncWebLockGuard l(_lockmq);
+    if(!_controlQueue.isEmpty()){
+      auto head = _controlQueue.front();
+      if(head->finished()){
+        len -= head->len();
+        if(_status == WS_DISCONNECTING && head->opcode() == WS_DISCONNECT){
+          _status = WS_DISCONNECTED;
+          closing = true;
+        }
         _controlQueue.remove(head);
-        _status = WS_DISCONNECTED;
-        _client->close(true);
-        return;
       }
-      _controlQueue.remove(head);
+    }
+    if(!closing && len && !_messageQueue.isEmpty()){
+      _messageQueue.front()->ack(len, time);
     }
   }
-  if(len && !_messageQueue.isEmpty()){
-    _messageQueue.front()->ack(len, time);
+  //closing deletes this client, so not with the lock held
+  if(closing){
+    _client->close(true);
+    return;
   }
   _server->_cleanBuffers(); 
+  AsyncWebLockGuard l(_lockmq);
   _runQueue();
 }
 
 void AsyncWebSocketClient::_onPoll(){
+  //a client that didn't answer the ping in time is gone. aborting frees it and all it has queued now
+  if(_pongPending && _pongTimeout > 0 && (millis() - _pingTime) >= _pongTimeout){
+    _client->close(true);
+    return;
+  }
+  //ping whenever nothing was acked or received for a while, also when messages are stuck in the queue
+  if(_keepAlivePeriod > 0 && !_pongPending && _status == WS_CONNECTED && (millis() - _lastMessageTime) >= _keepAlivePeriod){
+    ping((uint8_t *)AWSC_PING_PAYLOAD, AWSC_PING_PAYLOAD_LEN);
+    _pingTime = millis();
+    _pongPending = true;
+  }
+  AsyncWebLockGuard l(_lockmq);
   if(_client->canSend() && (!_controlQueue.isEmpty() || !_messageQueue.isEmpty())){
     _runQueue();
-  } else if(_keepAlivePeriod > 0 && _controlQueue.isEmpty() && _messageQueue.isEmpty() && (millis() - _lastMessageTime) >= _keepAlivePeriod){
-    ping((uint8_t *)AWSC_PING_PAYLOAD, AWSC_PING_PAYLOAD_LEN);
   }
 }
 
+//expects _lockmq to be held
 void AsyncWebSocketClient::_runQueue(){
   while(!_messageQueue.isEmpty() && _messageQueue.front()->finished()){
     _messageQueue.remove(_messageQueue.front());
@@ -536,6 +699,7 @@ void AsyncWebSocketClient::_runQueue(){
 }
 
 bool AsyncWebSocketClient::queueIsFull(){
+  AsyncWebLockGuard l(_lockmq);
   if((_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES) || (_status != WS_CONNECTED) ) return true;
   return false;
 }
@@ -543,15 +707,41 @@ bool AsyncWebSocketClient::queueIsFull(){
 void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage){
   if(dataMessage == NULL)
     return;
+  AsyncWebLockGuard l(_lockmq);
   if(_status != WS_CONNECTED){
     delete dataMessage;
     return;
   }
-  if(_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES){
-      ets_printf("ERROR: Too many messages queued\n");
-      delete dataMessage;
-  } else {
+  AsyncWebSocketMessage * sending = _messageQueue.isEmpty()?NULL:_messageQueue.front();
+  uint8_t key = dataMessage->key();
+  switch(dataMessage->messageClass()){
+    case WS_MSG_COMMAND:
       _messageQueue.add(dataMessage);
+      break;
+    case WS_MSG_BULK:
+      if(_messageQueue.count_if([](AsyncWebSocketMessage * const &m){ return m->messageClass() == WS_MSG_BULK; }) >= WS_MAX_QUEUED_BULK){
+        ets_printf("ERROR: Too many bulk messages queued\n");
+        delete dataMessage;
+      } else {
+        _messageQueue.add(dataMessage);
+      }
+      break;
+    case WS_MSG_LATEST:
+      //a newer value replaces the queued one, unless that is being sent already
+      if(_messageQueue.replace_first([sending, key](AsyncWebSocketMessage * const &m){
+          return m != sending && m->messageClass() == WS_MSG_LATEST && m->key() == key;
+        }, dataMessage)){
+        break;
+      }
+      // fall through
+    default:
+      if(_messageQueue.count_if([](AsyncWebSocketMessage * const &m){ return m->messageClass() <= WS_MSG_LATEST; }) >= WS_MAX_QUEUED_MESSAGES){
+        ets_printf("ERROR: Too many messages queued\n");
+        delete dataMessage;
+      } else {
+        _messageQueue.add(dataMessage);
+      }
+      break;
   }
   if(_client->canSend())
     _runQueue();
@@ -560,6 +750,7 @@ void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage){
 void AsyncWebSocketClient::_queueControl(AsyncWebSocketControl *controlMessage){
   if(controlMessage == NULL)
     return;
+  AsyncWebLockGuard l(_lockmq);
   _controlQueue.add(controlMessage);
   if(_client->canSend())
     _runQueue();
@@ -609,6 +800,7 @@ void AsyncWebSocketClient::_onDisconnect(){
 
 void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
   _lastMessageTime = millis();
+  _pongPending = false;
   uint8_t *data = (uint8_t*)pbuf;
   while(plen > 0){
     if(!_pstate){
@@ -616,6 +808,9 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
       _pinfo.index = 0;
       _pinfo.final = (fdata[0] & 0x80) != 0;
       _pinfo.opcode = fdata[0] & 0x0F;
+      //RSV1 on the first frame of a message: it is compressed
+      if(_pinfo.opcode == WS_TEXT || _pinfo.opcode == WS_BINARY)
+        _pcompressed = (fdata[0] & 0x40) != 0;
       _pinfo.masked = (fdata[1] & 0x80) != 0;
       _pinfo.len = fdata[1] & 0x7F;
       data += 2;
@@ -645,7 +840,15 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
         data[i] ^= _pinfo.mask[(_pinfo.index+i)%4];
     }
 
-    if((datalen + _pinfo.index) < _pinfo.len){
+    if(_pcompressed && _pinfo.opcode < 8){
+      //compressed messages are collected across segments and frames and inflated at the end
+      if(!_collectCompressed(data, datalen))
+        break;
+      _pinfo.index += datalen;
+      _pstate = (_pinfo.index < _pinfo.len)?1:0;
+      if(!_pstate && _pinfo.final && !_handleCompressed())
+        break;
+    } else if((datalen + _pinfo.index) < _pinfo.len){
       _pstate = 1;
 
       if(_pinfo.index == 0){
@@ -698,6 +901,71 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
   }
 }
 
+/*
+ * Adds a piece of a compressed message to _pbuffer, which holds up to WS_INFLATE_MAX_SIZE bytes.
+ * Closes the connection if permessage-deflate wasn't agreed on or the message doesn't fit.
+ */
+bool AsyncWebSocketClient::_collectCompressed(uint8_t *data, size_t len){
+  if(!_deflate){
+    close(1002, "unexpected RSV1");
+    return false;
+  }
+  //the first frame of a message
+  if(_pinfo.opcode != WS_CONTINUATION && _pinfo.index == 0){
+    _pinfo.message_opcode = _pinfo.opcode;
+    _pbufferLen = 0;
+  }
+  if(_pbufferLen + len > WS_INFLATE_MAX_SIZE){
+    free(_pbuffer);
+    _pbuffer = NULL;
+    _pbufferLen = 0;
+    close(1009, "compressed message too big");
+    return false;
+  }
+  if(_pbuffer == NULL){
+    _pbuffer = (uint8_t*)malloc(WS_INFLATE_MAX_SIZE);
+    if(_pbuffer == NULL){
+      close(1011);
+      return false;
+    }
+  }
+  memcpy(_pbuffer + _pbufferLen, data, len);
+  _pbufferLen += len;
+  return true;
+}
+
+/*
+ * Inflates the compressed message collected in _pbuffer and hands it on like any other,
+ * as a single frame. Closes the connection if it doesn't inflate.
+ */
+bool AsyncWebSocketClient::_handleCompressed(){
+  uint8_t * message = (uint8_t*)malloc(WS_INFLATE_MAX_SIZE + 1);
+  int messageLen = -1;
+  if(message != NULL)
+    messageLen = AsyncWebSocketDeflater::inflate(_pbuffer, _pbufferLen, message, WS_INFLATE_MAX_SIZE);
+  free(_pbuffer);
+  _pbuffer = NULL;
+  _pbufferLen = 0;
+  if(message == NULL){
+    close(1011);
+    return false;
+  }
+  if(messageLen < 0){
+    free(message);
+    close(1009, "compressed message too big");
+    return false;
+  }
+  message[messageLen] = 0;
+  _pinfo.opcode = _pinfo.message_opcode;
+  _pinfo.final = 1;
+  _pinfo.num = 0;
+  _pinfo.index = 0;
+  _pinfo.len = messageLen;
+  _server->_handleEvent(this, WS_EVT_DATA, (void *)&_pinfo, message, messageLen);
+  free(message);
+  return true;
+}
+
 size_t AsyncWebSocketClient::printf(const char *format, ...) {
   va_list arg;
   va_start(arg, format);
@@ -791,9 +1059,11 @@ void AsyncWebSocketClient::text(const __FlashStringHelper *data){
     free(message);
   }
 }
-void AsyncWebSocketClient::text(AsyncWebSocketMessageBuffer * buffer)
+void AsyncWebSocketClient::text(AsyncWebSocketMessageBuffer * buffer, AwsMessageClass messageClass, uint8_t key)
 {
-  _queueMessage(new AsyncWebSocketMultiMessage(buffer));
+  AsyncWebSocketMessage * message = new AsyncWebSocketMultiMessage(buffer);
+  message->setClass(messageClass, key);
+  _queueMessage(message);
 }
 
 void AsyncWebSocketClient::binary(const char * message, size_t len){
@@ -822,9 +1092,17 @@ void AsyncWebSocketClient::binary(const __FlashStringHelper *data, size_t len){
   }
   
 }
-void AsyncWebSocketClient::binary(AsyncWebSocketMessageBuffer * buffer)
+void AsyncWebSocketClient::binary(AsyncWebSocketMessageBuffer * buffer, AwsMessageClass messageClass, uint8_t key)
+{
+  AsyncWebSocketMessage * message = new AsyncWebSocketMultiMessage(buffer, WS_BINARY);
+  message->setClass(messageClass, key);
+  _queueMessage(message);
+}
+
+void AsyncWebSocketClient::stream(AwsResponseFiller callback, uint8_t opcode, size_t sizeHint)
 {
-  _queueMessage(new AsyncWebSocketMultiMessage(buffer, WS_BINARY));
+  bool compress = _deflate && sizeHint >= _server->deflateThreshold();
+  _queueMessage(new AsyncWebSocketStreamMessage(callback, opcode, false, compress?_server->deflateWindowBits():0));
 }
 
 IPAddress AsyncWebSocketClient::remoteIP() {
@@ -849,9 +1127,14 @@ uint16_t AsyncWebSocketClient::remotePort() {
 
 AsyncWebSocket::AsyncWebSocket(const String& url)
   :_url(url)
-  ,_clients(LinkedList<AsyncWebSocketClient *>([](AsyncWebSocketClient *c){ delete c; }))
+  ,_clients(LinkedList<AsyncWebSocketClient *>(nullptr))
   ,_cNextId(1)
   ,_enabled(true)
+  ,_deflate(false)
+  ,_deflateThreshold(0)
+  ,_deflateWindowBits(10)
+  ,_keepAlivePeriod(0)
+  ,_pongTimeout(0)
   ,_buffers(LinkedList<AsyncWebSocketMessageBuffer *>([](AsyncWebSocketMessageBuffer *b){ delete b; }))
 {
   _eventHandler = NULL;
@@ -866,17 +1149,26 @@ void AsyncWebSocket::_handleEvent(AsyncWebSocketClient * client, AwsEventType ty
 }
 
 void AsyncWebSocket::_addClient(AsyncWebSocketClient * client){
+  AsyncWebLockGuard l(_lock);
   _clients.add(client);
 }
 
 void AsyncWebSocket::_handleDisconnect(AsyncWebSocketClient * client){
-  
-  _clients.remove_first([=](AsyncWebSocketClient * c){
-    return c->id() == client->id();
-  });
+  bool found;
+  {
+    AsyncWebLockGuard l(_lock);
+    found = _clients.remove_first([=](AsyncWebSocketClient * c){
+      return c->id() == client->id();
+    });
+  }
+  //the disconnect event of the client may take other locks, so it is deleted once no other
+  //task can find it anymore, but not with the list locked
+  if(found)
+    delete client;
 }
 
 bool AsyncWebSocket::availableForWriteAll(){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->queueIsFull()) return false;
   }
@@ -884,6 +1176,7 @@ bool AsyncWebSocket::availableForWriteAll(){
 }
 
 bool AsyncWebSocket::availableForWrite(uint32_t id){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->queueIsFull() && (c->id() == id )) return false;
   }
@@ -891,12 +1184,14 @@ bool AsyncWebSocket::availableForWrite(uint32_t id){
 }
 
 size_t AsyncWebSocket::count() const {
+  AsyncWebLockGuard l(_lock);
   return _clients.count_if([](AsyncWebSocketClient * c){
     return c->status() == WS_CONNECTED;
   });
 }
 
 AsyncWebSocketClient * AsyncWebSocket::client(uint32_t id){
+  AsyncWebLockGuard l(_lock);
   for(const auto &c: _clients){
     if(c->id() == id && c->status() == WS_CONNECTED){
       return c;
@@ -907,12 +1202,14 @@ AsyncWebSocketClient * AsyncWebSocket::client(uint32_t id){
 
 
 void AsyncWebSocket::close(uint32_t id, uint16_t code, const char * message){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c)
     c->close(code, message);
 }
 
 void AsyncWebSocket::closeAll(uint16_t code, const char * message){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->close(code, message);
@@ -921,18 +1218,21 @@ void AsyncWebSocket::closeAll(uint16_t code, const char * message){
 
 void AsyncWebSocket::cleanupClients(uint16_t maxClients)
 {
+  AsyncWebLockGuard l(_lock);
   if (count() > maxClients){
     _clients.front()->close();
   }
 }
 
 void AsyncWebSocket::ping(uint32_t id, uint8_t *data, size_t len){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c)
     c->ping(data, len);
 }
 
 void AsyncWebSocket::pingAll(uint8_t *data, size_t len){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->ping(data, len);
@@ -940,6 +1240,7 @@ void AsyncWebSocket::pingAll(uint8_t *data, size_t len){
 }
 
 void AsyncWebSocket::text(uint32_t id, const char * message, size_t len){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c)
     c->text(message, len);
@@ -947,6 +1248,7 @@ void AsyncWebSocket::text(uint32_t id, const char * message, size_t len){
 
 void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer * buffer){
   if (!buffer) return;
+  AsyncWebLockGuard l(_lock);
   buffer->lock(); 
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED){
@@ -958,12 +1260,27 @@ void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer * buffer){
 }
 
 
+void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer * buffer, AwsClientFilter filter, AwsMessageClass messageClass, uint8_t key){
+  if (!buffer) return;
+  AsyncWebLockGuard l(_lock);
+  buffer->lock(); 
+  for(const auto& c: _clients){
+    if(c->status() == WS_CONNECTED && filter(c)){
+        c->text(buffer, messageClass, key);
+    }
+  }
+  buffer->unlock();
+  _cleanBuffers(); 
+}
+
+
 void AsyncWebSocket::textAll(const char * message, size_t len){
   AsyncWebSocketMessageBuffer * WSBuffer = makeBuffer((uint8_t *)message, len); 
     textAll(WSBuffer); 
 }
 
 void AsyncWebSocket::binary(uint32_t id, const char * message, size_t len){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c)
     c->binary(message, len);
@@ -977,6 +1294,7 @@ void AsyncWebSocket::binaryAll(const char * message, size_t len){
 void AsyncWebSocket::binaryAll(AsyncWebSocketMessageBuffer * buffer)
 {
   if (!buffer) return;
+  AsyncWebLockGuard l(_lock);
   buffer->lock(); 
     for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
@@ -986,13 +1304,28 @@ void AsyncWebSocket::binaryAll(AsyncWebSocketMessageBuffer * buffer)
   _cleanBuffers(); 
 }
 
+void AsyncWebSocket::binaryAll(AsyncWebSocketMessageBuffer * buffer, AwsClientFilter filter, AwsMessageClass messageClass, uint8_t key)
+{
+  if (!buffer) return;
+  AsyncWebLockGuard l(_lock);
+  buffer->lock(); 
+  for(const auto& c: _clients){
+    if(c->status() == WS_CONNECTED && filter(c))
+      c->binary(buffer, messageClass, key);
+  }
+  buffer->unlock(); 
+  _cleanBuffers(); 
+}
+
 void AsyncWebSocket::message(uint32_t id, AsyncWebSocketMessage *message){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c)
     c->message(message);
 }
 
 void AsyncWebSocket::messageAll(AsyncWebSocketMultiMessage *message){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->message(message);
@@ -1001,6 +1334,7 @@ void AsyncWebSocket::messageAll(AsyncWebSocketMultiMessage *message){
 }
 
 size_t AsyncWebSocket::printf(uint32_t id, const char *format, ...){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c){
     va_list arg;
@@ -1038,6 +1372,7 @@ size_t AsyncWebSocket::printfAll(const char *format, ...) {
 
 #ifndef ESP32
 size_t AsyncWebSocket::printf_P(uint32_t id, PGM_P formatP, ...){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c != NULL){
     va_list arg;
@@ -1087,6 +1422,7 @@ void AsyncWebSocket::text(uint32_t id, const String &message){
   text(id, message.c_str(), message.length());
 }
 void AsyncWebSocket::text(uint32_t id, const __FlashStringHelper *message){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c != NULL)
     c->text(message);
@@ -1104,6 +1440,7 @@ void AsyncWebSocket::textAll(const String &message){
   textAll(message.c_str(), message.length());
 }
 void AsyncWebSocket::textAll(const __FlashStringHelper *message){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->text(message);
@@ -1122,6 +1459,7 @@ void AsyncWebSocket::binary(uint32_t id, const String &message){
   binary(id, message.c_str(), message.length());
 }
 void AsyncWebSocket::binary(uint32_t id, const __FlashStringHelper *message, size_t len){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c != NULL)
     c-> binary(message, len);
@@ -1139,6 +1477,7 @@ void AsyncWebSocket::binaryAll(const String &message){
   binaryAll(message.c_str(), message.length());
 }
 void AsyncWebSocket::binaryAll(const __FlashStringHelper *message, size_t len){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c-> binary(message, len);
@@ -1152,6 +1491,7 @@ const char * WS_STR_VERSION = "Sec-WebSocket-Version";
 const char * WS_STR_KEY = "Sec-WebSocket-Key";
 const char * WS_STR_PROTOCOL = "Sec-WebSocket-Protocol";
 const char * WS_STR_ACCEPT = "Sec-WebSocket-Accept";
+const char * WS_STR_EXTENSIONS = "Sec-WebSocket-Extensions";
 const char * WS_STR_UUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
 bool AsyncWebSocket::canHandle(AsyncWebServerRequest *request){
@@ -1167,6 +1507,7 @@ bool AsyncWebSocket::canHandle(AsyncWebServerRequest *request){
   request->addInterestingHeader(WS_STR_VERSION);
   request->addInterestingHeader(WS_STR_KEY);
   request->addInterestingHeader(WS_STR_PROTOCOL);
+  request->addInterestingHeader(WS_STR_EXTENSIONS);
   return true;
 }
 
@@ -1186,15 +1527,51 @@ void AsyncWebSocket::handleRequest(AsyncWebServerRequest *request){
     return;
   }
   AsyncWebHeader* key = request->getHeader(WS_STR_KEY);
-  AsyncWebServerResponse *response = new AsyncWebSocketResponse(key->value(), this);
+  String protocol;
   if(request->hasHeader(WS_STR_PROTOCOL)){
-    AsyncWebHeader* protocol = request->getHeader(WS_STR_PROTOCOL);
-    //ToDo: check protocol
-    response->addHeader(WS_STR_PROTOCOL, protocol->value());
+    protocol = _selectProtocol(request->getHeader(WS_STR_PROTOCOL)->value());
+  }
+  //no context takeover on either side, so each message is compressed on its own and no
+  //window has to be kept between messages
+  bool deflate = _deflate && request->hasHeader(WS_STR_EXTENSIONS) &&
+    request->getHeader(WS_STR_EXTENSIONS)->value().indexOf("permessage-deflate") >= 0;
+  AsyncWebServerResponse *response = new AsyncWebSocketResponse(key->value(), this, protocol, deflate);
+  if(protocol.length()){
+    response->addHeader(WS_STR_PROTOCOL, protocol);
+  }
+  if(deflate){
+    response->addHeader(WS_STR_EXTENSIONS, String("permessage-deflate; server_no_context_takeover; client_no_context_takeover; server_max_window_bits=") + _deflateWindowBits);
   }
   request->send(response);
 }
 
+/*
+ * Picks the first of the comma separated subprotocols offered by the client that was added
+ * with addProtocol(). Returns an empty string if there is none, in which case the handshake
+ * answers without a subprotocol.
+ */
+String AsyncWebSocket::_selectProtocol(const String& offered){
+  if(_protocols.isEmpty()){
+    return offered;
+  }
+  int start = 0;
+  while(start < (int)offered.length()){
+    int end = offered.indexOf(',', start);
+    if(end < 0){
+      end = offered.length();
+    }
+    String protocol = offered.substring(start, end);
+    protocol.trim();
+    for(const auto& p: _protocols){
+      if(protocol.equals(p)){
+        return protocol;
+      }
+    }
+    start = end + 1;
+  }
+  return String();
+}
+
 AsyncWebSocketMessageBuffer * AsyncWebSocket::makeBuffer(size_t size)
 {
   AsyncWebSocketMessageBuffer * buffer = new AsyncWebSocketMessageBuffer(size); 
@@ -1217,6 +1594,20 @@ AsyncWebSocketMessageBuffer * AsyncWebSocket::makeBuffer(uint8_t * data, size_t
   return buffer; 
 }
 
+AsyncWebSocketMessageBuffer * AsyncWebSocket::reserveBuffer(size_t size)
+{
+  AsyncWebSocketMessageBuffer * buffer = new AsyncWebSocketMessageBuffer(size); 
+
+  if (buffer) {
+    //lock before it is in the list, or an ack could clean it up before it is queued
+    buffer->lock();
+    AsyncWebLockGuard l(_lock);
+    _buffers.add(buffer);
+  }
+
+  return buffer; 
+}
+
 void AsyncWebSocket::_cleanBuffers()
 {
   AsyncWebLockGuard l(_lock);
@@ -1237,8 +1628,10 @@ AsyncWebSocket::AsyncWebSocketClientLinkedList AsyncWebSocket::getClients() cons
  * Authentication code from https://github.com/Links2004/arduinoWebSockets/blob/master/src/WebSockets.cpp#L480
  */
 
-AsyncWebSocketResponse::AsyncWebSocketResponse(const String& key, AsyncWebSocket *server){
+AsyncWebSocketResponse::AsyncWebSocketResponse(const String& key, AsyncWebSocket *server, const String& protocol, bool deflate){
   _server = server;
+  _protocol = protocol;
+  _deflate = deflate;
   _code = 101;
   _sendContentLength = false;
 
@@ -1288,7 +1681,7 @@ void AsyncWebSocketResponse::_respond(AsyncWebServerRequest *request){
 size_t AsyncWebSocketResponse::_ack(AsyncWebServerRequest *request, size_t len, uint32_t time){
   (void)time;
   if(len){
-    new AsyncWebSocketClient(request, _server);
+    new AsyncWebSocketClient(request, _server, _protocol, _deflate);
   }
   return 0;
 }
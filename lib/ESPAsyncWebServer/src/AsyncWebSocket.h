@@ -32,6 +32,7 @@
 #include <ESPAsyncWebServer.h>
 
 #include "AsyncWebSynchronization.h"
+#include "AsyncWebSocketDeflate.h"
 
 #ifdef ESP8266
 #include <Hash.h>
@@ -46,6 +47,21 @@
 #define DEFAULT_MAX_WS_CLIENTS 4
 #endif
 
+//bulk messages, like streamed history, a client can have queued
+#ifndef WS_MAX_QUEUED_BULK
+#define WS_MAX_QUEUED_BULK 2
+#endif
+
+//largest frame payload a stream message buffers at a time
+#ifndef WS_STREAM_FRAME_SIZE
+#define WS_STREAM_FRAME_SIZE 1024
+#endif
+
+//input a compressed stream message reads at a time
+#ifndef WS_STREAM_INPUT_SIZE
+#define WS_STREAM_INPUT_SIZE 256
+#endif
+
 class AsyncWebSocket;
 class AsyncWebSocketResponse;
 class AsyncWebSocketClient;
@@ -79,6 +95,12 @@ typedef enum { WS_DISCONNECTED, WS_CONNECTED, WS_DISCONNECTING } AwsClientStatus
 typedef enum { WS_CONTINUATION, WS_TEXT, WS_BINARY, WS_DISCONNECT = 0x08, WS_PING, WS_PONG } AwsFrameType;
 typedef enum { WS_MSG_SENDING, WS_MSG_SENT, WS_MSG_ERROR } AwsMessageStatus;
 typedef enum { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_PONG, WS_EVT_ERROR, WS_EVT_DATA } AwsEventType;
+//how a message is queued for a client that can't keep up:
+//WS_MSG_DEFAULT is dropped once WS_MAX_QUEUED_MESSAGES are queued,
+//WS_MSG_LATEST replaces a queued message with the same key that isn't being sent yet,
+//WS_MSG_BULK is produced as the connection takes it, and only WS_MAX_QUEUED_BULK are queued,
+//WS_MSG_COMMAND is never dropped
+typedef enum { WS_MSG_DEFAULT, WS_MSG_LATEST, WS_MSG_BULK, WS_MSG_COMMAND } AwsMessageClass;
 
 class AsyncWebSocketMessageBuffer {
   private:
@@ -113,8 +135,13 @@ class AsyncWebSocketMessage {
     uint8_t _opcode;
     bool _mask;
     AwsMessageStatus _status;
+    AwsMessageClass _class;
+    uint8_t _key;
   public:
-    AsyncWebSocketMessage():_opcode(WS_TEXT),_mask(false),_status(WS_MSG_ERROR){}
+    AsyncWebSocketMessage():_opcode(WS_TEXT),_mask(false),_status(WS_MSG_ERROR),_class(WS_MSG_DEFAULT),_key(0){}
+    void setClass(AwsMessageClass messageClass, uint8_t key=0){ _class = messageClass; _key = key; }
+    AwsMessageClass messageClass() const { return _class; }
+    uint8_t key() const { return _key; }
     virtual ~AsyncWebSocketMessage(){}
     virtual void ack(size_t len __attribute__((unused)), uint32_t time __attribute__((unused))){}
     virtual size_t send(AsyncClient *client __attribute__((unused))){ return 0; }
@@ -154,6 +181,34 @@ public:
     virtual size_t send(AsyncClient *client) override ;
 };
 
+//message produced a frame at a time by a filler callback, so it never has to be in memory at once.
+//the callback works like the one of a chunked response and returns 0 once there is nothing left,
+//which is then sent as an empty final frame.
+//with windowBits the message is compressed with permessage-deflate as it is filled.
+class AsyncWebSocketStreamMessage: public AsyncWebSocketMessage {
+  private:
+    AwsResponseFiller _content;
+    uint8_t _windowBits;
+    AsyncWebSocketDeflater * _deflater;
+    uint8_t * _input;
+    uint8_t * _data;
+    size_t _len;
+    size_t _pos;
+    size_t _index;
+    size_t _ack;
+    size_t _acked;
+    bool _first;
+    bool _done;
+    size_t _fill(size_t space);
+    size_t _deflate(size_t space);
+public:
+    AsyncWebSocketStreamMessage(AwsResponseFiller callback, uint8_t opcode=WS_TEXT, bool mask=false, uint8_t windowBits=0);
+    virtual ~AsyncWebSocketStreamMessage() override;
+    virtual bool betweenFrames() const override { return _acked == _ack; }
+    virtual void ack(size_t len, uint32_t time) override ;
+    virtual size_t send(AsyncClient *client) override ;
+};
+
 class AsyncWebSocketClient {
   private:
     AsyncClient *_client;
@@ -163,12 +218,25 @@ class AsyncWebSocketClient {
 
     LinkedList<AsyncWebSocketControl *> _controlQueue;
     LinkedList<AsyncWebSocketMessage *> _messageQueue;
+    //messages are queued from other tasks while async_tcp sends and removes them
+    AsyncWebLock _lockmq;
 
     uint8_t _pstate;
     AwsFrameInfo _pinfo;
 
     uint32_t _lastMessageTime;
     uint32_t _keepAlivePeriod;
+    uint32_t _pongTimeout;
+    uint32_t _pingTime;
+    bool _pongPending;
+    String _protocol;
+    bool _deflate;
+    bool _pcompressed;
+    uint8_t * _pbuffer;   //compressed message collected until its last frame
+    size_t _pbufferLen;
+
+    bool _collectCompressed(uint8_t *data, size_t len);
+    bool _handleCompressed();
 
     void _queueMessage(AsyncWebSocketMessage *dataMessage);
     void _queueControl(AsyncWebSocketControl *controlMessage);
@@ -177,7 +245,7 @@ class AsyncWebSocketClient {
   public:
     void *_tempObject;
 
-    AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server);
+    AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server, const String& protocol = String(), bool deflate = false);
     ~AsyncWebSocketClient();
 
     //client id increments for the given server
@@ -186,6 +254,10 @@ class AsyncWebSocketClient {
     AsyncClient* client(){ return _client; }
     AsyncWebSocket *server(){ return _server; }
     AwsFrameInfo const &pinfo() const { return _pinfo; }
+    //subprotocol agreed on in the handshake, empty if none
+    const String& protocol() const { return _protocol; }
+    //permessage-deflate was agreed on in the handshake
+    bool deflate() const { return _deflate; }
 
     IPAddress remoteIP();
     uint16_t  remotePort();
@@ -201,6 +273,13 @@ class AsyncWebSocketClient {
     uint16_t keepAlivePeriod(){
       return (uint16_t)(_keepAlivePeriod / 1000);
     }
+    //set seconds to wait for the answer to an auto-ping before the connection is dropped. disabled if zero (default)
+    void pongTimeout(uint16_t seconds){
+      _pongTimeout = seconds * 1000;
+    }
+    uint16_t pongTimeout(){
+      return (uint16_t)(_pongTimeout / 1000);
+    }
 
     //data packets
     void message(AsyncWebSocketMessage *message){ _queueMessage(message); }
@@ -216,7 +295,7 @@ class AsyncWebSocketClient {
     void text(char * message);
     void text(const String &message);
     void text(const __FlashStringHelper *data);
-    void text(AsyncWebSocketMessageBuffer *buffer); 
+    void text(AsyncWebSocketMessageBuffer *buffer, AwsMessageClass messageClass=WS_MSG_DEFAULT, uint8_t key=0); 
 
     void binary(const char * message, size_t len);
     void binary(const char * message);
@@ -224,9 +303,16 @@ class AsyncWebSocketClient {
     void binary(char * message);
     void binary(const String &message);
     void binary(const __FlashStringHelper *data, size_t len);
-    void binary(AsyncWebSocketMessageBuffer *buffer); 
+    void binary(AsyncWebSocketMessageBuffer *buffer, AwsMessageClass messageClass=WS_MSG_DEFAULT, uint8_t key=0); 
+
+    //sends a message of unknown length in frames filled by callback as the connection can take them.
+    //it is a WS_MSG_BULK message. it is compressed if the client agreed on permessage-deflate and
+    //sizeHint, the expected length, is at least the threshold set with enableDeflate()
+    void stream(AwsResponseFiller callback, uint8_t opcode=WS_TEXT, size_t sizeHint=0);
 
-    bool canSend() { return _messageQueue.length() < WS_MAX_QUEUED_MESSAGES; }
+    bool canSend() { AsyncWebLockGuard l(_lockmq); return _messageQueue.length() < WS_MAX_QUEUED_MESSAGES; }
+    //messages waiting to be sent, including the one being sent
+    size_t queueLength() { AsyncWebLockGuard l(_lockmq); return _messageQueue.length(); }
 
     //system callbacks (do not call)
     void _onAck(size_t len, uint32_t time);
@@ -238,6 +324,7 @@ class AsyncWebSocketClient {
 };
 
 typedef std::function<void(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len)> AwsEventHandler;
+typedef std::function<bool(AsyncWebSocketClient * client)> AwsClientFilter;
 
 //WebServer Handler implementation that plays the role of a socket server
 class AsyncWebSocket: public AsyncWebHandler {
@@ -250,6 +337,14 @@ class AsyncWebSocket: public AsyncWebHandler {
     AwsEventHandler _eventHandler;
     bool _enabled;
     AsyncWebLock _lock;
+    StringArray _protocols;
+    bool _deflate;
+    size_t _deflateThreshold;
+    uint8_t _deflateWindowBits;
+    uint16_t _keepAlivePeriod;
+    uint16_t _pongTimeout;
+
+    String _selectProtocol(const String& offered);
 
   public:
     AsyncWebSocket(const String& url);
@@ -257,11 +352,35 @@ class AsyncWebSocket: public AsyncWebHandler {
     const char * url() const { return _url.c_str(); }
     void enable(bool e){ _enabled = e; }
     bool enabled() const { return _enabled; }
+    //subprotocols the server accepts, in the Sec-WebSocket-Protocol header of the handshake.
+    //if none are added, whatever the client asks for is accepted
+    void addProtocol(const String& protocol){ _protocols.add(protocol); }
+    //offers permessage-deflate without context takeover to clients that support it. streamed
+    //messages of at least threshold bytes are compressed with a window of 2^windowBits bytes,
+    //kept to the 9 to 14 bits the deflater supports
+    void enableDeflate(size_t threshold = 1024, uint8_t windowBits = 10){
+      _deflate = true;
+      _deflateThreshold = threshold;
+      _deflateWindowBits = (windowBits < 9)?9:((windowBits > 14)?14:windowBits);
+    }
+    //auto-ping and pong timeout in seconds for every new client, see AsyncWebSocketClient
+    void keepAlive(uint16_t period, uint16_t timeout){
+      _keepAlivePeriod = period;
+      _pongTimeout = timeout;
+    }
+    uint16_t keepAlivePeriod() const { return _keepAlivePeriod; }
+    uint16_t pongTimeout() const { return _pongTimeout; }
+    size_t deflateThreshold() const { return _deflateThreshold; }
+    uint8_t deflateWindowBits() const { return _deflateWindowBits; }
     bool availableForWriteAll();
     bool availableForWrite(uint32_t id);
 
     size_t count() const;
+    //the client, if it is connected. a disconnect on the async_tcp task frees it, so another
+    //task has to hold clientsLock() from looking it up until it is done with it
     AsyncWebSocketClient * client(uint32_t id);
+    //held while the list of clients is walked or changed
+    const AsyncWebLock& clientsLock() const { return _lock; }
     bool hasClient(uint32_t id){ return client(id) != NULL; }
 
     void close(uint32_t id, uint16_t code=0, const char * message=NULL);
@@ -285,6 +404,7 @@ class AsyncWebSocket: public AsyncWebHandler {
     void textAll(const String &message);
     void textAll(const __FlashStringHelper *message); //  need to convert
     void textAll(AsyncWebSocketMessageBuffer * buffer); 
+    void textAll(AsyncWebSocketMessageBuffer * buffer, AwsClientFilter filter, AwsMessageClass messageClass=WS_MSG_DEFAULT, uint8_t key=0);
 
     void binary(uint32_t id, const char * message, size_t len);
     void binary(uint32_t id, const char * message);
@@ -300,6 +420,7 @@ class AsyncWebSocket: public AsyncWebHandler {
     void binaryAll(const String &message);
     void binaryAll(const __FlashStringHelper *message, size_t len);
     void binaryAll(AsyncWebSocketMessageBuffer * buffer); 
+    void binaryAll(AsyncWebSocketMessageBuffer * buffer, AwsClientFilter filter, AwsMessageClass messageClass=WS_MSG_DEFAULT, uint8_t key=0);
 
     void message(uint32_t id, AsyncWebSocketMessage *message);
     void messageAll(AsyncWebSocketMultiMessage *message);
@@ -328,6 +449,9 @@ class AsyncWebSocket: public AsyncWebHandler {
     //  messagebuffer functions/objects. 
     AsyncWebSocketMessageBuffer * makeBuffer(size_t size = 0); 
     AsyncWebSocketMessageBuffer * makeBuffer(uint8_t * data, size_t size); 
+    //buffer of `size` bytes to serialize a message into once and queue to any number of clients.
+    //it is locked, so it is kept until textAll()/binaryAll() have queued it or it is unlocked
+    AsyncWebSocketMessageBuffer * reserveBuffer(size_t size);
     LinkedList<AsyncWebSocketMessageBuffer *> _buffers;
     void _cleanBuffers(); 
 
@@ -339,8 +463,10 @@ class AsyncWebSocketResponse: public AsyncWebServerResponse {
   private:
     String _content;
     AsyncWebSocket *_server;
+    String _protocol;
+    bool _deflate;
   public:
-    AsyncWebSocketResponse(const String& key, AsyncWebSocket *server);
+    AsyncWebSocketResponse(const String& key, AsyncWebSocket *server, const String& protocol = String(), bool deflate = false);
     void _respond(AsyncWebServerRequest *request);
     size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time);
     bool _sourceValid() const { return true; }
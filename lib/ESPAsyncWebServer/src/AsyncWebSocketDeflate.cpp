@@ -0,0 +1,286 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "AsyncWebSocketDeflate.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef ESP32
+#include "rom/miniz.h"
+#endif
+
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_HASH_BITS 10
+#define DEFLATE_HASH_SIZE (1 << DEFLATE_HASH_BITS)
+//candidates tried for each match, more compress better but slower
+#define DEFLATE_MAX_CHAIN 16
+
+static const uint16_t lengthBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t lengthExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distanceBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distanceExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+AsyncWebSocketDeflater::AsyncWebSocketDeflater(uint8_t windowBits)
+  :_pos(0)
+  ,_end(0)
+  ,_outLen(0)
+  ,_bits(0)
+  ,_bitCount(0)
+  ,_finished(false)
+{
+  //the window has to be larger than a match, and its positions have to fit _head
+  if(windowBits < 9)
+    windowBits = 9;
+  if(windowBits > 14)
+    windowBits = 14;
+  _windowBits = windowBits;
+  _windowSize = 1 << windowBits;
+  _window = (uint8_t*)malloc(2 * _windowSize);
+  _head = (uint16_t*)calloc(DEFLATE_HASH_SIZE, sizeof(uint16_t));
+  _prev = (uint16_t*)calloc(2 * _windowSize, sizeof(uint16_t));
+  _out = (uint8_t*)malloc(WS_DEFLATE_OUTPUT_SIZE);
+
+  //one block with the fixed codes: BFINAL 0, BTYPE 01
+  if(valid())
+    _putBits(0x02, 3);
+}
+
+AsyncWebSocketDeflater::~AsyncWebSocketDeflater(){
+  free(_window);
+  free(_head);
+  free(_prev);
+  free(_out);
+}
+
+size_t AsyncWebSocketDeflater::writable() const {
+  if(_finished)
+    return 0;
+  //a literal takes at most 9 bits, and the input not compressed yet may all come out as literals
+  if(available() + 16 >= WS_DEFLATE_OUTPUT_SIZE)
+    return 0;
+  size_t room = WS_DEFLATE_OUTPUT_SIZE - available() - 16;
+  size_t pending = (_end - _pos) + DEFLATE_MAX_MATCH;
+  size_t fits = room * 8 / 9;
+  return (fits > pending)?(fits - pending):0;
+}
+
+void AsyncWebSocketDeflater::write(const uint8_t * data, size_t len){
+  if(_finished || !valid())
+    return;
+  while(len){
+    if(_end == 2 * _windowSize)
+      _slide();
+    size_t toCopy = 2 * _windowSize - _end;
+    if(toCopy > len)
+      toCopy = len;
+    memcpy(_window + _end, data, toCopy);
+    _end += toCopy;
+    data += toCopy;
+    len -= toCopy;
+    _compress(false);
+  }
+}
+
+void AsyncWebSocketDeflater::finish(){
+  if(_finished || !valid())
+    return;
+  _compress(true);
+  //end of block, then the header of an empty stored block padded to a byte.
+  //its 0x00 0x00 0xff 0xff length is left off, the client adds it back
+  _putCode(0, 7);
+  _putBits(0, 3);
+  if(_bitCount)
+    _putBits(0, 8 - _bitCount);
+  _finished = true;
+}
+
+size_t AsyncWebSocketDeflater::read(uint8_t * data, size_t len){
+  if(len > available())
+    len = available();
+  memcpy(data, _out, len);
+  _outLen -= len;
+  memmove(_out, _out + len, _outLen);
+  return len;
+}
+
+/*
+ * Compresses the input up to the last DEFLATE_MAX_MATCH bytes, which are kept so a match
+ * can run on into the next write. With flush everything is compressed.
+ */
+void AsyncWebSocketDeflater::_compress(bool flush){
+  while(_pos < _end && (flush || _end - _pos >= DEFLATE_MAX_MATCH)){
+    size_t distance = 0;
+    size_t len = _match(_pos, distance);
+    if(len >= DEFLATE_MIN_MATCH){
+      _putMatch(len, distance);
+      for(size_t i = 0; i < len; i++)
+        _insert(_pos + i);
+      _pos += len;
+    } else {
+      _putLiteral(_window[_pos]);
+      _insert(_pos);
+      _pos++;
+    }
+  }
+}
+
+/*
+ * Drops the older half of the input once the buffer is full. What is left is still a
+ * whole window behind the next byte to compress, as writes leave at most DEFLATE_MAX_MATCH
+ * bytes uncompressed.
+ */
+void AsyncWebSocketDeflater::_slide(){
+  memmove(_window, _window + _windowSize, _windowSize);
+  memmove(_prev, _prev + _windowSize, _windowSize * sizeof(uint16_t));
+  memset(_prev + _windowSize, 0, _windowSize * sizeof(uint16_t));
+  for(size_t i = 0; i < DEFLATE_HASH_SIZE; i++)
+    _head[i] = (_head[i] > _windowSize)?(_head[i] - _windowSize):0;
+  for(size_t i = 0; i < _windowSize; i++)
+    _prev[i] = (_prev[i] > _windowSize)?(_prev[i] - _windowSize):0;
+  _pos -= _windowSize;
+  _end -= _windowSize;
+}
+
+static inline uint16_t deflateHash(const uint8_t * p){
+  return ((p[0] << 6) ^ (p[1] << 3) ^ p[2]) & (DEFLATE_HASH_SIZE - 1);
+}
+
+void AsyncWebSocketDeflater::_insert(size_t pos){
+  if(_end - pos < DEFLATE_MIN_MATCH)
+    return;
+  uint16_t hash = deflateHash(_window + pos);
+  _prev[pos] = _head[hash];
+  _head[hash] = pos + 1;
+}
+
+size_t AsyncWebSocketDeflater::_match(size_t pos, size_t &distance){
+  size_t maxLen = _end - pos;
+  if(maxLen < DEFLATE_MIN_MATCH)
+    return 0;
+  if(maxLen > DEFLATE_MAX_MATCH)
+    maxLen = DEFLATE_MAX_MATCH;
+  size_t best = 0;
+  uint16_t candidate = _head[deflateHash(_window + pos)];
+  for(int chain = 0; candidate && chain < DEFLATE_MAX_CHAIN; chain++){
+    size_t from = candidate - 1;
+    if(from >= pos || pos - from > _windowSize)
+      break;
+    size_t len = 0;
+    while(len < maxLen && _window[from + len] == _window[pos + len])
+      len++;
+    if(len > best){
+      best = len;
+      distance = pos - from;
+      if(len == maxLen)
+        break;
+    }
+    candidate = _prev[from];
+  }
+  return best;
+}
+
+void AsyncWebSocketDeflater::_putBits(uint32_t value, uint8_t count){
+  _bits |= value << _bitCount;
+  _bitCount += count;
+  while(_bitCount >= 8){
+    if(_outLen < WS_DEFLATE_OUTPUT_SIZE)
+      _out[_outLen++] = _bits & 0xFF;
+    _bits >>= 8;
+    _bitCount -= 8;
+  }
+}
+
+//Huffman codes go out with their first bit first, the other way around to plain values
+void AsyncWebSocketDeflater::_putCode(uint16_t code, uint8_t len){
+  uint16_t reversed = 0;
+  for(uint8_t i = 0; i < len; i++){
+    reversed = (reversed << 1) | (code & 1);
+    code >>= 1;
+  }
+  _putBits(reversed, len);
+}
+
+void AsyncWebSocketDeflater::_putLiteral(uint16_t symbol){
+  if(symbol < 144)
+    _putCode(0x30 + symbol, 8);
+  else if(symbol < 256)
+    _putCode(0x190 + symbol - 144, 9);
+  else if(symbol < 280)
+    _putCode(symbol - 256, 7);
+  else
+    _putCode(0xC0 + symbol - 280, 8);
+}
+
+void AsyncWebSocketDeflater::_putMatch(size_t len, size_t distance){
+  uint8_t code = 28;
+  while(lengthBase[code] > len)
+    code--;
+  _putLiteral(257 + code);
+  if(lengthExtra[code])
+    _putBits(len - lengthBase[code], lengthExtra[code]);
+
+  code = 29;
+  while(distanceBase[code] > distance)
+    code--;
+  _putCode(code, 5);
+  if(distanceExtra[code])
+    _putBits(distance - distanceBase[code], distanceExtra[code]);
+}
+
+int AsyncWebSocketDeflater::inflate(const uint8_t * data, size_t len, uint8_t * out, size_t outLen){
+#ifdef ESP32
+  //the sender left off the length of the empty stored block the message ends with
+  uint8_t * input = (uint8_t*)malloc(len + 4);
+  tinfl_decompressor * inflater = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+  if(input == NULL || inflater == NULL){
+    free(input);
+    free(inflater);
+    return -1;
+  }
+  memcpy(input, data, len);
+  memcpy(input + len, "\x00\x00\xff\xff", 4);
+  size_t inLen = len + 4;
+  size_t written = outLen;
+  tinfl_init(inflater);
+  tinfl_status status = tinfl_decompress(inflater, input, &inLen, out, out, &written,
+    TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+  bool whole = inLen == len + 4;
+  free(input);
+  free(inflater);
+  if((status != TINFL_STATUS_DONE && status != TINFL_STATUS_NEEDS_MORE_INPUT) || !whole)
+    return -1;
+  return written;
+#else
+  (void)data; (void)len; (void)out; (void)outLen;
+  return -1;
+#endif
+}
@@ -0,0 +1,89 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBSOCKETDEFLATE_H_
+#define ASYNCWEBSOCKETDEFLATE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+//compressed bytes a deflater holds before they are read
+#ifndef WS_DEFLATE_OUTPUT_SIZE
+#define WS_DEFLATE_OUTPUT_SIZE 1536
+#endif
+
+//largest message a compressed client message is inflated to
+#ifndef WS_INFLATE_MAX_SIZE
+#define WS_INFLATE_MAX_SIZE 1024
+#endif
+
+/*
+ * Compresses one message for permessage-deflate (RFC 7692) without context takeover.
+ *
+ * Input is written a piece at a time and matched against the last 2^windowBits bytes,
+ * so a message of any length takes about 6 * 2^windowBits bytes plus the output buffer.
+ * Matches are coded with the fixed Huffman codes, which saves building code tables and
+ * still does well on the repeated keys of JSON. finish() ends the message the way
+ * RFC 7692 wants it, without the trailing 0x00 0x00 0xff 0xff.
+ */
+class AsyncWebSocketDeflater {
+  private:
+    uint8_t _windowBits;
+    size_t _windowSize;
+    uint8_t * _window;   //two windows of input, the one matched against and the one being compressed
+    uint16_t * _head;    //last position + 1 of each hash, 0 if none
+    uint16_t * _prev;    //position + 1 before it with the same hash
+    size_t _pos;         //next input byte to compress
+    size_t _end;         //end of the input
+    uint8_t * _out;
+    size_t _outLen;
+    uint32_t _bits;
+    uint8_t _bitCount;
+    bool _finished;
+
+    void _compress(bool flush);
+    void _slide();
+    void _insert(size_t pos);
+    size_t _match(size_t pos, size_t &distance);
+    void _putBits(uint32_t value, uint8_t count);
+    void _putCode(uint16_t code, uint8_t len);
+    void _putLiteral(uint16_t symbol);
+    void _putMatch(size_t len, size_t distance);
+
+  public:
+    AsyncWebSocketDeflater(uint8_t windowBits = 10);
+    ~AsyncWebSocketDeflater();
+    bool valid() const { return _window && _head && _prev && _out; }
+    uint8_t windowBits() const { return _windowBits; }
+    //input that can be written without the compressed output overflowing
+    size_t writable() const;
+    void write(const uint8_t * data, size_t len);
+    //compresses the rest of the input and ends the message
+    void finish();
+    bool finished() const { return _finished; }
+    //compressed bytes waiting to be read
+    size_t available() const { return _outLen; }
+    size_t read(uint8_t * data, size_t len);
+
+    //inflates a message from a client into out. returns its length, or -1 if it isn't valid or doesn't fit
+    static int inflate(const uint8_t * data, size_t len, uint8_t * out, size_t outLen);
+};
+
+#endif /* ASYNCWEBSOCKETDEFLATE_H_ */
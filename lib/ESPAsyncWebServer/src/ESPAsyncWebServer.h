@@ -54,8 +54,12 @@ class AsyncWebParameter;
 class AsyncWebRewrite;
 class AsyncWebHandler;
 class AsyncStaticWebHandler;
+class AsyncProgmemWebHandler;
+struct AsyncProgmemAsset;
 class AsyncCallbackWebHandler;
 class AsyncResponseStream;
+class AsyncWebRouteTable;
+class AsyncWebBufferPool;
 
 #ifndef WEBSERVER_H
 typedef enum {
@@ -128,6 +132,16 @@ class AsyncWebHeader {
 
 typedef enum { RCT_NOT_USED = -1, RCT_DEFAULT = 0, RCT_HTTP, RCT_WS, RCT_EVENT, RCT_MAX } RequestedConnectionType;
 
+//bytes of request line and headers a request can have, larger ones get a 431
+#ifndef WEB_REQUEST_HEAD_SIZE
+#define WEB_REQUEST_HEAD_SIZE 1536
+#endif
+
+//headers a request can have, more get a 431
+#ifndef WEB_REQUEST_MAX_HEADERS
+#define WEB_REQUEST_MAX_HEADERS 32
+#endif
+
 typedef std::function<size_t(uint8_t*, size_t, size_t)> AwsResponseFiller;
 typedef std::function<String(const String&)> AwsTemplateProcessor;
 
@@ -147,6 +161,23 @@ class AsyncWebServerRequest {
     String _temp;
     uint8_t _parseState;
 
+    //the request line and headers as they came in, each line ends with a 0.
+    //headers and the query string are kept as offsets into it
+    char _head[WEB_REQUEST_HEAD_SIZE];
+    size_t _headLength;
+    size_t _lineStart;
+    struct HeaderView {
+      uint16_t name;
+      uint16_t value;
+    };
+    HeaderView _headerViews[WEB_REQUEST_MAX_HEADERS];
+    uint8_t _headerCount;
+    //made the first time a header is asked for as an AsyncWebHeader
+    mutable AsyncWebHeader* _headerObjects[WEB_REQUEST_MAX_HEADERS];
+    uint16_t _query;
+    uint16_t _queryLength;
+    mutable bool _queryParsed;
+
     uint8_t _version;
     WebRequestMethodComposite _method;
     String _url;
@@ -155,6 +186,11 @@ class AsyncWebServerRequest {
     String _boundary;
     String _authorization;
     RequestedConnectionType _reqconntype;
+    bool _connectionClose;       //Connection: close
+    bool _connectionKeepAlive;   //Connection: keep-alive
+    bool _keepAlive;
+    uint16_t _requestCount;      //requests answered on the connection before this one
+    std::vector<uint8_t> _pipelined;   //the next requests, sent before this one was answered
     void _removeNotInterestingHeaders();
     bool _isDigest;
     bool _isMultipart;
@@ -163,8 +199,7 @@ class AsyncWebServerRequest {
     size_t _contentLength;
     size_t _parsedLength;
 
-    LinkedList<AsyncWebHeader *> _headers;
-    LinkedList<AsyncWebParameter *> _params;
+    mutable LinkedList<AsyncWebParameter *> _params;
     LinkedList<String *> _pathParams;
 
     uint8_t _multiParseState;
@@ -185,13 +220,18 @@ class AsyncWebServerRequest {
     void _onTimeout(uint32_t time);
     void _onDisconnect();
     void _onData(void *buf, size_t len);
+    void _recycle();
 
     void _addParam(AsyncWebParameter*);
     void _addPathParam(const char *param);
 
-    bool _parseReqHead();
-    bool _parseReqHeader();
-    void _parseLine();
+    bool _parseReqHead(char *line);
+    bool _parseReqHeader(char *line);
+    void _parseLine(char *line, size_t len);
+    int _findHeader(const char *name) const;
+    AsyncWebHeader* _header(size_t num) const;
+    void _parseQuery() const;
+    void _decodeParams(const char *params, size_t len) const;
     void _parsePlainPostChar(uint8_t data);
     void _parseMultipartPostByte(uint8_t data, bool last);
     void _addGetParams(const String& params);
@@ -208,6 +248,7 @@ class AsyncWebServerRequest {
     ~AsyncWebServerRequest();
 
     AsyncClient* client(){ return _client; }
+    AsyncWebServer* server(){ return _server; }
     uint8_t version() const { return _version; }
     WebRequestMethodComposite method() const { return _method; }
     const String& url() const { return _url; }
@@ -220,6 +261,9 @@ class AsyncWebServerRequest {
     RequestedConnectionType requestedConnType() const { return _reqconntype; }
     bool isExpectedRequestedConnType(RequestedConnectionType erct1, RequestedConnectionType erct2 = RCT_NOT_USED, RequestedConnectionType erct3 = RCT_NOT_USED);
     void onDisconnect (ArDisconnectHandler fn);
+    //the connection is kept for another request once the response is acked
+    bool keepAlive() const { return _keepAlive; }
+    void setKeepAlive(bool keepAlive);
 
     //hash is the string representation of:
     // base64(user:pass) for basic or
@@ -345,6 +389,8 @@ class AsyncWebHandler {
     virtual void handleUpload(AsyncWebServerRequest *request  __attribute__((unused)), const String& filename __attribute__((unused)), size_t index __attribute__((unused)), uint8_t *data __attribute__((unused)), size_t len __attribute__((unused)), bool final  __attribute__((unused))){}
     virtual void handleBody(AsyncWebServerRequest *request __attribute__((unused)), uint8_t *data __attribute__((unused)), size_t len __attribute__((unused)), size_t index __attribute__((unused)), size_t total __attribute__((unused))){}
     virtual bool isRequestHandlerTrivial(){return true;}
+    //the plain uri and methods of a handler that matches nothing else, for the route table
+    virtual bool route(String& uri __attribute__((unused)), WebRequestMethodComposite& method __attribute__((unused))){ return false; }
 };
 
 /*
@@ -400,6 +446,14 @@ class AsyncWebServer {
     LinkedList<AsyncWebRewrite*> _rewrites;
     LinkedList<AsyncWebHandler*> _handlers;
     AsyncCallbackWebHandler* _catchAllHandler;
+    AsyncWebRouteTable* _routeTable;
+    bool _routeTableEnabled;
+    bool _routeTableValid;
+    uint32_t _keepAliveTimeout;
+    uint16_t _keepAliveRequests;
+    AsyncWebBufferPool* _sendBuffers;
+
+    void _buildRouteTable();
 
   public:
     AsyncWebServer(uint16_t port);
@@ -407,6 +461,15 @@ class AsyncWebServer {
 
     void begin();
     void end();
+    //finds handlers in a table built from them when the server begins, instead of asking each in turn
+    void enableRouteTable(bool enable = true);
+    //keeps connections open for up to maxRequests requests, closing them after timeout seconds
+    //without one. a timeout of 0 closes each after its first response
+    void keepAlive(uint32_t timeout, uint16_t maxRequests = 100);
+    uint32_t keepAliveTimeout() const { return _keepAliveTimeout; }
+    uint16_t keepAliveRequests() const { return _keepAliveRequests; }
+    //buffers the responses of this server are written from
+    AsyncWebBufferPool* sendBuffers() const { return _sendBuffers; }
 
 #if ASYNC_TCP_SSL_ENABLED
     void onSslFileRequest(AcSSlFileHandler cb, void* arg);
@@ -426,6 +489,8 @@ class AsyncWebServer {
     AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody);
 
     AsyncStaticWebHandler& serveStatic(const char* uri, fs::FS& fs, const char* path, const char* cache_control = NULL);
+    //serves files compiled into flash, from a table sorted by path
+    AsyncProgmemWebHandler& serveProgmem(const AsyncProgmemAsset* assets, size_t count);
 
     void onNotFound(ArRequestHandlerFunction fn);  //called when handler is not assigned
     void onFileUpload(ArUploadHandlerFunction fn); //handle file uploads
@@ -157,6 +157,20 @@ class LinkedList {
       }
       return false;
     }
+    bool replace_first(Predicate predicate, const T& t){
+      auto it = _root;
+      while(it){
+        if(predicate(it->value())){
+          if (_onRemove) {
+            _onRemove(it->value());
+          }
+          it->value() = t;
+          return true;
+        }
+        it = it->next;
+      }
+      return false;
+    }
     
     void free(){
       while(_root != nullptr){
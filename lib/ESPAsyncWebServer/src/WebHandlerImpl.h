@@ -22,6 +22,7 @@
 #define ASYNCWEBSERVERHANDLERIMPL_H_
 
 #include <string>
+#include <vector>
 #ifdef ASYNCWEBSERVER_REGEX
 #include <regex>
 #endif
@@ -36,7 +37,13 @@ class AsyncStaticWebHandler: public AsyncWebHandler {
     bool _getFile(AsyncWebServerRequest *request);
     bool _fileExists(AsyncWebServerRequest *request, const String& path);
     uint8_t _countBits(const uint8_t value) const;
+    String _etag(File& file);
   protected:
+    struct ETag {
+      String name;
+      size_t size;
+      String etag;
+    };
     FS _fs;
     String _uri;
     String _path;
@@ -47,6 +54,7 @@ class AsyncStaticWebHandler: public AsyncWebHandler {
     bool _isDir;
     bool _gzipFirst;
     uint8_t _gzipStats;
+    std::vector<ETag> _etags;
   public:
     AsyncStaticWebHandler(const char* uri, FS& fs, const char* path, const char* cache_control);
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
@@ -63,6 +71,33 @@ class AsyncStaticWebHandler: public AsyncWebHandler {
     AsyncStaticWebHandler& setTemplateProcessor(AwsTemplateProcessor newCallback) {_callback = newCallback; return *this;}
 };
 
+//a file compiled into flash. data, etag and everything else has to stay valid for as long as it is served
+struct AsyncProgmemAsset {
+  const char* path;          //e.g. "/index.html"
+  const char* contentType;
+  const char* cacheControl;  //NULL for none
+  const char* etag;          //strong ETag, quoted. NULL for none
+  bool gzip;                 //data is gzipped
+  const uint8_t* data;       //in PROGMEM
+  size_t len;
+};
+
+//serves files from a table of AsyncProgmemAsset sorted by path, without touching a filesystem
+class AsyncProgmemWebHandler: public AsyncWebHandler {
+  private:
+    const AsyncProgmemAsset* _assets;
+    size_t _count;
+    String _uri;
+    String _default_file;
+    const AsyncProgmemAsset* _find(AsyncWebServerRequest *request) const;
+  public:
+    AsyncProgmemWebHandler(const AsyncProgmemAsset* assets, size_t count, const char* uri = "/");
+    AsyncProgmemWebHandler& setDefaultFile(const char* filename);
+    virtual bool canHandle(AsyncWebServerRequest *request) override final;
+    virtual void handleRequest(AsyncWebServerRequest *request) override final;
+    virtual bool isRequestHandlerTrivial() override final { return true; }
+};
+
 class AsyncCallbackWebHandler: public AsyncWebHandler {
   private:
   protected:
@@ -124,6 +159,14 @@ class AsyncCallbackWebHandler: public AsyncWebHandler {
       request->addInterestingHeader("ANY");
       return true;
     }
+
+    virtual bool route(String& uri, WebRequestMethodComposite& method) override final{
+      if(!_uri.length() || !_uri.startsWith("/") || _uri.startsWith("/*.") || _uri.endsWith("*"))
+        return false;
+      uri = _uri;
+      method = _method;
+      return true;
+    }
   
     virtual void handleRequest(AsyncWebServerRequest *request) override final {
       if((_username != "" && _password != "") && !request->authenticate(_username.c_str(), _password.c_str()))
@@ -20,6 +20,9 @@
 */
 #include "ESPAsyncWebServer.h"
 #include "WebHandlerImpl.h"
+#ifdef ESP32
+#include "rom/crc.h"
+#endif
 
 AsyncStaticWebHandler::AsyncStaticWebHandler(const char* uri, FS& fs, const char* path, const char* cache_control)
   : _fs(fs), _uri(uri), _path(path), _default_file("index.htm"), _cache_control(cache_control), _last_modified(""), _callback(nullptr)
@@ -176,6 +179,38 @@ bool AsyncStaticWebHandler::_fileExists(AsyncWebServerRequest *request, const St
   return found;
 }
 
+/*
+ * Strong ETag of a file, from a crc of its content. Files only change with a new
+ * filesystem image, so it is worked out once per file and kept.
+ */
+String AsyncStaticWebHandler::_etag(File& file)
+{
+#ifdef ESP32
+  String name = file.path();
+#else
+  String name = file.fullName();
+#endif
+  size_t size = file.size();
+  for(const auto& e: _etags){
+    if(e.size == size && e.name == name)
+      return e.etag;
+  }
+#ifdef ESP32
+  uint32_t crc = 0;
+  uint8_t buf[256];
+  size_t len;
+  while((len = file.read(buf, sizeof(buf))) > 0)
+    crc = crc32_le(crc, buf, len);
+  file.seek(0);
+  char etag[24];
+  snprintf(etag, sizeof(etag), "\"%08x-%x\"", crc, (unsigned int)size);
+  _etags.push_back({name, size, String(etag)});
+#else
+  _etags.push_back({name, size, "\"" + String(size) + "\""});
+#endif
+  return _etags.back().etag;
+}
+
 uint8_t AsyncStaticWebHandler::_countBits(const uint8_t value) const
 {
   uint8_t w = value;
@@ -194,11 +229,11 @@ void AsyncStaticWebHandler::handleRequest(AsyncWebServerRequest *request)
       return request->requestAuthentication();
 
   if (request->_tempFile == true) {
-    String etag = String(request->_tempFile.size());
+    String etag = _cache_control.length() ? _etag(request->_tempFile) : String();
     if (_last_modified.length() && _last_modified == request->header("If-Modified-Since")) {
       request->_tempFile.close();
       request->send(304); // Not modified
-    } else if (_cache_control.length() && request->hasHeader("If-None-Match") && request->header("If-None-Match").equals(etag)) {
+    } else if (_cache_control.length() && request->hasHeader("If-None-Match") && request->header("If-None-Match").indexOf(etag) >= 0) {
       request->_tempFile.close();
       AsyncWebServerResponse * response = new AsyncBasicResponse(304); // Not modified
       response->addHeader("Cache-Control", _cache_control);
@@ -218,3 +253,73 @@ void AsyncStaticWebHandler::handleRequest(AsyncWebServerRequest *request)
     request->send(404);
   }
 }
+
+AsyncProgmemWebHandler::AsyncProgmemWebHandler(const AsyncProgmemAsset* assets, size_t count, const char* uri)
+  : _assets(assets), _count(count), _uri(uri), _default_file("index.html")
+{
+  // Ensure leading '/', and drop the trailing one like AsyncStaticWebHandler does
+  if (_uri.length() == 0 || _uri[0] != '/') _uri = "/" + _uri;
+  if (_uri[_uri.length()-1] == '/') _uri = _uri.substring(0, _uri.length()-1);
+}
+
+AsyncProgmemWebHandler& AsyncProgmemWebHandler::setDefaultFile(const char* filename){
+  _default_file = String(filename);
+  return *this;
+}
+
+// binary search, the table is sorted by path
+const AsyncProgmemAsset* AsyncProgmemWebHandler::_find(AsyncWebServerRequest *request) const {
+  const String& url = request->url();
+  if(!url.startsWith(_uri))
+    return NULL;
+  String path = url.substring(_uri.length());
+  if(path.length() == 0)
+    path = "/";
+  if(path[path.length()-1] == '/')
+    path += _default_file;
+
+  size_t low = 0;
+  size_t high = _count;
+  while(low < high){
+    size_t mid = low + (high - low) / 2;
+    int cmp = strcmp(path.c_str(), _assets[mid].path);
+    if(cmp == 0)
+      return &_assets[mid];
+    if(cmp < 0)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  return NULL;
+}
+
+bool AsyncProgmemWebHandler::canHandle(AsyncWebServerRequest *request){
+  if(request->method() != HTTP_GET || !_find(request))
+    return false;
+  request->addInterestingHeader("If-None-Match");
+  return true;
+}
+
+void AsyncProgmemWebHandler::handleRequest(AsyncWebServerRequest *request){
+  if((_username != "" && _password != "") && !request->authenticate(_username.c_str(), _password.c_str()))
+      return request->requestAuthentication();
+
+  const AsyncProgmemAsset* asset = _find(request);
+  if(asset == NULL){
+    request->send(404);
+    return;
+  }
+  AsyncWebServerResponse * response;
+  if(asset->etag && request->hasHeader("If-None-Match") && request->header("If-None-Match").indexOf(asset->etag) >= 0){
+    response = new AsyncBasicResponse(304); // Not modified
+  } else {
+    response = new AsyncProgmemResponse(200, asset->contentType, asset->data, asset->len);
+    if(asset->gzip)
+      response->addHeader("Content-Encoding", "gzip");
+  }
+  if(asset->cacheControl)
+    response->addHeader("Cache-Control", asset->cacheControl);
+  if(asset->etag)
+    response->addHeader("ETag", asset->etag);
+  request->send(response);
+}
@@ -39,6 +39,13 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   , _response(NULL)
   , _temp()
   , _parseState(0)
+  , _headLength(0)
+  , _lineStart(0)
+  , _headerCount(0)
+  , _headerObjects()
+  , _query(0)
+  , _queryLength(0)
+  , _queryParsed(false)
   , _version(0)
   , _method(HTTP_ANY)
   , _url()
@@ -47,13 +54,17 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   , _boundary()
   , _authorization()
   , _reqconntype(RCT_HTTP)
+  , _connectionClose(false)
+  , _connectionKeepAlive(false)
+  , _keepAlive(false)
+  , _requestCount(0)
+  , _pipelined()
   , _isDigest(false)
   , _isMultipart(false)
   , _isPlainPost(false)
   , _expectingContinue(false)
   , _contentLength(0)
   , _parsedLength(0)
-  , _headers(LinkedList<AsyncWebHeader *>([](AsyncWebHeader *h){ delete h; }))
   , _params(LinkedList<AsyncWebParameter *>([](AsyncWebParameter *p){ delete p; }))
   , _pathParams(LinkedList<String *>([](String *p){ delete p; }))
   , _multiParseState(0)
@@ -78,7 +89,8 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
 }
 
 AsyncWebServerRequest::~AsyncWebServerRequest(){
-  _headers.free();
+  for(uint8_t i = 0; i < _headerCount; i++)
+    delete _headerObjects[i];
 
   _params.free();
   _pathParams.free();
@@ -102,7 +114,11 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
   size_t i = 0;
   while (true) {
 
-  if(_parseState < PARSE_REQ_BODY){
+  if(_parseState == PARSE_REQ_END){
+    // The next request, sent before this one was answered. Too many of them close the connection
+    if(_keepAlive && _pipelined.size() <= WEB_REQUEST_HEAD_SIZE)
+      _pipelined.insert(_pipelined.end(), (uint8_t*)buf, (uint8_t*)buf + len);
+  } else if(_parseState < PARSE_REQ_BODY){
     // Find new line in buf
     char *str = (char*)buf;
     for (i = 0; i < len; i++) {
@@ -110,17 +126,18 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
         break;
       }
     }
-    if (i == len) { // No new line, just add the buffer in _temp
-      char ch = str[len-1];
-      str[len-1] = 0;
-      _temp.reserve(_temp.length()+len);
-      _temp.concat(str);
-      _temp.concat(ch);
-    } else { // Found new line - extract it and parse
-      str[i] = 0; // Terminate the string at the end of the line.
-      _temp.concat(str);
-      _temp.trim();
-      _parseLine();
+    // Add it to the head, with room left for the 0 ending the line
+    if (_headLength + i >= WEB_REQUEST_HEAD_SIZE) {
+      _parseState = PARSE_REQ_FAIL;
+      send(431);
+      return;
+    }
+    memcpy(_head + _headLength, str, i);
+    _headLength += i;
+    if (i < len) { // Found new line - terminate it and parse it where it is
+      _head[_headLength++] = 0;
+      _parseLine(_head + _lineStart, _headLength - 1 - _lineStart);
+      _lineStart = _headLength;
       if (++i < len) {
         // Still have more buffer to process
         buf = str+i;
@@ -129,6 +146,12 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
       }
     }
   } else if(_parseState == PARSE_REQ_BODY){
+    // The next request can follow the body in the same packet
+    size_t rest = 0;
+    if(len > _contentLength - _parsedLength){
+      rest = len - (_contentLength - _parsedLength);
+      len -= rest;
+    }
     // A handler should be already attached at this point in _parseLine function.
     // If handler does nothing (_onRequest is NULL), we don't need to really parse the body.
     const bool needParse = _handler && !_handler->isRequestHandlerTrivial();
@@ -172,25 +195,134 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
       //check if authenticated before calling handleRequest and request auth instead
       if(_handler) _handler->handleRequest(this);
       else send(501);
+      if(rest){
+        buf = (uint8_t*)buf + len;
+        len = rest;
+        continue;
+      }
     }
   }
   break;
   }
 }
 
+/*
+ * Makes the request ready for the next one on its connection, once its response is acked.
+ * The head buffer and the request itself are used again, and requests that came in while
+ * this one was answered are parsed now.
+ */
+void AsyncWebServerRequest::_recycle(){
+  if(_pipelined.size() > WEB_REQUEST_HEAD_SIZE){
+    _client->close();
+    return;
+  }
+  if(_onDisconnectfn){
+    _onDisconnectfn();
+    _onDisconnectfn = nullptr;
+  }
+  delete _response;
+  _response = NULL;
+  _handler = NULL;
+
+  for(uint8_t i = 0; i < _headerCount; i++){
+    delete _headerObjects[i];
+    _headerObjects[i] = NULL;
+  }
+  _headerCount = 0;
+  _headLength = 0;
+  _lineStart = 0;
+  _query = 0;
+  _queryLength = 0;
+  _queryParsed = false;
+  _params.free();
+  _pathParams.free();
+  _interestingHeaders.free();
+
+  _temp = String();
+  _parseState = PARSE_REQ_START;
+  _version = 0;
+  _method = HTTP_ANY;
+  _url = String();
+  _host = String();
+  _contentType = String();
+  _boundary = String();
+  _authorization = String();
+  _reqconntype = RCT_HTTP;
+  _connectionClose = false;
+  _connectionKeepAlive = false;
+  _keepAlive = false;
+  _isDigest = false;
+  _isMultipart = false;
+  _isPlainPost = false;
+  _expectingContinue = false;
+  _contentLength = 0;
+  _parsedLength = 0;
+
+  _multiParseState = 0;
+  _boundaryPosition = 0;
+  _itemStartIndex = 0;
+  _itemSize = 0;
+  _itemName = String();
+  _itemFilename = String();
+  _itemType = String();
+  _itemValue = String();
+  if(_itemBuffer){
+    free(_itemBuffer);
+    _itemBuffer = NULL;
+  }
+  _itemBufferIndex = 0;
+  _itemIsFile = false;
+  if(_tempObject != NULL){
+    free(_tempObject);
+    _tempObject = NULL;
+  }
+  if(_tempFile){
+    _tempFile.close();
+  }
+
+  _requestCount++;
+  _client->setRxTimeout(_server->keepAliveTimeout());
+  if(!_pipelined.empty()){
+    std::vector<uint8_t> data;
+    data.swap(_pipelined);
+    _onData(data.data(), data.size());
+  }
+}
+
+void AsyncWebServerRequest::setKeepAlive(bool keepAlive){
+  _keepAlive = keepAlive && _server->keepAliveTimeout();
+}
+
 void AsyncWebServerRequest::_removeNotInterestingHeaders(){
   if (_interestingHeaders.containsIgnoreCase("ANY")) return; // nothing to do
-  for(const auto& header: _headers){
-      if(!_interestingHeaders.containsIgnoreCase(header->name().c_str())){
-        _headers.remove(header);
+  uint8_t kept = 0;
+  for(uint8_t i = 0; i < _headerCount; i++){
+    bool interesting = false;
+    for(const auto& name: _interestingHeaders){
+      if(!strcasecmp(name.c_str(), _head + _headerViews[i].name)){
+        interesting = true;
+        break;
       }
+    }
+    if(interesting){
+      _headerViews[kept] = _headerViews[i];
+      _headerObjects[kept++] = _headerObjects[i];
+    } else {
+      delete _headerObjects[i];
+    }
   }
+  for(uint8_t i = kept; i < _headerCount; i++)
+    _headerObjects[i] = NULL;
+  _headerCount = kept;
 }
 
 void AsyncWebServerRequest::_onPoll(){
   //os_printf("p\n");
   if(_response != NULL && _client != NULL && _client->canSend() && !_response->_finished()){
+    bool keepAlive = _keepAlive;
     _response->_ack(this, 0, 0);
+    if(keepAlive && _response->_finished())
+      _recycle();
   }
 }
 
@@ -198,7 +330,11 @@ void AsyncWebServerRequest::_onAck(size_t len, uint32_t time){
   //os_printf("a:%u:%u\n", len, time);
   if(_response != NULL){
     if(!_response->_finished()){
+      //responses on a kept connection don't close it or hand it over, so the request is still here after
+      bool keepAlive = _keepAlive;
       _response->_ack(this, len, time);
+      if(keepAlive && _response->_finished())
+        _recycle();
     } else {
       AsyncWebServerResponse* r = _response;
       _response = NULL;
@@ -230,6 +366,8 @@ void AsyncWebServerRequest::_onDisconnect(){
 }
 
 void AsyncWebServerRequest::_addParam(AsyncWebParameter *p){
+  //the query string comes first
+  _parseQuery();
   _params.add(p);
 }
 
@@ -238,116 +376,165 @@ void AsyncWebServerRequest::_addPathParam(const char *p){
 }
 
 void AsyncWebServerRequest::_addGetParams(const String& params){
+  _parseQuery();
+  _decodeParams(params.c_str(), params.length());
+}
+
+void AsyncWebServerRequest::_parseQuery() const {
+  if(_queryParsed)
+    return;
+  _queryParsed = true;
+  if(_queryLength)
+    _decodeParams(_head + _query, _queryLength);
+}
+
+static void urlDecodeTo(String& decoded, const char *text, size_t len){
+  char temp[] = "0x00";
+  size_t i = 0;
+  decoded.reserve(len); // Allocate the string internal buffer - never longer from source text
+  while (i < len){
+    char decodedChar;
+    char encodedChar = text[i++];
+    if ((encodedChar == '%') && (i + 1 < len)){
+      temp[2] = text[i++];
+      temp[3] = text[i++];
+      decodedChar = strtol(temp, NULL, 16);
+    } else if (encodedChar == '+') {
+      decodedChar = ' ';
+    } else {
+      decodedChar = encodedChar;  // normal ascii char
+    }
+    decoded.concat(decodedChar);
+  }
+}
+
+void AsyncWebServerRequest::_decodeParams(const char *params, size_t len) const {
   size_t start = 0;
-  while (start < params.length()){
-    int end = params.indexOf('&', start);
-    if (end < 0) end = params.length();
-    int equal = params.indexOf('=', start);
-    if (equal < 0 || equal > end) equal = end;
-    String name = params.substring(start, equal);
-    String value = equal + 1 < end ? params.substring(equal + 1, end) : String();
-    _addParam(new AsyncWebParameter(urlDecode(name), urlDecode(value)));
+  while (start < len){
+    const char *amp = (const char *)memchr(params + start, '&', len - start);
+    size_t end = amp ? amp - params : len;
+    const char *eq = (const char *)memchr(params + start, '=', end - start);
+    size_t equal = eq ? eq - params : end;
+    String name;
+    String value;
+    urlDecodeTo(name, params + start, equal - start);
+    if (equal + 1 < end) urlDecodeTo(value, params + equal + 1, end - equal - 1);
+    _params.add(new AsyncWebParameter(name, value));
     start = end + 1;
   }
 }
 
-bool AsyncWebServerRequest::_parseReqHead(){
-  // Split the head into method, url and version
-  int index = _temp.indexOf(' ');
-  String m = _temp.substring(0, index);
-  index = _temp.indexOf(' ', index+1);
-  String u = _temp.substring(m.length()+1, index);
-  _temp = _temp.substring(index+1);
+bool AsyncWebServerRequest::_parseReqHead(char *line){
+  // Split the head into method, url and version, ending each with a 0
+  char *url = strchr(line, ' ');
+  if(url) *url++ = 0;
+  else url = line + strlen(line);
+  char *version = strchr(url, ' ');
+  if(version) *version++ = 0;
+  else version = url + strlen(url);
 
-  if(m == "GET"){
+  if(!strcmp(line, "GET")){
     _method = HTTP_GET;
-  } else if(m == "POST"){
+  } else if(!strcmp(line, "POST")){
     _method = HTTP_POST;
-  } else if(m == "DELETE"){
+  } else if(!strcmp(line, "DELETE")){
     _method = HTTP_DELETE;
-  } else if(m == "PUT"){
+  } else if(!strcmp(line, "PUT")){
     _method = HTTP_PUT;
-  } else if(m == "PATCH"){
+  } else if(!strcmp(line, "PATCH")){
     _method = HTTP_PATCH;
-  } else if(m == "HEAD"){
+  } else if(!strcmp(line, "HEAD")){
     _method = HTTP_HEAD;
-  } else if(m == "OPTIONS"){
+  } else if(!strcmp(line, "OPTIONS")){
     _method = HTTP_OPTIONS;
   }
 
-  String g = String();
-  index = u.indexOf('?');
-  if(index > 0){
-    g = u.substring(index +1);
-    u = u.substring(0, index);
+  // The query string is only decoded when a parameter is asked for
+  char *query = strchr(url, '?');
+  if(query && query != url){
+    *query++ = 0;
+    _query = query - _head;
+    _queryLength = strlen(query);
   }
-  _url = urlDecode(u);
-  _addGetParams(g);
+  _url = String();
+  urlDecodeTo(_url, url, strlen(url));
 
-  if(!_temp.startsWith("HTTP/1.0"))
+  if(strncmp(version, "HTTP/1.0", 8))
     _version = 1;
 
-  _temp = String();
   return true;
 }
 
-bool strContains(String src, String find, bool mindcase = true) {
-  int pos=0, i=0;
-  const int slen = src.length();
-  const int flen = find.length();
+bool strContains(const char *src, const char *find, bool mindcase = true) {
+  const size_t slen = strlen(src);
+  const size_t flen = strlen(find);
 
   if (slen < flen) return false;
-  while (pos <= (slen - flen)) {
-    for (i=0; i < flen; i++) {
-      if (mindcase) {
-        if (src[pos+i] != find[i]) i = flen + 1; // no match
-      } else if (tolower(src[pos+i]) != tolower(find[i])) i = flen + 1; // no match
-    }
-    if (i == flen) return true;
-    pos++;
+  for (size_t pos = 0; pos <= slen - flen; pos++) {
+    if (mindcase ? !strncmp(src + pos, find, flen) : !strncasecmp(src + pos, find, flen)) return true;
   }
   return false;
 }
 
-bool AsyncWebServerRequest::_parseReqHeader(){
-  int index = _temp.indexOf(':');
-  if(index){
-    String name = _temp.substring(0, index);
-    String value = _temp.substring(index + 2);
-    if(name.equalsIgnoreCase("Host")){
-      _host = value;
-    } else if(name.equalsIgnoreCase("Content-Type")){
-	  _contentType = value.substring(0, value.indexOf(';'));
-      if (value.startsWith("multipart/")){
-        _boundary = value.substring(value.indexOf('=')+1);
-        _boundary.replace("\"","");
-        _isMultipart = true;
-      }
-    } else if(name.equalsIgnoreCase("Content-Length")){
-      _contentLength = atoi(value.c_str());
-    } else if(name.equalsIgnoreCase("Expect") && value == "100-continue"){
-      _expectingContinue = true;
-    } else if(name.equalsIgnoreCase("Authorization")){
-      if(value.length() > 5 && value.substring(0,5).equalsIgnoreCase("Basic")){
-        _authorization = value.substring(6);
-      } else if(value.length() > 6 && value.substring(0,6).equalsIgnoreCase("Digest")){
-        _isDigest = true;
-        _authorization = value.substring(7);
-      }
+bool AsyncWebServerRequest::_parseReqHeader(char *line){
+  char *value = strchr(line, ':');
+  if(value == NULL || value == line)
+    return true;
+  if(_headerCount == WEB_REQUEST_MAX_HEADERS){
+    _parseState = PARSE_REQ_FAIL;
+    send(431);
+    return false;
+  }
+  *value++ = 0;
+  while(*value == ' ' || *value == '\t')
+    value++;
+  const char *name = line;
+
+  if(!strcasecmp(name, "Host")){
+    _host = value;
+  } else if(!strcasecmp(name, "Content-Type")){
+    char *end = strchr(value, ';');
+    if(end){
+      *end = 0;
+      _contentType = value;
+      *end = ';';
     } else {
-      if(name.equalsIgnoreCase("Upgrade") && value.equalsIgnoreCase("websocket")){
-        // WebSocket request can be uniquely identified by header: [Upgrade: websocket]
-        _reqconntype = RCT_WS;
-      } else {
-        if(name.equalsIgnoreCase("Accept") && strContains(value, "text/event-stream", false)){
-          // WebEvent request can be uniquely identified by header:  [Accept: text/event-stream]
-          _reqconntype = RCT_EVENT;
-        }
+      _contentType = value;
+    }
+    if (!strncmp(value, "multipart/", 10)){
+      const char *boundary = strchr(value, '=');
+      _boundary = boundary ? boundary + 1 : value;
+      _boundary.replace("\"","");
+      _isMultipart = true;
+    }
+  } else if(!strcasecmp(name, "Connection")){
+    _connectionClose = strContains(value, "close", false);
+    _connectionKeepAlive = strContains(value, "keep-alive", false);
+  } else if(!strcasecmp(name, "Content-Length")){
+    _contentLength = atoi(value);
+  } else if(!strcasecmp(name, "Expect") && !strcmp(value, "100-continue")){
+    _expectingContinue = true;
+  } else if(!strcasecmp(name, "Authorization")){
+    if(strlen(value) > 5 && !strncasecmp(value, "Basic", 5)){
+      _authorization = value + 6;
+    } else if(strlen(value) > 6 && !strncasecmp(value, "Digest", 6)){
+      _isDigest = true;
+      _authorization = value + 7;
+    }
+  } else {
+    if(!strcasecmp(name, "Upgrade") && !strcasecmp(value, "websocket")){
+      // WebSocket request can be uniquely identified by header: [Upgrade: websocket]
+      _reqconntype = RCT_WS;
+    } else {
+      if(!strcasecmp(name, "Accept") && strContains(value, "text/event-stream", false)){
+        // WebEvent request can be uniquely identified by header:  [Accept: text/event-stream]
+        _reqconntype = RCT_EVENT;
       }
     }
-    _headers.add(new AsyncWebHeader(name, value));
   }
-  _temp = String();
+  _headerViews[_headerCount].name = name - _head;
+  _headerViews[_headerCount].value = value - _head;
+  _headerCount++;
   return true;
 }
 
@@ -551,24 +738,39 @@ void AsyncWebServerRequest::_parseMultipartPostByte(uint8_t data, bool last){
   }
 }
 
-void AsyncWebServerRequest::_parseLine(){
+void AsyncWebServerRequest::_parseLine(char *line, size_t len){
+  // Trim it where it is, it is already ended with a 0
+  while(len && isspace((unsigned char)line[len - 1]))
+    line[--len] = 0;
+  while(len && isspace((unsigned char)*line)){
+    line++;
+    len--;
+  }
+
   if(_parseState == PARSE_REQ_START){
-    if(!_temp.length()){
+    if(!len && _requestCount){
+      // Clients may end a body with an extra CRLF before the next request
+      return;
+    } else if(!len){
       _parseState = PARSE_REQ_FAIL;
       _client->close();
     } else {
-      _parseReqHead();
+      _parseReqHead(line);
       _parseState = PARSE_REQ_HEADERS;
     }
     return;
   }
 
   if(_parseState == PARSE_REQ_HEADERS){
-    if(!_temp.length()){
+    if(!len){
       //end of headers
       _server->_rewriteRequest(this);
       _server->_attachHandler(this);
       _removeNotInterestingHeaders();
+      // HTTP/1.1 keeps connections unless told not to, HTTP/1.0 only when asked
+      _keepAlive = _server->keepAliveTimeout() && _reqconntype == RCT_HTTP
+        && _requestCount + 1 < _server->keepAliveRequests()
+        && (_version ? !_connectionClose : _connectionKeepAlive);
       if(_expectingContinue){
         const char * response = "HTTP/1.1 100 Continue\r\n\r\n";
         _client->write(response, os_strlen(response));
@@ -581,21 +783,33 @@ void AsyncWebServerRequest::_parseLine(){
         if(_handler) _handler->handleRequest(this);
         else send(501);
       }
-    } else _parseReqHeader();
+    } else _parseReqHeader(line);
   }
 }
 
 size_t AsyncWebServerRequest::headers() const{
-  return _headers.length();
+  return _headerCount;
 }
 
-bool AsyncWebServerRequest::hasHeader(const String& name) const {
-  for(const auto& h: _headers){
-    if(h->name().equalsIgnoreCase(name)){
-      return true;
+int AsyncWebServerRequest::_findHeader(const char *name) const {
+  for(uint8_t i = 0; i < _headerCount; i++){
+    if(!strcasecmp(_head + _headerViews[i].name, name)){
+      return i;
     }
   }
-  return false;
+  return -1;
+}
+
+AsyncWebHeader* AsyncWebServerRequest::_header(size_t num) const {
+  if(num >= _headerCount)
+    return nullptr;
+  if(_headerObjects[num] == NULL)
+    _headerObjects[num] = new AsyncWebHeader(String(_head + _headerViews[num].name), String(_head + _headerViews[num].value));
+  return _headerObjects[num];
+}
+
+bool AsyncWebServerRequest::hasHeader(const String& name) const {
+  return _findHeader(name.c_str()) >= 0;
 }
 
 bool AsyncWebServerRequest::hasHeader(const __FlashStringHelper * data) const {
@@ -619,12 +833,8 @@ bool AsyncWebServerRequest::hasHeader(const __FlashStringHelper * data) const {
 }
 
 AsyncWebHeader* AsyncWebServerRequest::getHeader(const String& name) const {
-  for(const auto& h: _headers){
-    if(h->name().equalsIgnoreCase(name)){
-      return h;
-    }
-  }
-  return nullptr;
+  int num = _findHeader(name.c_str());
+  return (num < 0)?nullptr:_header(num);
 }
 
 AsyncWebHeader* AsyncWebServerRequest::getHeader(const __FlashStringHelper * data) const {
@@ -642,15 +852,16 @@ AsyncWebHeader* AsyncWebServerRequest::getHeader(const __FlashStringHelper * dat
 }
 
 AsyncWebHeader* AsyncWebServerRequest::getHeader(size_t num) const {
-  auto header = _headers.nth(num);
-  return header ? *header : nullptr;
+  return _header(num);
 }
 
 size_t AsyncWebServerRequest::params() const {
+  _parseQuery();
   return _params.length();
 }
 
 bool AsyncWebServerRequest::hasParam(const String& name, bool post, bool file) const {
+  _parseQuery();
   for(const auto& p: _params){
     if(p->name() == name && p->isPost() == post && p->isFile() == file){
       return true;
@@ -676,6 +887,7 @@ bool AsyncWebServerRequest::hasParam(const __FlashStringHelper * data, bool post
 }
 
 AsyncWebParameter* AsyncWebServerRequest::getParam(const String& name, bool post, bool file) const {
+  _parseQuery();
   for(const auto& p: _params){
     if(p->name() == name && p->isPost() == post && p->isFile() == file){
       return p;
@@ -699,6 +911,7 @@ AsyncWebParameter* AsyncWebServerRequest::getParam(const __FlashStringHelper * d
 }
 
 AsyncWebParameter* AsyncWebServerRequest::getParam(size_t num) const {
+  _parseQuery();
   auto param = _params.nth(num);
   return param ? *param : nullptr;
 }
@@ -862,6 +1075,7 @@ void AsyncWebServerRequest::requestAuthentication(const char * realm, bool isDig
 }
 
 bool AsyncWebServerRequest::hasArg(const char* name) const {
+  _parseQuery();
   for(const auto& arg: _params){
     if(arg->name() == name){
       return true;
@@ -886,6 +1100,7 @@ bool AsyncWebServerRequest::hasArg(const __FlashStringHelper * data) const {
 
 
 const String& AsyncWebServerRequest::arg(const String& name) const {
+  _parseQuery();
   for(const auto& arg: _params){
     if(arg->name() == name){
       return arg->value();
@@ -923,8 +1138,8 @@ const String& AsyncWebServerRequest::pathArg(size_t i) const {
 }
 
 const String& AsyncWebServerRequest::header(const char* name) const {
-  AsyncWebHeader* h = getHeader(String(name));
-  return h ? h->value() : SharedEmptyString;
+  int num = _findHeader(name);
+  return (num < 0) ? SharedEmptyString : _header(num)->value();
 }
 
 const String& AsyncWebServerRequest::header(const __FlashStringHelper * data) const {
@@ -953,25 +1168,8 @@ const String& AsyncWebServerRequest::headerName(size_t i) const {
 }
 
 String AsyncWebServerRequest::urlDecode(const String& text) const {
-  char temp[] = "0x00";
-  unsigned int len = text.length();
-  unsigned int i = 0;
   String decoded = String();
-  decoded.reserve(len); // Allocate the string internal buffer - never longer from source text
-  while (i < len){
-    char decodedChar;
-    char encodedChar = text.charAt(i++);
-    if ((encodedChar == '%') && (i + 1 < len)){
-      temp[2] = text.charAt(i++);
-      temp[3] = text.charAt(i++);
-      decodedChar = strtol(temp, NULL, 16);
-    } else if (encodedChar == '+') {
-      decodedChar = ' ';
-    } else {
-      decodedChar = encodedChar;  // normal ascii char
-    }
-    decoded.concat(decodedChar);
-  }
+  urlDecodeTo(decoded, text.c_str(), text.length());
   return decoded;
 }
 
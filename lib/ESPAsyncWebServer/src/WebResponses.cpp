@@ -21,6 +21,7 @@
 #include "ESPAsyncWebServer.h"
 #include "WebResponseImpl.h"
 #include "cbuf.h"
+#include "AsyncWebBufferPool.h"
 
 // Since ESP8266 does not link memchr by default, here's its implementation.
 void* memchr(void* ptr, int ch, size_t count)
@@ -72,6 +73,7 @@ const char* AsyncWebServerResponse::_responseCodeToString(int code) {
     case 415: return "Unsupported Media Type";
     case 416: return "Requested range not satisfiable";
     case 417: return "Expectation Failed";
+    case 431: return "Request Header Fields Too Large";
     case 500: return "Internal Server Error";
     case 501: return "Not Implemented";
     case 502: return "Bad Gateway";
@@ -125,7 +127,13 @@ void AsyncWebServerResponse::addHeader(const String& name, const String& value){
 
 String AsyncWebServerResponse::_assembleHead(uint8_t version){
   if(version){
-    addHeader("Accept-Ranges","none");
+    //unless the handler serves ranges of its own
+    bool ranges = false;
+    for(const auto& header: _headers)
+      if(header->name().equalsIgnoreCase("Accept-Ranges"))
+        ranges = true;
+    if(!ranges)
+      addHeader("Accept-Ranges","none");
     if(_chunked)
       addHeader("Transfer-Encoding","chunked");
   }
@@ -137,7 +145,7 @@ String AsyncWebServerResponse::_assembleHead(uint8_t version){
   out.concat(buf);
 
   if(_sendContentLength) {
-    snprintf(buf, bufSize, "Content-Length: %d\r\n", _contentLength);
+    snprintf(buf, bufSize, "Content-Length: %u\r\n", (unsigned int)_contentLength);
     out.concat(buf);
   }
   if(_contentType.length()) {
@@ -175,10 +183,10 @@ AsyncBasicResponse::AsyncBasicResponse(int code, const String& contentType, cons
     if(!_contentType.length())
       _contentType = "text/plain";
   }
-  addHeader("Connection","close");
 }
 
 void AsyncBasicResponse::_respond(AsyncWebServerRequest *request){
+  addHeader("Connection", request->keepAlive() ? "keep-alive" : "close");
   _state = RESPONSE_HEADERS;
   String out = _assembleHead(request->version());
   size_t outLen = out.length();
@@ -255,7 +263,10 @@ AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _ca
 }
 
 void AsyncAbstractResponse::_respond(AsyncWebServerRequest *request){
-  addHeader("Connection","close");
+  //without a length or chunks, only closing the connection tells where the content ends
+  if(!_sendContentLength && !(_chunked && request->version()))
+    request->setKeepAlive(false);
+  addHeader("Connection", request->keepAlive() ? "keep-alive" : "close");
   _head = _assembleHead(request->version());
   _state = RESPONSE_HEADERS;
   _ack(request, 0, 0);
@@ -285,74 +296,101 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
   }
 
   if(_state == RESPONSE_CONTENT){
-    size_t outLen;
-    if(_chunked){
-      if(space <= 8){
-        return 0;
-      }
-      outLen = space;
-    } else if(!_sendContentLength){
-      outLen = space;
-    } else {
-      outLen = ((_contentLength - _sentLength) > space)?space:(_contentLength - _sentLength);
+    //a buffer from the server's pool is filled and written as often as the window allows.
+    //one of the whole window is only allocated if none is free or the head doesn't fit
+    AsyncWebBufferPool* pool = request->server()->sendBuffers();
+    uint8_t *buf = pool?pool->take():NULL;
+    size_t bufLen = buf?pool->size():0;
+    if(buf && bufLen <= headLen + 8){
+      pool->give(buf);
+      buf = NULL;
     }
+    bool pooled = (buf != NULL);
+    size_t written = 0;
+
+    while(true){
+      size_t outLen;
+      if(_chunked){
+        if(space <= 8){
+          break;
+        }
+        outLen = space;
+      } else if(!_sendContentLength){
+        outLen = space;
+      } else {
+        outLen = ((_contentLength - _sentLength) > space)?space:(_contentLength - _sentLength);
+      }
 
-    uint8_t *buf = (uint8_t *)malloc(outLen+headLen);
-    if (!buf) {
-      // os_printf("_ack malloc %d failed\n", outLen+headLen);
-      return 0;
-    }
+      if(pooled){
+        if(outLen > bufLen - headLen)
+          outLen = bufLen - headLen;
+      } else {
+        buf = (uint8_t *)malloc(outLen+headLen);
+        if (!buf) {
+          // os_printf("_ack malloc %d failed\n", outLen+headLen);
+          break;
+        }
+      }
 
-    if(headLen){
-      memcpy(buf, _head.c_str(), _head.length());
-    }
+      if(headLen){
+        memcpy(buf, _head.c_str(), _head.length());
+      }
 
-    size_t readLen = 0;
+      size_t readLen = 0;
 
-    if(_chunked){
-      // HTTP 1.1 allows leading zeros in chunk length. Or spaces may be added.
-      // See RFC2616 sections 2, 3.6.1.
-      readLen = _fillBufferAndProcessTemplates(buf+headLen+6, outLen - 8);
-      if(readLen == RESPONSE_TRY_AGAIN){
-          free(buf);
-          return 0;
+      if(_chunked){
+        // HTTP 1.1 allows leading zeros in chunk length. Or spaces may be added.
+        // See RFC2616 sections 2, 3.6.1.
+        readLen = _fillBufferAndProcessTemplates(buf+headLen+6, outLen - 8);
+        if(readLen == RESPONSE_TRY_AGAIN){
+            break;
+        }
+        outLen = sprintf((char*)buf+headLen, "%x", (unsigned int)readLen) + headLen;
+        while(outLen < headLen + 4) buf[outLen++] = ' ';
+        buf[outLen++] = '\r';
+        buf[outLen++] = '\n';
+        outLen += readLen;
+        buf[outLen++] = '\r';
+        buf[outLen++] = '\n';
+      } else {
+        readLen = _fillBufferAndProcessTemplates(buf+headLen, outLen);
+        if(readLen == RESPONSE_TRY_AGAIN){
+            break;
+        }
+        outLen = readLen + headLen;
       }
-      outLen = sprintf((char*)buf+headLen, "%x", readLen) + headLen;
-      while(outLen < headLen + 4) buf[outLen++] = ' ';
-      buf[outLen++] = '\r';
-      buf[outLen++] = '\n';
-      outLen += readLen;
-      buf[outLen++] = '\r';
-      buf[outLen++] = '\n';
-    } else {
-      readLen = _fillBufferAndProcessTemplates(buf+headLen, outLen);
-      if(readLen == RESPONSE_TRY_AGAIN){
-          free(buf);
-          return 0;
+
+      size_t sent = 0;
+      if(outLen){
+          sent = request->client()->write((const char*)buf, outLen);
+          _writtenLength += sent;
       }
-      outLen = readLen + headLen;
-    }
+      written += outLen;
+      space -= (outLen - headLen < space)?(outLen - headLen):space;
 
-    if(headLen){
-        _head = String();
-    }
+      if(headLen){
+          _head = String();
+          headLen = 0;
+      }
 
-    if(outLen){
-        _writtenLength += request->client()->write((const char*)buf, outLen);
-    }
+      _sentLength += readLen;
 
-    if(_chunked){
-        _sentLength += readLen;
-    } else {
-        _sentLength += outLen - headLen;
+      if((_chunked && readLen == 0) || (!_sendContentLength && outLen == 0) || (!_chunked && _sentLength == _contentLength)){
+        _state = RESPONSE_WAIT_ACK;
+        break;
+      }
+      //a malloc'd buffer had the whole window, and a connection that took less is full
+      if(!pooled || readLen == 0 || sent < outLen || space == 0){
+        break;
+      }
     }
 
-    free(buf);
-
-    if((_chunked && readLen == 0) || (!_sendContentLength && outLen == 0) || (!_chunked && _sentLength == _contentLength)){
-      _state = RESPONSE_WAIT_ACK;
+    if(pooled){
+      pool->give(buf);
+    } else {
+      free(buf);
     }
-    return outLen;
+    return written;
 
   } else if(_state == RESPONSE_WAIT_ACK){
     if(!_sendContentLength || _ackedLength >= _writtenLength){
@@ -396,7 +434,7 @@ size_t AsyncAbstractResponse::_fillBufferAndProcessTemplates(uint8_t* data, size
     // If closing placeholder is found:
     if(pTemplateEnd) {
       // prepare argument to callback
-      const size_t paramNameLength = std::min(sizeof(buf) - 1, (unsigned int)(pTemplateEnd - pTemplateStart - 1));
+      const size_t paramNameLength = std::min(sizeof(buf) - 1, (size_t)(pTemplateEnd - pTemplateStart - 1));
       if(paramNameLength) {
         memcpy(buf, pTemplateStart + 1, paramNameLength);
         buf[paramNameLength] = 0;
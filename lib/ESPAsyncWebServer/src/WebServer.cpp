@@ -20,6 +20,8 @@
 */
 #include "ESPAsyncWebServer.h"
 #include "WebHandlerImpl.h"
+#include "AsyncWebRouteTable.h"
+#include "AsyncWebBufferPool.h"
 
 bool ON_STA_FILTER(AsyncWebServerRequest *request) {
   return WiFi.localIP() == request->client()->localIP();
@@ -34,6 +36,12 @@ AsyncWebServer::AsyncWebServer(uint16_t port)
   : _server(port)
   , _rewrites(LinkedList<AsyncWebRewrite*>([](AsyncWebRewrite* r){ delete r; }))
   , _handlers(LinkedList<AsyncWebHandler*>([](AsyncWebHandler* h){ delete h; }))
+  , _routeTable(NULL)
+  , _routeTableEnabled(false)
+  , _routeTableValid(false)
+  , _keepAliveTimeout(0)
+  , _keepAliveRequests(100)
+  , _sendBuffers(new AsyncWebBufferPool())
 {
   _catchAllHandler = new AsyncCallbackWebHandler();
   if(_catchAllHandler == NULL)
@@ -55,6 +63,8 @@ AsyncWebServer::~AsyncWebServer(){
   reset();  
   end();
   if(_catchAllHandler) delete _catchAllHandler;
+  if(_routeTable) delete _routeTable;
+  if(_sendBuffers) delete _sendBuffers;
 }
 
 AsyncWebRewrite& AsyncWebServer::addRewrite(AsyncWebRewrite* rewrite){
@@ -72,18 +82,43 @@ AsyncWebRewrite& AsyncWebServer::rewrite(const char* from, const char* to){
 
 AsyncWebHandler& AsyncWebServer::addHandler(AsyncWebHandler* handler){
   _handlers.add(handler);
+  _routeTableValid = false;
   return *handler;
 }
 
 bool AsyncWebServer::removeHandler(AsyncWebHandler *handler){
+  _routeTableValid = false;
   return _handlers.remove(handler);
 }
 
 void AsyncWebServer::begin(){
+  if(_routeTableEnabled)
+    _buildRouteTable();
   _server.setNoDelay(true);
   _server.begin();
 }
 
+void AsyncWebServer::enableRouteTable(bool enable){
+  _routeTableEnabled = enable;
+  _routeTableValid = false;
+}
+
+void AsyncWebServer::keepAlive(uint32_t timeout, uint16_t maxRequests){
+  _keepAliveTimeout = timeout;
+  _keepAliveRequests = maxRequests;
+}
+
+void AsyncWebServer::_buildRouteTable(){
+  if(_routeTable == NULL)
+    _routeTable = new AsyncWebRouteTable();
+  if(_routeTable == NULL)
+    return;
+  _routeTable->clear();
+  for(const auto& h: _handlers)
+    _routeTable->add(h);
+  _routeTableValid = true;
+}
+
 void AsyncWebServer::end(){
   _server.end();
 }
@@ -112,13 +147,23 @@ void AsyncWebServer::_rewriteRequest(AsyncWebServerRequest *request){
 }
 
 void AsyncWebServer::_attachHandler(AsyncWebServerRequest *request){
-  for(const auto& h: _handlers){
-    if (h->filter(request) && h->canHandle(request)){
-      request->setHandler(h);
-      return;
+  //handlers added or removed since the table was built get it built again
+  if(_routeTableEnabled && !_routeTableValid)
+    _buildRouteTable();
+  AsyncWebHandler* handler = NULL;
+  if(!_routeTableEnabled || !_routeTableValid || !_routeTable->find(request, &handler)){
+    for(const auto& h: _handlers){
+      if (h->filter(request) && h->canHandle(request)){
+        handler = h;
+        break;
+      }
     }
   }
-  
+  if(handler){
+    request->setHandler(handler);
+    return;
+  }
+
   request->addInterestingHeader("ANY");
   request->setHandler(_catchAllHandler);
 }
@@ -168,6 +213,12 @@ AsyncStaticWebHandler& AsyncWebServer::serveStatic(const char* uri, fs::FS& fs,
   return *handler;
 }
 
+AsyncProgmemWebHandler& AsyncWebServer::serveProgmem(const AsyncProgmemAsset* assets, size_t count){
+  AsyncProgmemWebHandler* handler = new AsyncProgmemWebHandler(assets, count);
+  addHandler(handler);
+  return *handler;
+}
+
 void AsyncWebServer::onNotFound(ArRequestHandlerFunction fn){
   _catchAllHandler->onRequest(fn);
 }
@@ -183,6 +234,7 @@ void AsyncWebServer::onRequestBody(ArBodyHandlerFunction fn){
 void AsyncWebServer::reset(){
   _rewrites.free();
   _handlers.free();
+  _routeTableValid = false;
   
   if (_catchAllHandler != NULL){
     _catchAllHandler->onRequest(NULL);
@@ -0,0 +1,203 @@
+"""
+Builds the LittleFS image of the web UI from data/.
+
+Runs before every PlatformIO target, so `pio run -t uploadfs` always uploads
+what is in data/ now:
+- Stylesheets and scripts are minified, gzipped and written to /assets/ with
+  a hash of their content in the name, e.g. /assets/script.1a2b3c4d.js.gz.
+  Their names change whenever they do, so they can be cached forever.
+- The Highcharts files the pages load from the CDN are downloaded once into
+  .pio/vendor/ and served from /assets/ the same way, so the page works on
+  networks without internet. If they can't be downloaded, the CDN links are kept.
+- Pages are minified and gzipped under their own names, pointing at the hashed files.
+- Everything else, like config.json, is copied as it is.
+
+The image is built from $BUILD_DIR/data instead of data/.
+
+With -DWEB_ASSETS_PROGMEM in build_flags, the gzipped files are also written to
+$BUILD_DIR/web/WebAssets.h as a table for AsyncProgmemWebHandler, sorted by
+path and with their content types, ETags and Cache-Control, so the firmware
+serves them from flash without opening any file.
+"""
+Import("env")
+
+import gzip
+import hashlib
+import os
+import re
+import shutil
+import urllib.request
+
+HIGHCHARTS_VERSION = "11.4.8"
+HIGHCHARTS_URL = "https://code.highcharts.com/"
+
+SOURCE_DIR = env.subst("$PROJECT_DATA_DIR")
+OUTPUT_DIR = os.path.join(env.subst("$BUILD_DIR"), "data")
+HEADER_DIR = os.path.join(env.subst("$BUILD_DIR"), "web")
+VENDOR_DIR = os.path.join(env.subst("$PROJECT_DIR"), ".pio", "vendor", "highcharts", HIGHCHARTS_VERSION)
+ASSET_DIR = "assets"
+
+# files that get hashed names, and pages that point at them
+HASHED = (".css", ".js")
+PAGES = (".html",)
+
+# the same as assetCacheControl and pageCacheControl in main.cpp
+ASSET_CACHE_CONTROL = "public, max-age=31536000, immutable"
+PAGE_CACHE_CONTROL = "no-cache"
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+}
+
+# gzipped files written, for the PROGMEM table: (path, content type, cache control, data)
+gzipped = []
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{}:;,>])\s*", r"\1", text)
+    return text.replace(";}", "}").strip()
+
+
+def minify_js(text):
+    # only whole line comments and indentation go, which is safe without parsing the script
+    lines = []
+    for line in text.splitlines():
+        line = line.strip()
+        if line and not line.startswith("//"):
+            lines.append(line)
+    return "\n".join(lines)
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    text = re.sub(r">\s+<", "><", text)
+    return re.sub(r"\s+", " ", text).strip()
+
+
+def minify(name, data):
+    text = data.decode("utf-8")
+    if name.endswith(".css"):
+        return minify_css(text).encode("utf-8")
+    if name.endswith(".js"):
+        return minify_js(text).encode("utf-8")
+    if name.endswith(".html"):
+        return minify_html(text).encode("utf-8")
+    return data
+
+
+def write_gzip(path, data, url, cache_control):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    # no name or time in the header, so the same input always gives the same file
+    data = gzip.compress(data, compresslevel=9, mtime=0)
+    with open(path, "wb") as f:
+        f.write(data)
+    content_type = CONTENT_TYPES.get(os.path.splitext(url)[1], "application/octet-stream")
+    gzipped.append((url, content_type, cache_control, data))
+
+
+def add_asset(name, data, assets):
+    """Writes a hashed, gzipped copy of data to /assets/ and returns its URL."""
+    stem, ext = os.path.splitext(os.path.basename(name))
+    digest = hashlib.sha256(data).hexdigest()[:8]
+    url = "/%s/%s.%s%s" % (ASSET_DIR, stem, digest, ext)
+    write_gzip(os.path.join(OUTPUT_DIR, url.lstrip("/") + ".gz"), data, url, ASSET_CACHE_CONTROL)
+    assets[name] = url
+    return url
+
+
+def vendor(url):
+    """Returns the contents of a Highcharts file, downloading it the first time. None if it can't be had."""
+    path = os.path.join(VENDOR_DIR, url[len(HIGHCHARTS_URL):])
+    if not os.path.exists(path):
+        try:
+            source = HIGHCHARTS_URL + HIGHCHARTS_VERSION + "/" + url[len(HIGHCHARTS_URL):]
+            with urllib.request.urlopen(source, timeout=30) as response:
+                data = response.read()
+        except Exception as e:
+            print("build_web: can't download %s (%s), keeping the CDN link" % (url, e))
+            return None
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "wb") as f:
+            f.write(data)
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def build():
+    shutil.rmtree(OUTPUT_DIR, ignore_errors=True)
+    os.makedirs(OUTPUT_DIR)
+    assets = {}
+    pages = []
+
+    for name in sorted(os.listdir(SOURCE_DIR)):
+        path = os.path.join(SOURCE_DIR, name)
+        if not os.path.isfile(path):
+            continue
+        with open(path, "rb") as f:
+            data = f.read()
+        if name.endswith(HASHED):
+            add_asset(name, minify(name, data), assets)
+        elif name.endswith(PAGES):
+            pages.append((name, data.decode("utf-8")))
+        else:
+            shutil.copyfile(path, os.path.join(OUTPUT_DIR, name))
+
+    def replace(match):
+        ref = match.group(2)
+        if ref.startswith(HIGHCHARTS_URL):
+            if ref not in assets:
+                data = vendor(ref)
+                if data is None:
+                    return match.group(0)
+                add_asset(ref, data, assets)
+        elif ref not in assets:
+            return match.group(0)
+        return '%s="%s"' % (match.group(1), assets[ref])
+
+    for name, text in pages:
+        text = re.sub(r'(src|href)="([^"]+)"', replace, text)
+        write_gzip(os.path.join(OUTPUT_DIR, name + ".gz"), minify(name, text.encode("utf-8")),
+                   "/" + name, PAGE_CACHE_CONTROL)
+
+    for ref, url in sorted(assets.items()):
+        print("build_web: %s -> %s" % (ref, url))
+
+
+def write_header():
+    """Writes the gzipped files as a table of AsyncProgmemAsset, sorted by path like strcmp."""
+    os.makedirs(HEADER_DIR, exist_ok=True)
+    lines = [
+        "// Generated by scripts/build_web.py from data/, don't edit.",
+        "#ifndef WEBASSETS_H_",
+        "#define WEBASSETS_H_",
+        "",
+        "#include <ESPAsyncWebServer.h>",
+        "",
+    ]
+    entries = sorted(gzipped, key=lambda e: e[0].encode("utf-8"))
+    for i, (path, content_type, cache_control, data) in enumerate(entries):
+        lines.append("static const uint8_t webAsset%d[] PROGMEM = {" % i)
+        for start in range(0, len(data), 20):
+            lines.append("  " + ",".join("0x%02x" % b for b in data[start:start + 20]) + ",")
+        lines.append("};")
+    lines.append("")
+    lines.append("static const AsyncProgmemAsset webAssets[] = {")
+    for i, (path, content_type, cache_control, data) in enumerate(entries):
+        etag = '"\\"%s\\""' % hashlib.sha256(data).hexdigest()[:16]
+        lines.append('  {"%s", "%s", "%s", %s, true, webAsset%d, %d},' % (path, content_type, cache_control, etag, i, len(data)))
+    lines.append("};")
+    lines.append("static const size_t webAssetCount = %d;" % len(entries))
+    lines.append("")
+    lines.append("#endif /* WEBASSETS_H_ */")
+    with open(os.path.join(HEADER_DIR, "WebAssets.h"), "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+build()
+env.Replace(PROJECT_DATA_DIR=OUTPUT_DIR)
+if "WEB_ASSETS_PROGMEM" in str(env.GetProjectOption("build_flags", "")):
+    write_header()
+    env.Append(CPPPATH=[HEADER_DIR])
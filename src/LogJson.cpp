@@ -0,0 +1,218 @@
+#include "LogJson.h"
+#include <stdio.h>
+#include <string.h>
+
+
+LogJsonWriter::LogJsonWriter(LogStore *store, uint32_t from, bool withFrom)
+  : _cursor(store, from)
+  , _cache(nullptr)
+  , _state(HEADER)
+  , _from(from)
+  , _end(UINT32_MAX)
+  , _withFrom(withFrom)
+  , _first(true)
+  , _pieceData(_piece)
+  , _pieceLen(0)
+  , _piecePos(0)
+{}
+
+
+size_t LogJsonWriter::fill(uint8_t *buffer, size_t maxLen){
+  size_t written = 0;
+  while(written < maxLen){
+    if(_piecePos == _pieceLen && !_nextPiece()){
+      break;
+    }
+    size_t chunk = _pieceLen - _piecePos;
+    if(chunk > maxLen - written){
+      chunk = maxLen - written;
+    }
+    memcpy(buffer + written, _pieceData + _piecePos, chunk);
+    _piecePos += chunk;
+    written += chunk;
+  }
+  return written;
+}
+
+
+/**
+ * @brief Formats the next piece of JSON into `_piece`.
+ *
+ * @return `false` once the closing brackets have been written.
+ */
+bool LogJsonWriter::_nextPiece(){
+  int len = 0;
+  _chunk.reset();
+  _pieceData = _piece;
+  switch (_state)
+  {
+    case HEADER:
+      if(_withFrom){
+        len = snprintf(_piece, sizeof(_piece), "{\"from\":%lu,\"log\":[", (unsigned long)_from);
+      }
+      else{
+        len = snprintf(_piece, sizeof(_piece), "{\"log\":[");
+      }
+      _state = RECORDS;
+      break;
+    case RECORDS: {
+      uint32_t position = _cursor.position();
+      if(_cache && position % LogJsonCache::CHUNK_RECORDS == 0 && _end >= position + LogJsonCache::CHUNK_RECORDS){
+        _chunk = _cache->get(position);
+      }
+      if(_chunk){
+        // the first record of the log goes without the comma
+        _pieceData = _chunk->json.data() + (_first ? 1 : 0);
+        len = _chunk->json.size() - (_first ? 1 : 0);
+        _first = false;
+        _cursor.seek(position + LogJsonCache::CHUNK_RECORDS);
+        break;
+      }
+      LogRecord record;
+      if(_cursor.position() < _end && _cursor.next(record)){
+        len = snprintf(_piece, sizeof(_piece), "%s{\"accumulatedValue\":%ld,\"time\":%lu}",
+                       _first ? "" : ",", (long)record.accumulatedValue, (unsigned long)record.time);
+        _first = false;
+        break;
+      }
+      _state = FOOTER;
+    }
+    // fall through
+    case FOOTER:
+      len = snprintf(_piece, sizeof(_piece), "]}");
+      _state = DONE;
+      break;
+    case DONE:
+      return false;
+  }
+  _pieceLen = len;
+  _piecePos = 0;
+  return true;
+}
+
+
+LogJsonCache::LogJsonCache(LogStore *store, size_t chunks)
+  : _store(store)
+  , _entries(chunks)
+  , _clock(0)
+  , _stats{}
+{
+#ifdef ARDUINO
+  _mutex = xSemaphoreCreateMutex();
+#endif
+}
+
+LogJsonCache::~LogJsonCache(){
+#ifdef ARDUINO
+  if(_mutex){
+    vSemaphoreDelete(_mutex);
+  }
+#endif
+}
+
+
+/**
+ * @brief Finds the chunk starting at `first`, serializing it into the least recently used entry if it isn't cached.
+ *
+ * The lock is held while a chunk is serialized, so writers that ask for it at the
+ * same time wait for it instead of serializing it too.
+ */
+std::shared_ptr<const LogJsonChunk> LogJsonCache::get(uint32_t first){
+  if(first % CHUNK_RECORDS != 0 || _entries.empty()){
+    return nullptr;
+  }
+  _lock();
+  uint32_t truncates = _store->stats().truncates;
+  Entry *entry = nullptr;
+  for(Entry &candidate : _entries){
+    if(candidate.chunk && candidate.chunk->first == first && candidate.chunk->truncates == truncates){
+      entry = &candidate;
+      _stats.hits++;
+      break;
+    }
+  }
+
+  if(!entry){
+    std::shared_ptr<const LogJsonChunk> chunk = _build(first, truncates);
+    if(!chunk){
+      _unlock();
+      return nullptr;
+    }
+    _stats.builds++;
+    for(Entry &candidate : _entries){
+      if(!entry || !candidate.chunk || (entry->chunk && candidate.used < entry->used)){
+        entry = &candidate;
+      }
+      if(!entry->chunk){
+        break;
+      }
+    }
+    if(entry->chunk){
+      _stats.evictions++;
+    }
+    entry->chunk = chunk;
+  }
+  entry->used = ++_clock;
+  std::shared_ptr<const LogJsonChunk> chunk = entry->chunk;
+  _unlock();
+  return chunk;
+}
+
+
+void LogJsonCache::clear(){
+  _lock();
+  for(Entry &entry : _entries){
+    entry.chunk.reset();
+  }
+  _unlock();
+}
+
+
+LogJsonCacheStats LogJsonCache::stats(){
+  _lock();
+  LogJsonCacheStats current = _stats;
+  _unlock();
+  return current;
+}
+
+
+std::shared_ptr<const LogJsonChunk> LogJsonCache::_build(uint32_t first, uint32_t truncates){
+  if(_store->count() < first + CHUNK_RECORDS){
+    return nullptr;
+  }
+  std::shared_ptr<LogJsonChunk> chunk = std::make_shared<LogJsonChunk>();
+  chunk->first = first;
+  chunk->truncates = truncates;
+  chunk->json.reserve(CHUNK_RECORDS * 48);
+
+  LogCursor cursor = _store->cursor(first);
+  char piece[64];
+  for(size_t i = 0; i < CHUNK_RECORDS; i++){
+    LogRecord record;
+    if(!cursor.next(record)){
+      return nullptr;
+    }
+    int len = snprintf(piece, sizeof(piece), ",{\"accumulatedValue\":%ld,\"time\":%lu}",
+                       (long)record.accumulatedValue, (unsigned long)record.time);
+    chunk->json.insert(chunk->json.end(), piece, piece + len);
+  }
+  return chunk;
+}
+
+
+void LogJsonCache::_lock(){
+#ifdef ARDUINO
+  xSemaphoreTake(_mutex, portMAX_DELAY);
+#else
+  _mutex.lock();
+#endif
+}
+
+
+void LogJsonCache::_unlock(){
+#ifdef ARDUINO
+  xSemaphoreGive(_mutex);
+#else
+  _mutex.unlock();
+#endif
+}
@@ -0,0 +1,1061 @@
+#include "LogStore.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef ARDUINO
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+
+/**
+ * @brief Calculates the CRC32 of a record, leaving out the crc field.
+ *
+ * Uses a 16 entry table so it is small enough for the ESP32 and the same on
+ * every platform.
+ *
+ * @param record The record to calculate the checksum of.
+ * @return The CRC32 of the record.
+ */
+uint32_t logRecordCrc(const LogRecord &record){
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  const uint8_t *data = (const uint8_t*)&record;
+  uint32_t crc = 0xFFFFFFFF;
+  for(size_t i = 0; i < offsetof(LogRecord, crc); i++){
+    crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+
+/**
+ * @brief Checks the crc of a record.
+ *
+ * @param record The record to check.
+ * @return `true` if the crc matches the rest of the record.
+ */
+bool logRecordValid(const LogRecord &record){
+  return record.crc == logRecordCrc(record);
+}
+
+
+size_t LogStore::appendBatch(LogRecord *records, size_t count){
+  uint32_t sequence = this->count();
+  for(size_t i = 0; i < count; i++){
+    records[i].sequence = sequence + i;
+    records[i].crc = logRecordCrc(records[i]);
+  }
+
+  _stats.appends++;
+  if(count == 0 || !_write(records, count)){
+    _stats.errors++;
+    return 0;
+  }
+  _stats.recordsWritten += count;
+  return count;
+}
+
+
+size_t LogStore::readCached(uint32_t index, LogRecord *records, size_t count){
+  return _cache ? _cache->read(index, records, count) : read(index, records, count);
+}
+
+
+LogCursor LogStore::cursor(uint32_t index, bool cached){
+  return LogCursor(this, index, cached);
+}
+
+
+/**
+ * @brief Finds the first record with a time of at least `time`.
+ *
+ * Uses a binary search, so it assumes the records are in time order. Records
+ * logged before the clock was set have a time of 0 and are skipped past.
+ *
+ * @param time The time to search for.
+ * @return The index of the record, or count() if every record is older.
+ */
+uint32_t LogStore::seekTime(uint32_t time){
+  uint32_t low = 0;
+  uint32_t high = count();
+  while(low < high){
+    uint32_t middle = low + (high - low) / 2;
+    LogRecord record;
+    if(readCached(middle, &record, 1) != 1){
+      break;
+    }
+    if(record.time < time){
+      low = middle + 1;
+    }
+    else{
+      high = middle;
+    }
+  }
+  return low;
+}
+
+
+bool LogStore::last(LogRecord &record){
+  uint32_t records = count();
+  return records > 0 && readCached(records - 1, &record, 1) == 1;
+}
+
+
+LogStoreStats LogStore::stats(){
+  LogStoreStats current = _stats;
+  current.records = count();
+  current.bytes = current.records * sizeof(LogRecord);
+  return current;
+}
+
+
+LogCursor::LogCursor(LogStore *store, uint32_t index, bool cached)
+  : _store(store)
+  , _cached(cached)
+  , _index(index)
+  , _bufferStart(0)
+  , _buffered(0)
+{}
+
+bool LogCursor::next(LogRecord &record){
+  if(_index < _bufferStart || _index >= _bufferStart + _buffered){
+    _bufferStart = _index;
+    _buffered = _cached
+      ? _store->readCached(_index, _buffer, BUFFERED_RECORDS)
+      : _store->read(_index, _buffer, BUFFERED_RECORDS);
+    if(_buffered == 0){
+      return false;
+    }
+  }
+  record = _buffer[_index - _bufferStart];
+  _index++;
+  return true;
+}
+
+void LogCursor::seek(uint32_t index){
+  _index = index;
+}
+
+
+LogBlockCache::LogBlockCache(LogStore *store, size_t blocks)
+  : _store(store)
+  , _entries(new Entry[blocks])
+  , _blocks(blocks)
+  , _clock(0)
+  , _lastBlock(UINT32_MAX)
+  , _truncates(0)
+  , _stats{}
+{
+  for(size_t i = 0; i < _blocks; i++){
+    _entries[i] = {0, 0, 0, nullptr};
+  }
+#ifdef ARDUINO
+  _mutex = xSemaphoreCreateMutex();
+#endif
+}
+
+LogBlockCache::~LogBlockCache(){
+  for(size_t i = 0; i < _blocks; i++){
+    free(_entries[i].records);
+  }
+  delete[] _entries;
+#ifdef ARDUINO
+  if(_mutex){
+    vSemaphoreDelete(_mutex);
+  }
+#endif
+}
+
+
+/**
+ * @brief Reads records from the cache, loading the blocks that aren't in it.
+ *
+ * @param index The index of the first record.
+ * @param records Where to copy the records to.
+ * @param count The number of records to read.
+ * @return The number of records read, less than `count` at the end of the store.
+ */
+size_t LogBlockCache::read(uint32_t index, LogRecord *records, size_t count){
+  _lock();
+  uint32_t truncates = _store->stats().truncates;
+  if(truncates != _truncates){
+    for(size_t i = 0; i < _blocks; i++){
+      _entries[i].filled = 0;
+    }
+    _truncates = truncates;
+  }
+
+  size_t done = 0;
+  while(done < count){
+    uint32_t position = index + done;
+    uint32_t block = position / BLOCK_RECORDS;
+    size_t offset = position % BLOCK_RECORDS;
+
+    Entry *entry = _find(block);
+    if(entry && offset < entry->filled){
+      _stats.hits++;
+    }
+    else{
+      _stats.misses++;
+      entry = _load(block, entry, nullptr);
+      if(!entry || offset >= entry->filled){
+        break;
+      }
+    }
+    entry->used = ++_clock;
+
+    // moving on to the next block, so have the one after it ready too
+    if(block == _lastBlock + 1 && entry->filled == BLOCK_RECORDS && !_find(block + 1)){
+      if(_load(block + 1, nullptr, entry)){
+        _stats.readAheads++;
+      }
+    }
+    _lastBlock = block;
+
+    size_t chunk = entry->filled - offset;
+    if(chunk > count - done){
+      chunk = count - done;
+    }
+    memcpy(records + done, entry->records + offset, chunk * sizeof(LogRecord));
+    done += chunk;
+  }
+  _unlock();
+  return done;
+}
+
+
+void LogBlockCache::clear(){
+  _lock();
+  for(size_t i = 0; i < _blocks; i++){
+    _entries[i].filled = 0;
+  }
+  _lastBlock = UINT32_MAX;
+  _unlock();
+}
+
+
+LogCacheStats LogBlockCache::stats(){
+  _lock();
+  LogCacheStats current = _stats;
+  _unlock();
+  return current;
+}
+
+
+LogBlockCache::Entry *LogBlockCache::_find(uint32_t block){
+  for(size_t i = 0; i < _blocks; i++){
+    if(_entries[i].filled > 0 && _entries[i].block == block){
+      return &_entries[i];
+    }
+  }
+  return nullptr;
+}
+
+
+/**
+ * @brief Reads a block from the store.
+ *
+ * @param block The block to read.
+ * @param entry The entry to read it into, or nullptr to use the least recently used one.
+ * @param keep An entry that must not be reused.
+ * @return The entry, or nullptr if nothing could be read.
+ */
+LogBlockCache::Entry *LogBlockCache::_load(uint32_t block, Entry *entry, const Entry *keep){
+  if(!entry){
+    for(size_t i = 0; i < _blocks; i++){
+      Entry *candidate = &_entries[i];
+      if(candidate == keep){
+        continue;
+      }
+      if(!entry || candidate->filled == 0 || (entry->filled > 0 && candidate->used < entry->used)){
+        entry = candidate;
+      }
+      if(entry->filled == 0){
+        break;
+      }
+    }
+    if(!entry){
+      return nullptr;
+    }
+    if(entry->filled > 0){
+      _stats.evictions++;
+    }
+  }
+  if(!entry->records){
+    entry->records = (LogRecord*)malloc(BLOCK_RECORDS * sizeof(LogRecord));
+    if(!entry->records){
+      return nullptr;
+    }
+  }
+
+  entry->block = block;
+  entry->filled = _store->read(block * BLOCK_RECORDS, entry->records, BLOCK_RECORDS);
+  entry->used = ++_clock;
+  return entry->filled > 0 ? entry : nullptr;
+}
+
+
+void LogBlockCache::_lock(){
+#ifdef ARDUINO
+  xSemaphoreTake(_mutex, portMAX_DELAY);
+#else
+  _mutex.lock();
+#endif
+}
+
+void LogBlockCache::_unlock(){
+#ifdef ARDUINO
+  xSemaphoreGive(_mutex);
+#else
+  _mutex.unlock();
+#endif
+}
+
+
+#ifdef ARDUINO
+
+FsLogStore::FsLogStore(fs::FS &fs, const char *path)
+  : _fs(fs)
+  , _path(path)
+  , _count(0)
+{
+  snprintf(_tmpPath, sizeof(_tmpPath), "%s.tmp", path);
+}
+
+
+/**
+ * @brief Opens the log file, creating it if needed.
+ *
+ * @details
+ * The function performs the following steps:
+ * - Finishes a truncate that was interrupted before the new file was renamed.
+ * - Creates an empty file if there is none.
+ * - Counts the records, and cuts off a record that was only partly written.
+ *
+ * @return `true` if the file can be used.
+ */
+bool FsLogStore::begin(){
+  if(!_fs.exists(_path) && _fs.exists(_tmpPath)){
+    _fs.rename(_tmpPath, _path);
+  }
+
+  File file = _fs.open(_path, _fs.exists(_path) ? FILE_READ : FILE_WRITE);
+  if(!file){
+    _count = 0;
+    return false;
+  }
+  size_t size = file.size();
+  file.close();
+
+  _count = size / sizeof(LogRecord);
+  if(size % sizeof(LogRecord) != 0){
+    uint32_t records = _count;
+    _count++; // make truncate() see the partial record
+    return FsLogStore::truncate(records);
+  }
+  return true;
+}
+
+
+size_t FsLogStore::read(uint32_t index, LogRecord *records, size_t count){
+  if(index >= _count){
+    return 0;
+  }
+  if(count > _count - index){
+    count = _count - index;
+  }
+
+  _stats.reads++;
+  size_t read = _readFile(index, records, count);
+  _stats.recordsRead += read;
+  return read;
+}
+
+
+/**
+ * @brief Reads records straight from the file, without checking the count.
+ *
+ * @return The number of records read.
+ */
+size_t FsLogStore::_readFile(uint32_t index, LogRecord *records, size_t count){
+  File file = _fs.open(_path, FILE_READ);
+  if(!file || !file.seek(index * sizeof(LogRecord))){
+    _stats.errors++;
+    return 0;
+  }
+  size_t read = file.read((uint8_t*)records, count * sizeof(LogRecord)) / sizeof(LogRecord);
+  file.close();
+  return read;
+}
+
+
+bool FsLogStore::_write(const LogRecord *records, size_t count){
+  File file = _fs.open(_path, FILE_APPEND);
+  if(!file){
+    return false;
+  }
+  size_t bytes = count * sizeof(LogRecord);
+  bool written = file.write((const uint8_t*)records, bytes) == bytes;
+  file.close();
+
+  if(written){
+    _count += count;
+  }
+  return written;
+}
+
+
+/**
+ * @brief Keeps the first `count` records and drops the rest.
+ *
+ * Arduino files can't be truncated in place, so the records to keep are
+ * copied to a temporary file that then replaces the log. `begin()` finishes
+ * the job if the device restarts in between.
+ *
+ * @param count The number of records to keep.
+ * @return `true` if the log was truncated.
+ */
+bool FsLogStore::truncate(uint32_t count){
+  if(count >= _count){
+    return true;
+  }
+  _stats.truncates++;
+
+  if(count == 0){
+    File file = _fs.open(_path, FILE_WRITE);
+    if(!file){
+      _stats.errors++;
+      return false;
+    }
+    file.close();
+    _count = 0;
+    return true;
+  }
+
+  File file = _fs.open(_path, FILE_READ);
+  File tmpFile = _fs.open(_tmpPath, FILE_WRITE);
+  if(!file || !tmpFile){
+    file.close();
+    tmpFile.close();
+    _stats.errors++;
+    return false;
+  }
+
+  uint8_t buffer[512];
+  size_t remaining = count * sizeof(LogRecord);
+  bool written = true;
+  while(remaining > 0 && written){
+    size_t chunk = file.read(buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer));
+    written = chunk > 0 && tmpFile.write(buffer, chunk) == chunk;
+    remaining -= chunk;
+  }
+  file.close();
+  tmpFile.close();
+
+  if(!written){
+    _fs.remove(_tmpPath);
+    _stats.errors++;
+    return false;
+  }
+
+  _fs.remove(_path);
+  _fs.rename(_tmpPath, _path);
+  _count = count;
+  return true;
+}
+
+
+/**
+ * @brief Moves the log to `path` and starts an empty one.
+ *
+ * Only the directory entry changes, so this takes the same time for any size
+ * of log, unlike deleting it. Removing the old file is left to the caller.
+ * Counts as a truncate in the stats.
+ *
+ * @param path Where to move the log to. Must not exist.
+ * @return `true` if the log was moved and the new one can be used.
+ */
+bool FsLogStore::rotate(const char *path){
+  if(!_fs.rename(_path, path)){
+    _stats.errors++;
+    return false;
+  }
+  _stats.truncates++;
+  return FsLogStore::begin();
+}
+
+
+BufferedFsLogStore::BufferedFsLogStore(fs::FS &fs, const char *path)
+  : FsLogStore(fs, path)
+  , _buffers{nullptr, nullptr}
+  , _block{0, 0}
+  , _filled{0, 0}
+  , _synced{0, 0}
+  , _active(0)
+  , _flushed(0)
+  , _allocated(0)
+  , _preallocate(0)
+  , _lock(nullptr)
+  , _flushLock(nullptr)
+  , _writerStats{}
+{}
+
+BufferedFsLogStore::~BufferedFsLogStore(){
+  if(_file){
+    _file.close();
+  }
+  free(_buffers[0]);
+  free(_buffers[1]);
+  if(_lock){
+    vSemaphoreDelete(_lock);
+    vSemaphoreDelete(_flushLock);
+  }
+}
+
+
+/**
+ * @brief Opens the log file and keeps it open for writing.
+ *
+ * Records that were buffered but never flushed, e.g. because the card was
+ * removed, are taken out of the buffers first and appended to the file once it
+ * is open, so they get the same positions if the file is the one they were
+ * meant for. If the file can't be opened they are kept for the next call.
+ * Nothing else may append while this runs.
+ *
+ * @return `true` if the file can be used.
+ */
+bool BufferedFsLogStore::begin(){
+  if(!_lock){
+    _lock = xSemaphoreCreateMutex();
+    _flushLock = xSemaphoreCreateMutex();
+  }
+  if(!_buffers[0]){
+    _buffers[0] = (LogRecord*)malloc(BLOCK_SIZE);
+    _buffers[1] = (LogRecord*)malloc(BLOCK_SIZE);
+  }
+  if(!_lock || !_flushLock || !_buffers[0] || !_buffers[1]){
+    return false;
+  }
+
+  xSemaphoreTake(_flushLock, portMAX_DELAY);
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if(_file){
+    _file.close();
+  }
+  size_t unflushed = _count > _flushed ? _count - _flushed : 0;
+  if(unflushed > 0){
+    size_t kept = _unflushed.size();
+    _unflushed.resize(kept + unflushed);
+    size_t copied = 0;
+    while(copied < unflushed){
+      size_t read = _copyBuffered(_flushed + copied, &_unflushed[kept + copied], unflushed - copied);
+      if(read == 0){
+        break;
+      }
+      copied += read;
+    }
+    _unflushed.resize(kept + copied);
+    for(int i = 0; i < 2; i++){
+      _filled[i] = _synced[i];
+    }
+    _count = _flushed;
+  }
+  bool ready = FsLogStore::begin() && _open();
+  xSemaphoreGive(_lock);
+  xSemaphoreGive(_flushLock);
+
+  // appended one buffer at a time, as a full buffer may have to be flushed first
+  size_t appended = 0;
+  while(ready && appended < _unflushed.size()){
+    size_t chunk = _unflushed.size() - appended;
+    if(chunk > BLOCK_RECORDS){
+      chunk = BLOCK_RECORDS;
+    }
+    ready = appendBatch(&_unflushed[appended], chunk) == chunk;
+    if(ready){
+      appended += chunk;
+    }
+  }
+  _unflushed.erase(_unflushed.begin(), _unflushed.begin() + appended);
+  if(_unflushed.empty()){
+    std::vector<LogRecord>().swap(_unflushed);
+  }
+  return ready;
+}
+
+
+/**
+ * @brief Opens the file and sets up the buffers from what is on the card.
+ *
+ * @details
+ * The function performs the following steps:
+ * - Opens the file for reading and writing, without truncating it.
+ * - If the file ends in zeroed records, it was preallocated, and the end of the
+ *   log is found with a binary search for the first record that isn't valid.
+ * - Loads the records of the last, partly filled block into a buffer, so the
+ *   next flush writes that block from its start.
+ *
+ * Expects `_count` to hold the number of records in the file, and both locks
+ * to be held.
+ *
+ * @return `true` if the file was opened.
+ */
+bool BufferedFsLogStore::_open(){
+  _file = _fs.open(_path, "r+");
+  if(!_file){
+    _count = 0;
+    return false;
+  }
+  _allocated = _file.size();
+
+  uint32_t records = _count;
+  LogRecord record;
+  if(records > 0 && _readFile(records - 1, &record, 1) == 1 && record.sequence == 0 && record.crc == 0){
+    uint32_t low = 0;
+    uint32_t high = records - 1;
+    while(low < high){
+      uint32_t middle = low + (high - low) / 2;
+      if(_readFile(middle, &record, 1) == 1 && logRecordValid(record) && record.sequence == middle){
+        low = middle + 1;
+      }
+      else{
+        high = middle;
+      }
+    }
+    records = low;
+  }
+
+  _count = records;
+  _flushed = records;
+  _active = 0;
+  _block[0] = records / BLOCK_RECORDS;
+  _filled[0] = records % BLOCK_RECORDS;
+  _synced[0] = _filled[0];
+  _block[1] = _block[0];
+  _filled[1] = 0;
+  _synced[1] = 0;
+  if(_filled[0] > 0 && _readFile(_block[0] * BLOCK_RECORDS, _buffers[0], _filled[0]) != _filled[0]){
+    _file.close();
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * @brief Copies records into the buffers.
+ *
+ * A batch must fit in one buffer. If both buffers are full the records are
+ * written out first, so a slow flush holds up appends only then.
+ */
+bool BufferedFsLogStore::_write(const LogRecord *records, size_t count){
+  if(!_file || count > BLOCK_RECORDS){
+    return false;
+  }
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  while(true){
+    int other = 1 - _active;
+    size_t room = BLOCK_RECORDS - _filled[_active];
+    if(_synced[other] == _filled[other]){
+      room += BLOCK_RECORDS;
+    }
+    if(room >= count){
+      break;
+    }
+    _writerStats.stalls++;
+    xSemaphoreGive(_lock);
+    xSemaphoreTake(_flushLock, portMAX_DELAY);
+    int written = _flushBuffer(false);
+    xSemaphoreGive(_flushLock);
+    if(written < 0){
+      return false;
+    }
+    xSemaphoreTake(_lock, portMAX_DELAY);
+  }
+
+  size_t copied = 0;
+  while(copied < count){
+    if(_filled[_active] == BLOCK_RECORDS){
+      int other = 1 - _active;
+      _block[other] = _block[_active] + 1;
+      _filled[other] = 0;
+      _synced[other] = 0;
+      _active = other;
+    }
+    size_t chunk = BLOCK_RECORDS - _filled[_active];
+    if(chunk > count - copied){
+      chunk = count - copied;
+    }
+    memcpy(_buffers[_active] + _filled[_active], records + copied, chunk * sizeof(LogRecord));
+    _filled[_active] += chunk;
+    copied += chunk;
+  }
+  _count += count;
+  _writerStats.bytesAppended += count * sizeof(LogRecord);
+  xSemaphoreGive(_lock);
+  return true;
+}
+
+
+/**
+ * @brief Writes the oldest buffer that holds records not yet on the card.
+ *
+ * The write starts at the beginning of the 512 byte sector holding the first
+ * unwritten record. The already written records in that sector are written
+ * again, so the card gets whole sectors and never has to merge data. A full
+ * buffer is a whole 4 KB block. The buffer lock is only held to pick the
+ * records, so appends go on while they are written.
+ *
+ * Expects `_flushLock` to be held.
+ *
+ * @param partial Also write the buffer that is still being filled.
+ * @return The number of records written, or -1 if the write failed.
+ */
+int BufferedFsLogStore::_flushBuffer(bool partial){
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  int buffer = -1;
+  for(int i = 0; i < 2; i++){
+    if(_synced[i] < _filled[i] && (buffer < 0 || _block[i] < _block[buffer])){
+      buffer = i;
+    }
+  }
+  if(buffer < 0 || (!partial && _filled[buffer] < BLOCK_RECORDS)){
+    xSemaphoreGive(_lock);
+    return 0;
+  }
+  const size_t sectorRecords = 512 / sizeof(LogRecord);
+  uint32_t block = _block[buffer];
+  size_t from = _synced[buffer] - _synced[buffer] % sectorRecords;
+  size_t to = _filled[buffer];
+  const LogRecord *records = _buffers[buffer];
+  xSemaphoreGive(_lock);
+
+  uint32_t offset = (block * BLOCK_RECORDS + from) * sizeof(LogRecord);
+  size_t bytes = (to - from) * sizeof(LogRecord);
+  uint32_t start = micros();
+  bool written = _preallocateTo(offset + bytes)
+    && _file.seek(offset)
+    && _file.write((const uint8_t*)(records + from), bytes) == bytes;
+  _file.flush();
+  uint32_t elapsed = micros() - start;
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if(written){
+    _synced[buffer] = to;
+    _flushed = block * BLOCK_RECORDS + to;
+    if(offset + bytes > _allocated){
+      _allocated = offset + bytes;
+    }
+    _writerStats.flushes++;
+    _writerStats.bytesWritten += bytes;
+    _writerStats.lastFlushMicros = elapsed;
+    _writerStats.totalFlushMicros += elapsed;
+    if(elapsed > _writerStats.maxFlushMicros){
+      _writerStats.maxFlushMicros = elapsed;
+    }
+  }
+  else{
+    _stats.errors++;
+  }
+  xSemaphoreGive(_lock);
+  return written ? to - from : -1;
+}
+
+
+/**
+ * @brief Grows the file with zeroed blocks if `size` is past its end.
+ *
+ * Does nothing unless `preallocate()` was called.
+ *
+ * @param size The size the file has to have room for.
+ * @return `false` if the zeroes could not be written.
+ */
+bool BufferedFsLogStore::_preallocateTo(uint32_t size){
+  if(_preallocate == 0 || size <= _allocated){
+    return true;
+  }
+  uint8_t zeroes[512] = {};
+  uint32_t end = size + _preallocate;
+  end -= end % BLOCK_SIZE;
+  if(!_file.seek(_allocated)){
+    return false;
+  }
+  while(_allocated < end){
+    size_t chunk = end - _allocated < sizeof(zeroes) ? end - _allocated : sizeof(zeroes);
+    if(_file.write(zeroes, chunk) != chunk){
+      return false;
+    }
+    _allocated += chunk;
+    _writerStats.bytesPreallocated += chunk;
+  }
+  return true;
+}
+
+
+/**
+ * @brief Writes buffered records to the card.
+ *
+ * @param partial Also write the records of the buffer that isn't full yet.
+ * @return `false` if a write failed. The records stay buffered.
+ */
+bool BufferedFsLogStore::flush(bool partial){
+  if(!_flushLock || !_file){
+    return false;
+  }
+  xSemaphoreTake(_flushLock, portMAX_DELAY);
+  int written;
+  do{
+    written = _flushBuffer(partial);
+  } while(written > 0);
+  xSemaphoreGive(_flushLock);
+  return written == 0;
+}
+
+
+bool BufferedFsLogStore::needsFlush(){
+  if(!_lock){
+    return false;
+  }
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  bool full = false;
+  for(int i = 0; i < 2; i++){
+    full |= _filled[i] == BLOCK_RECORDS && _synced[i] < _filled[i];
+  }
+  xSemaphoreGive(_lock);
+  return full;
+}
+
+
+uint32_t BufferedFsLogStore::flushedCount(){
+  return _flushed;
+}
+
+
+LogWriterStats BufferedFsLogStore::writerStats(){
+  if(!_lock){
+    return _writerStats;
+  }
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  LogWriterStats current = _writerStats;
+  xSemaphoreGive(_lock);
+  return current;
+}
+
+
+/**
+ * @brief Copies records that are still in a buffer. Expects `_lock` to be held.
+ *
+ * @return The number of records copied, 0 if `index` isn't buffered.
+ */
+size_t BufferedFsLogStore::_copyBuffered(uint32_t index, LogRecord *records, size_t count){
+  for(int i = 0; i < 2; i++){
+    uint32_t start = _block[i] * BLOCK_RECORDS;
+    if(index >= start && index < start + _filled[i]){
+      size_t available = start + _filled[i] - index;
+      if(count > available){
+        count = available;
+      }
+      memcpy(records, _buffers[i] + (index - start), count * sizeof(LogRecord));
+      return count;
+    }
+  }
+  return 0;
+}
+
+
+/**
+ * @brief Reads records, taking the ones still in a buffer from RAM.
+ */
+size_t BufferedFsLogStore::read(uint32_t index, LogRecord *records, size_t count){
+  if(!_lock){
+    return 0;
+  }
+  _stats.reads++;
+  size_t done = 0;
+  while(done < count){
+    uint32_t position = index + done;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if(position >= _count){
+      xSemaphoreGive(_lock);
+      break;
+    }
+    size_t wanted = count - done;
+    if(wanted > _count - position){
+      wanted = _count - position;
+    }
+    size_t read = _copyBuffered(position, records + done, wanted);
+    uint32_t flushed = _flushed;
+    xSemaphoreGive(_lock);
+
+    // records that aren't buffered any more are on the card
+    if(read == 0 && position < flushed){
+      read = _readFile(position, records + done, wanted < flushed - position ? wanted : flushed - position);
+    }
+    if(read == 0){
+      break;
+    }
+    done += read;
+  }
+  _stats.recordsRead += done;
+  return done;
+}
+
+
+/**
+ * @brief Drops the buffered records and moves the log to `path`.
+ */
+bool BufferedFsLogStore::rotate(const char *path){
+  if(!_lock){
+    return false;
+  }
+  xSemaphoreTake(_flushLock, portMAX_DELAY);
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  std::vector<LogRecord>().swap(_unflushed);
+  if(_file){
+    _file.close();
+  }
+  bool rotated = FsLogStore::rotate(path);
+  if(!rotated){
+    FsLogStore::begin();
+  }
+  bool ready = _open();
+  xSemaphoreGive(_lock);
+  xSemaphoreGive(_flushLock);
+  return rotated && ready;
+}
+
+
+/**
+ * @brief Flushes the buffers, then truncates the file like `FsLogStore`.
+ *
+ * A preallocated tail is cut off too, the file grows again on the next flush.
+ */
+bool BufferedFsLogStore::truncate(uint32_t count){
+  if(count >= _count){
+    return true;
+  }
+  if(!flush()){
+    return false;
+  }
+
+  xSemaphoreTake(_flushLock, portMAX_DELAY);
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _file.close();
+  _count = _allocated / sizeof(LogRecord);
+  bool truncated = FsLogStore::truncate(count);
+  if(!truncated){
+    _count = _allocated / sizeof(LogRecord);
+  }
+  bool ready = _open();
+  xSemaphoreGive(_lock);
+  xSemaphoreGive(_flushLock);
+  return truncated && ready;
+}
+
+#else
+
+PosixLogStore::PosixLogStore(const char *path)
+  : _path(path)
+  , _fd(-1)
+  , _count(0)
+{}
+
+PosixLogStore::~PosixLogStore(){
+  if(_fd >= 0){
+    close(_fd);
+  }
+}
+
+bool PosixLogStore::begin(){
+  if(_fd < 0){
+    _fd = open(_path.c_str(), O_RDWR | O_CREAT, 0644);
+  }
+  struct stat st;
+  if(_fd < 0 || fstat(_fd, &st) != 0){
+    return false;
+  }
+  _count = st.st_size / sizeof(LogRecord);
+  if(st.st_size % sizeof(LogRecord) != 0){
+    return ftruncate(_fd, _count * sizeof(LogRecord)) == 0;
+  }
+  return true;
+}
+
+size_t PosixLogStore::read(uint32_t index, LogRecord *records, size_t count){
+  if(_fd < 0 || index >= _count){
+    return 0;
+  }
+  if(count > _count - index){
+    count = _count - index;
+  }
+
+  _stats.reads++;
+  ssize_t bytes = pread(_fd, records, count * sizeof(LogRecord), (off_t)index * sizeof(LogRecord));
+  if(bytes < 0){
+    _stats.errors++;
+    return 0;
+  }
+  size_t read = bytes / sizeof(LogRecord);
+  _stats.recordsRead += read;
+  return read;
+}
+
+bool PosixLogStore::_write(const LogRecord *records, size_t count){
+  size_t bytes = count * sizeof(LogRecord);
+  if(_fd < 0 || pwrite(_fd, records, bytes, (off_t)_count * sizeof(LogRecord)) != (ssize_t)bytes){
+    return false;
+  }
+  _count += count;
+  return true;
+}
+
+bool PosixLogStore::truncate(uint32_t count){
+  if(count >= _count){
+    return true;
+  }
+  _stats.truncates++;
+  if(_fd < 0 || ftruncate(_fd, (off_t)count * sizeof(LogRecord)) != 0){
+    _stats.errors++;
+    return false;
+  }
+  _count = count;
+  return true;
+}
+
+#endif
+
+
+size_t RamLogStore::read(uint32_t index, LogRecord *records, size_t count){
+  if(index >= _records.size()){
+    return 0;
+  }
+  if(count > _records.size() - index){
+    count = _records.size() - index;
+  }
+  _stats.reads++;
+  memcpy(records, &_records[index], count * sizeof(LogRecord));
+  _stats.recordsRead += count;
+  return count;
+}
+
+bool RamLogStore::_write(const LogRecord *records, size_t count){
+  if(_capacity > 0 && _records.size() + count > _capacity){
+    return false;
+  }
+  _records.insert(_records.end(), records, records + count);
+  return true;
+}
+
+bool RamLogStore::truncate(uint32_t count){
+  if(count < _records.size()){
+    _stats.truncates++;
+    _records.resize(count);
+  }
+  return true;
+}
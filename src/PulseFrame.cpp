@@ -0,0 +1,48 @@
+#include "PulseFrame.h"
+#include <string.h>
+
+
+void PulseFrame::clear(){
+  memset(_data, 0, HEADER_SIZE);
+  _data[0] = TYPE_PULSES;
+  _count = 0;
+  _lastTime = 0;
+  _lastValue = 0;
+}
+
+
+bool PulseFrame::add(uint32_t sequence, uint32_t time, int32_t value){
+  if(_count == MAX_RECORDS){
+    return false;
+  }
+  if(_count == 0){
+    _put32(4, time);
+    _put32(8, (uint32_t)value);
+    _lastTime = time;
+    _lastValue = value;
+  }
+  if(time < _lastTime || time - _lastTime > 0xFFFF || value < _lastValue || (uint32_t)(value - _lastValue) > 0xFFFF){
+    return false;
+  }
+
+  size_t pos = HEADER_SIZE + _count * RECORD_SIZE;
+  _put32(pos, sequence);
+  _put16(pos + 4, time - _lastTime);
+  _put16(pos + 6, value - _lastValue);
+  _lastTime = time;
+  _lastValue = value;
+  _count++;
+  _data[1] = _count;
+  return true;
+}
+
+
+void PulseFrame::_put16(size_t pos, uint16_t value){
+  _data[pos] = value & 0xFF;
+  _data[pos + 1] = value >> 8;
+}
+
+void PulseFrame::_put32(size_t pos, uint32_t value){
+  _put16(pos, value & 0xFFFF);
+  _put16(pos + 2, value >> 16);
+}
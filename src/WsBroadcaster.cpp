@@ -0,0 +1,450 @@
+#include "WsBroadcaster.h"
+#include <time.h>
+
+// finished buckets kept while nothing runs, e.g. in configuration mode
+static const size_t MAX_BUCKETS = 60;
+
+// names of the topics, in the order of their bits
+static const char *TOPIC_NAMES[] = {"pulses", "seconds", "minutes", "power", "health"};
+static const size_t TOPIC_COUNT = sizeof(TOPIC_NAMES) / sizeof(TOPIC_NAMES[0]);
+
+
+uint8_t WsBroadcaster::topic(const char *name){
+  if(!name){
+    return 0;
+  }
+  for(size_t i = 0; i < TOPIC_COUNT; i++){
+    if(strcmp(name, TOPIC_NAMES[i]) == 0){
+      return 1 << i;
+    }
+  }
+  return 0;
+}
+
+
+const char *WsBroadcaster::topicName(uint8_t topic){
+  for(size_t i = 0; i < TOPIC_COUNT; i++){
+    if(topic == (1 << i)){
+      return TOPIC_NAMES[i];
+    }
+  }
+  return nullptr;
+}
+
+
+WsBroadcaster::WsBroadcaster(AsyncWebSocket *ws, const char *binaryProtocol, size_t capacity)
+  : _ws(ws)
+  , _binaryProtocol(binaryProtocol)
+  , _pulses(capacity)
+  , _added(0)
+  , _events(nullptr)
+  , _eventsNext(0)
+  , _minInterval(100)
+  , _maxInterval(2000)
+  , _second{0, 0, 0}
+  , _minute{0, 0, 0}
+  , _lastPower(0)
+  , _lock(xSemaphoreCreateMutex())
+{}
+
+
+void WsBroadcaster::setInterval(uint32_t minInterval, uint32_t maxInterval){
+  _minInterval = minInterval;
+  _maxInterval = maxInterval < minInterval ? minInterval : maxInterval;
+}
+
+
+void WsBroadcaster::addClient(uint32_t id, uint32_t sequence){
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  uint32_t next = _added > _pulses.size() ? _added - _pulses.size() : 0;
+  while(next < _added && _pulses[next % _pulses.size()].sequence < sequence){
+    next++;
+  }
+  ClientState *state = _find(id);
+  if(state){
+    state->next = next;
+    state->synced = true;
+  }
+  else{
+    _clients.push_back({id, TOPIC_PULSES, true, next, _minInterval, (uint32_t)millis()});
+  }
+  xSemaphoreGive(_lock);
+}
+
+
+void WsBroadcaster::removeClient(uint32_t id){
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _remove(id);
+  xSemaphoreGive(_lock);
+}
+
+
+void WsBroadcaster::subscribe(uint32_t id, uint8_t topics){
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  ClientState *state = _find(id);
+  if(state){
+    state->topics = topics;
+  }
+  else{
+    // pulses only start once the client was sent the log
+    _clients.push_back({id, topics, false, _added, _minInterval, (uint32_t)millis()});
+  }
+  xSemaphoreGive(_lock);
+}
+
+
+bool WsBroadcaster::subscribed(uint8_t topic){
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  bool subscribed = _subscribed(topic);
+  xSemaphoreGive(_lock);
+  return subscribed;
+}
+
+
+void WsBroadcaster::publish(uint8_t topic, JsonDocument &doc, AwsMessageClass messageClass){
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _publish(topic, doc, messageClass);
+  xSemaphoreGive(_lock);
+  _ws->_cleanBuffers();
+}
+
+
+WsBroadcaster::ClientState *WsBroadcaster::_find(uint32_t id){
+  for(ClientState &state : _clients){
+    if(state.id == id){
+      return &state;
+    }
+  }
+  return nullptr;
+}
+
+
+bool WsBroadcaster::_subscribed(uint8_t topic){
+  // event source clients get every topic
+  if(_events && _events->count()){
+    return true;
+  }
+  for(const ClientState &state : _clients){
+    if(state.topics & topic){
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void WsBroadcaster::_publish(uint8_t topic, JsonDocument &doc, AwsMessageClass messageClass){
+  if(!_subscribed(topic)){
+    return;
+  }
+  size_t len = measureJson(doc);
+  AsyncWebSocketMessageBuffer *buffer = _ws->reserveBuffer(len);
+  if(!buffer || !buffer->get()){
+    if(buffer){
+      buffer->unlock();
+    }
+    return;
+  }
+  serializeJson(doc, (char*)buffer->get(), len + 1);
+
+  // a client found here is only safe to use while the list of clients is locked
+  AsyncWebLockGuard clients(_ws->clientsLock());
+  for(const ClientState &state : _clients){
+    if(!(state.topics & topic)){
+      continue;
+    }
+    AsyncWebSocketClient *client = _ws->client(state.id);
+    if(client && client->status() == WS_CONNECTED){
+      // the topic is the key, so a newer value only replaces one of the same topic
+      client->text(buffer, messageClass, topic);
+    }
+  }
+  if(_events && _events->count()){
+    _events->send((const char*)buffer->get(), topicName(topic));
+  }
+  buffer->unlock();
+}
+
+
+void WsBroadcaster::_remove(uint32_t id){
+  for(size_t i = 0; i < _clients.size(); i++){
+    if(_clients[i].id == id){
+      _clients.erase(_clients.begin() + i);
+      break;
+    }
+  }
+}
+
+
+void WsBroadcaster::add(uint32_t sequence, uint32_t time, int32_t value){
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _pulses[_added % _pulses.size()] = {sequence, time, value};
+  _added++;
+  _count(_second, _seconds, 1, {sequence, time, value});
+  _count(_minute, _minutes, 60, {sequence, time, value});
+  xSemaphoreGive(_lock);
+}
+
+
+void WsBroadcaster::reset(){
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _added = 0;
+  _eventsNext = 0;
+  for(ClientState &state : _clients){
+    state.next = 0;
+  }
+  _second.pulses = 0;
+  _minute.pulses = 0;
+  _seconds.clear();
+  _minutes.clear();
+  xSemaphoreGive(_lock);
+}
+
+
+/**
+ * @brief Sends every client that is due the pulses it hasn't had yet.
+ *
+ * @details
+ * For each client the function:
+ * - Skips it if there is nothing new or its interval hasn't passed.
+ * - Doubles its interval if it still has messages queued, and skips it.
+ * - Otherwise halves its interval towards `minInterval` and sends the pulses in one frame.
+ *
+ * Messages are built the first time a client needs them and kept for the other
+ * clients that need the same ones during this run, then released. The clients
+ * of the event source get the new pulses as one event, from the same JSON. After the
+ * pulses, the seconds and minutes that have ended and the power are published
+ * to the clients that subscribed to them.
+ */
+void WsBroadcaster::run(){
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  uint32_t now = millis();
+  uint32_t oldest = _added > _pulses.size() ? _added - _pulses.size() : 0;
+
+  {
+    // a disconnect frees the client on the async_tcp task, so it is looked up and sent to with the clients locked
+    AsyncWebLockGuard clients(_ws->clientsLock());
+    for(ClientState &state : _clients){
+      if(!state.synced || state.next >= _added || (int32_t)(now - state.due) < 0){
+        continue;
+      }
+      if(!(state.topics & TOPIC_PULSES)){
+        state.next = _added;
+        continue;
+      }
+      AsyncWebSocketClient *client = _ws->client(state.id);
+      if(!client || client->status() != WS_CONNECTED){
+        continue;
+      }
+
+      if(!client->canSend() || client->queueLength() > 0){
+        state.interval = state.interval * 2 > _maxInterval ? _maxInterval : state.interval * 2;
+        state.due = now + state.interval;
+        continue;
+      }
+      state.interval = state.interval / 2 < _minInterval ? _minInterval : state.interval / 2;
+
+      _send(client, state.next < oldest ? oldest : state.next);
+      state.next = _added;
+      state.due = now + state.interval;
+    }
+  }
+  _sendEvents(oldest);
+  _release(_json);
+  _release(_binary);
+
+  uint32_t seconds = ::time(nullptr);
+  _close(_second, _seconds, 1, seconds);
+  _close(_minute, _minutes, 60, seconds);
+  _publishBuckets(TOPIC_SECONDS, "seconds", _seconds);
+  _publishBuckets(TOPIC_MINUTES, "minutes", _minutes);
+  if(seconds != _lastPower){
+    _lastPower = seconds;
+    _publishPower(seconds);
+  }
+  xSemaphoreGive(_lock);
+  _ws->_cleanBuffers();
+}
+
+
+/**
+ * @brief Counts a pulse in the bucket of `period` seconds it falls in.
+ *
+ * When the pulse is past the end of the bucket, the bucket is finished and
+ * moved to `done`, and a new one is started with the pulse.
+ */
+void WsBroadcaster::_count(Bucket &bucket, std::vector<Bucket> &done, uint32_t period, const Pulse &pulse){
+  uint32_t start = pulse.time - pulse.time % period;
+  if(bucket.pulses && bucket.start != start){
+    _close(bucket, done, period, start);
+  }
+  if(!bucket.pulses){
+    bucket.start = start;
+  }
+  bucket.pulses++;
+  bucket.value = pulse.value;
+}
+
+
+/**
+ * @brief Moves the bucket to `done` if it ended before `now`.
+ */
+void WsBroadcaster::_close(Bucket &bucket, std::vector<Bucket> &done, uint32_t period, uint32_t now){
+  if(!bucket.pulses || bucket.start + period > now){
+    return;
+  }
+  if(done.size() >= MAX_BUCKETS){
+    done.erase(done.begin());
+  }
+  done.push_back(bucket);
+  bucket.pulses = 0;
+}
+
+
+void WsBroadcaster::_publishBuckets(uint8_t topic, const char *name, std::vector<Bucket> &done){
+  for(const Bucket &bucket : done){
+    JsonDocument doc;
+    doc["topic"] = name;
+    doc["time"] = bucket.start;
+    doc["pulses"] = bucket.pulses;
+    doc["accumulatedValue"] = bucket.value;
+    _publish(topic, doc, WS_MSG_DEFAULT);
+  }
+  done.clear();
+}
+
+
+/**
+ * @brief Publishes the pulses of the last `POWER_WINDOW` seconds, as pulses per hour.
+ */
+void WsBroadcaster::_publishPower(uint32_t now){
+  if(!_subscribed(TOPIC_POWER)){
+    return;
+  }
+  uint32_t oldest = _added > _pulses.size() ? _added - _pulses.size() : 0;
+  uint32_t pulses = 0;
+  for(uint32_t i = _added; i > oldest; i--){
+    if(_pulses[(i - 1) % _pulses.size()].time + POWER_WINDOW <= now){
+      break;
+    }
+    pulses++;
+  }
+
+  JsonDocument doc;
+  doc["topic"] = "power";
+  doc["time"] = now;
+  doc["pulsesPerHour"] = pulses * 3600 / POWER_WINDOW;
+  _publish(TOPIC_POWER, doc, WS_MSG_LATEST);
+}
+
+
+/**
+ * @brief Sends the pulses added since the last run to the event source, as one `pulses` event.
+ *
+ * The id of the event is the sequence number of the last pulse in it, so a client
+ * that reconnects with it as `Last-Event-ID` can be sent what it missed.
+ */
+void WsBroadcaster::_sendEvents(uint32_t oldest){
+  if(!_events || _eventsNext >= _added || !_events->count()){
+    _eventsNext = _added;
+    return;
+  }
+  uint32_t from = _eventsNext < oldest ? oldest : _eventsNext;
+  if(_json.buffers.empty() || _json.from != from){
+    _release(_json);
+    _json.from = from;
+    _buildJson(_json, from);
+  }
+  if(!_json.buffers.empty()){
+    const Pulse &last = _pulses[(_added - 1) % _pulses.size()];
+    _events->send((const char*)_json.buffers[0]->get(), "pulses", last.sequence);
+  }
+  _eventsNext = _added;
+}
+
+
+void WsBroadcaster::_send(AsyncWebSocketClient *client, uint32_t from){
+  bool binary = client->protocol() == _binaryProtocol;
+  Message &message = binary ? _binary : _json;
+  if(message.buffers.empty() || message.from != from){
+    _release(message);
+    message.from = from;
+    if(binary){
+      _buildBinary(message, from);
+    }
+    else{
+      _buildJson(message, from);
+    }
+  }
+
+  for(AsyncWebSocketMessageBuffer *buffer : message.buffers){
+    if(binary){
+      client->binary(buffer);
+    }
+    else{
+      client->text(buffer);
+    }
+  }
+}
+
+
+void WsBroadcaster::_buildBinary(Message &message, uint32_t from){
+  _frame.clear();
+  for(uint32_t i = from; i <= _added; i++){
+    const Pulse &pulse = _pulses[i % _pulses.size()];
+    // the last frame is done after the last pulse, others when the next pulse doesn't fit
+    if(i < _added && _frame.add(pulse.sequence, pulse.time, pulse.value)){
+      continue;
+    }
+    AsyncWebSocketMessageBuffer *buffer = _ws->reserveBuffer(_frame.length());
+    if(buffer && buffer->get()){
+      memcpy(buffer->get(), _frame.data(), _frame.length());
+      message.buffers.push_back(buffer);
+    }
+    else if(buffer){
+      buffer->unlock();
+    }
+    _frame.clear();
+    if(i < _added){
+      _frame.add(pulse.sequence, pulse.time, pulse.value);
+    }
+  }
+}
+
+
+void WsBroadcaster::_buildJson(Message &message, uint32_t from){
+  JsonDocument doc;
+  JsonArray pulses;
+  if(_added - from > 1){
+    pulses = doc["pulses"].to<JsonArray>();
+  }
+  for(uint32_t i = from; i < _added; i++){
+    const Pulse &pulse = _pulses[i % _pulses.size()];
+    JsonObject object = pulses.isNull() ? doc.to<JsonObject>() : pulses.add<JsonObject>();
+    object["sequence"] = pulse.sequence;
+    object["accumulatedValue"] = pulse.value;
+    object["time"] = pulse.time;
+  }
+
+  // serialize straight into the buffer the clients share
+  size_t len = measureJson(doc);
+  AsyncWebSocketMessageBuffer *buffer = _ws->reserveBuffer(len);
+  if(buffer && buffer->get()){
+    serializeJson(doc, (char*)buffer->get(), len + 1);
+    message.buffers.push_back(buffer);
+  }
+  else if(buffer){
+    buffer->unlock();
+  }
+}
+
+
+/**
+ * @brief Unlocks the buffers of a message, so they are freed once every client has sent them.
+ */
+void WsBroadcaster::_release(Message &message){
+  for(AsyncWebSocketMessageBuffer *buffer : message.buffers){
+    buffer->unlock();
+  }
+  message.buffers.clear();
+}
@@ -9,6 +9,15 @@
 #include "time.h"
 #include <SD.h>
 #include <ArduinoJson.h>
+#include <Preferences.h>
+#include "rom/crc.h"
+#include "LogStore.h"
+#include "LogJson.h"
+#include "PulseFrame.h"
+#include "WsBroadcaster.h"
+#ifdef WEB_ASSETS_PROGMEM
+#include "WebAssets.h" // generated by scripts/build_web.py
+#endif
 
 // for interrupt
 const int interruptPin = 13; // change if connected to another pin 
@@ -31,7 +40,30 @@ IPAddress dns(8, 8, 8, 8);
 
 // for webserver
 AsyncWebServer server(80);
+const char* assetCacheControl = "public, max-age=31536000, immutable"; // files in /assets/, see scripts/build_web.py
+const char* pageCacheControl = "no-cache";  // pages are checked every time, which costs a 304 if they didn't change
+const uint32_t httpKeepAliveTimeout = 5;    // s an idle connection is kept for the page's next request or poll
+const uint16_t httpKeepAliveRequests = 100; // requests on a connection before it is closed anyway
 AsyncWebSocket ws("/ws");
+const char* wsBinaryProtocol = "energy.pulses.v1"; // live pulses as PulseFrames, history as JSON
+const char* wsJsonProtocol = "energy.json.v1";     // everything as JSON, same as without a subprotocol
+const uint32_t wsBroadcastInterval = 100;  // ms between frames of pulses to a client, so at most 10 per second
+const uint32_t wsSlowInterval = 2000;      // ms between frames to a client that can't keep up
+const uint32_t wsHealthInterval = 5000;    // ms between system health messages
+const uint16_t wsPingInterval = 5;         // s without traffic before a client is pinged
+const uint16_t wsPongTimeout = 3;          // s a client has to answer a ping before it is dropped
+const size_t wsDeflateThreshold = 1024;    // bytes a log message has to be before it is compressed
+const uint8_t wsDeflateWindowBits = 10;    // 1 KB window, about 7 KB of RAM per log being compressed
+const size_t wsLogRecordJsonSize = 44;     // bytes a record takes in the JSON log, about
+WsBroadcaster broadcaster(&ws, wsBinaryProtocol);
+AsyncEventSource events("/events");
+const uint32_t sseReplayMax = 512;      // records replayed at most to a client that reconnects
+const uint32_t sseReplayChunk = 32;     // records per replayed event
+const int sseReplayQueueLength = 4;     // replays waiting for broadcastLog, more reconnects at once aren't replayed
+struct eventReplay {
+  uint32_t client;   // id of the event source client
+  uint32_t from;     // index of the first record to send
+};
 
 
 // for time -- reference: https://randomnerdtutorials.com/esp32-date-time-ntp-client-server-arduino/
@@ -47,17 +79,95 @@ struct dataLog {
 };
 volatile int accumulatedValue = 0;
 volatile dataLog latestData;
-
+struct logEntry {
+  dataLog log;
+  uint32_t epoch;  // logEpoch when the value was counted
+  bool reset;      // starts a new epoch instead of carrying a value
+};
+volatile uint32_t logEpoch = 0; // goes up every time the log is reset
+uint32_t storedEpoch = 0;       // epoch of the values in the log, only used by handleData
+portMUX_TYPE counterMux = portMUX_INITIALIZER_UNLOCKED; // guards accumulatedValue and logEpoch
+const char* trashDir = "/trash"; // logs that were reset, removed by the reclaimLog task
+BufferedFsLogStore dataLogStore(SD, "/dataLog.bin");
+const unsigned long logFlushInterval = 1000; // ms records may wait in RAM before they are written to the sd card
+const unsigned long logFinalFlushTimeout = 5000; // ms to wait for the last flush before a restart
+volatile TaskHandle_t logFinalFlush = NULL;  // task waiting for flushLog to write everything and stop
+const size_t logPreallocation = 65536;       // bytes the data log is grown by ahead of the records
+const int logCacheBlocks = 8;                // 4 KB blocks of the log kept in RAM for readers
+LogBlockCache logCache(&dataLogStore, logCacheBlocks);
+const int logJsonCacheChunks = 8;            // chunks of 64 records of JSON kept for clients asking for the same records
+LogJsonCache logJsonCache(&dataLogStore, logJsonCacheChunks);
+const unsigned long webSDWait = 50;          // ms a web request waits for SDMutex before it answers busy or tries again
+
+// for buffering while the sd card is missing
+const int bufferCapacity = 4096;      // records kept in LittleFS while the sd card is missing
+const int ramBufferCapacity = 256;    // records kept in RAM if LittleFS can't be written either
+const int migrateBatchSize = 64;      // records moved to the sd card per read-modify-write
+const int sdRemountInterval = 10000;  // ms between mount attempts
+const uint32_t bufferMagic = 0x45434231; // "ECB1"
+struct bufferHeader {
+  uint32_t magic;
+  uint32_t head;
+  uint32_t count;
+};
+volatile bool sdAvailable = false;
+bool counterRestored = false; // true once accumulatedValue has been read back from the sd card
+int counterOffset = 0;        // added to accumulatedValue if the counter was restored after boot
+bool flashBufferReady = false;
+bufferHeader flashBuffer;
+dataLog ramBuffer[ramBufferCapacity];
+int ramBufferHead = 0;
+int ramBufferCount = 0;
+
+// for restoring the counter without reading the log
+const uint32_t counterMagic = 0x45434331; // "ECC1"
+const unsigned long nvsWriteInterval = 60000; // ms between NVS writes, to spare the flash
+struct counterState {
+  uint32_t magic;
+  int accumulatedValue;
+  uint32_t sequence;      // number of records in the log
+  uint32_t commitOffset;  // size of the data log after the last write
+  uint32_t crc;
+};
+RTC_NOINIT_ATTR counterState rtcCounter; // survives restarts, but not a power loss
+Preferences preferences;
+uint32_t logSequence = 0;
+uint32_t commitOffset = 0;
+unsigned long lastNvsWrite = 0;
+
+// for checking the log in the background
+const int scanBudget = 4096;                  // bytes of the log checked per second
+const unsigned long scanIdleInterval = 60000; // ms to wait once the whole log has been checked
+enum scanAction { SCAN_NONE, SCAN_RESTART, SCAN_TRUNCATE, SCAN_REBUILD };
+struct scanStatus {
+  uint32_t checked;      // records checked
+  uint32_t total;        // records in the log at the last check
+  uint32_t counterGaps;  // records where the accumulated value didn't go up by one
+  uint32_t timeErrors;   // records where the time is missing or went backwards
+  int32_t firstGap;      // index of the first record after a gap, -1 if none
+  int32_t corruptAt;     // index of the first record with a bad crc or sequence, -1 if none
+  int lastValue;
+  uint32_t lastTime;
+  bool complete;         // true when every record in the log has been checked
+};
+scanStatus scan;
+volatile scanAction scanRequest = SCAN_NONE;
 
 
 // shared
 xQueueHandle logQueue;
+xQueueHandle eventReplayQueue;
 SemaphoreHandle_t SDMutex;
 
 // task handles
-TaskHandle_t websocketCleanupHandle;
 TaskHandle_t handleDataHandle;
 TaskHandle_t simulateImpulseHandle;
+TaskHandle_t sdRemountHandle;
+TaskHandle_t scanLogHandle;
+TaskHandle_t flushLogHandle;
+TaskHandle_t reclaimLogHandle;
+TaskHandle_t broadcastLogHandle;
+TaskHandle_t configModeHandle = NULL;
 
 
 
@@ -65,23 +175,56 @@ TaskHandle_t simulateImpulseHandle;
 // prototypes
 bool setupWifi();
 void setupSD();
+bool mountSD();
+void setupBuffer();
+bool openDataLog();
+void convertJsonLog();
+bool restoreCounter();
+bool readCounterFromLog();
+void mirrorCounter(int value, bool forceNvs);
+uint32_t counterChecksum(const counterState &state);
 int setupConfig();
 void saveConfig();
 void createAccessPoint();
 void websocketInit();
+void eventSourceInit();
 void addRoutes();
-void handleWebSocketEvent(void *arg, uint8_t *data, size_t len);
+void handleWebSocketEvent(AsyncWebSocketClient *client, void *arg, uint8_t *data, size_t len);
 void notifyClientWholeLog();
 void notifyClientSingleLog(dataLog log);
-void sendLogToClient(AsyncWebSocketClient *client);
+bool isBinaryClient(AsyncWebSocketClient *client);
+String logToJson();
+void sendLogToClient(AsyncWebSocketClient *client, uint32_t from);
+uint32_t resumeIndex(JsonDocument &doc);
+String downloadETag(uint32_t count);
+int downloadRange(AsyncWebServerRequest *request, uint32_t count, const String &etag, uint32_t &from, uint32_t &end);
+bool parseRangeIndex(const String &text, uint32_t &value);
+void onEventSourceConnect(AsyncEventSourceClient *client);
+void replayEvents(uint32_t client, uint32_t from);
 void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type,
              void *arg, uint8_t *data, size_t len);
-void websocketCleanup( void * pvParameters );
 void handleData( void * pvParameters);
 void simulateImpulse( void * pvParameters);
-void createDataLog();
+bool createDataLog();
 void addDataLog(dataLog log);
+bool appendDataLogs(dataLog *logs, int count);
 void deleteDataLogFile();
+void resetDataLog(uint32_t epoch);
+bool bufferDataLog(dataLog log);
+bool writeBufferHeader();
+int bufferedCount();
+bool migrateBuffer();
+void sdRemount( void * pvParameters);
+void scanLog( void * pvParameters);
+void flushLog( void * pvParameters);
+void reclaimLog( void * pvParameters);
+void broadcastLog( void * pvParameters);
+void enterConfigMode( void * pvParameters);
+void publishHealth();
+void resetScan();
+void scanStep();
+bool truncateLog();
+void rebuildCounter();
 
 
 /**
@@ -97,16 +240,19 @@ void deleteDataLogFile();
  * - Sets a specified pin to low.
  * - Sets up the SD card.
  * - Sets up the configuration file and handles cases where the file is empty or an error occurs.
+ * - Opens the LittleFS fallback buffer used while the SD card is missing.
+ * - Restores the accumulated value from RTC memory, NVS or the data log.
  * - Sets up the WiFi connection and creates an access point if the connection fails.
  * - Initializes the WebSocket and adds routes.
  * - Synchronizes time using NTP server.
  * - Creates a queue and a mutex for handling data logging.
- * - Creates and starts tasks for WebSocket cleanup, data handling, and impulse simulation.
+ * - Creates and starts tasks for data handling, impulse simulation, SD card re-mounting,
+ *   checking the log, removing reset logs and sending pulses to the WebSocket clients.
  *
  * @note Ensure to define the necessary global variables and functions such as `interruptPin`, `setupSD()`, `setupConfig()`, 
  * `createAccessPoint()`, `setupWifi()`, `websocketInit()`, `addRoutes()`, `gmtOffset_sec`, `daylightOffset_sec`, 
- * `ntpServer`, `getLocalTime()`, `logQueue`, `xQueueCreate()`, `xSemaphoreCreateMutex()`, `websocketCleanupHandle`, 
- * `handleDataHandle`, `simulateImpulseHandle`, `websocketCleanup()`, `handleData()`, and `simulateImpulse()`.
+ * `ntpServer`, `getLocalTime()`, `logQueue`, `xQueueCreate()`, `xSemaphoreCreateMutex()`, 
+ * `handleDataHandle`, `simulateImpulseHandle`, `handleData()`, and `simulateImpulse()`.
  *
  * @return void
  */
@@ -140,6 +286,11 @@ void setup() {
      break;
   }
 
+  // setup fallback buffer for when the sd card is missing
+  setupBuffer();
+
+  // get the counter back from RTC memory, NVS or the log
+  restoreCounter();
 
 
   if(!setupWifi()){
@@ -151,6 +302,7 @@ void setup() {
 
   // setup websocket
   websocketInit();
+  eventSourceInit();
   addRoutes();
 
   vTaskDelay(1000);
@@ -167,14 +319,19 @@ void setup() {
 
 
   // create queue & create mutex
-  logQueue = xQueueCreate(1024, sizeof( struct dataLog));
+  logQueue = xQueueCreate(1024, sizeof( struct logEntry));
+  eventReplayQueue = xQueueCreate(sseReplayQueueLength, sizeof(eventReplay));
   SDMutex = xSemaphoreCreateMutex();
 
 
   // setup tasks
-  xTaskCreate(websocketCleanup, "websocketCleanup", 2048, NULL, 1, &websocketCleanupHandle);
   xTaskCreate(handleData, "handleData", 4096, NULL, 2, &handleDataHandle);
   xTaskCreate(simulateImpulse, "simulateImpulse", 2048, NULL, 3, &simulateImpulseHandle);
+  xTaskCreate(sdRemount, "sdRemount", 6144, NULL, 1, &sdRemountHandle);
+  xTaskCreate(scanLog, "scanLog", 4096, NULL, 0, &scanLogHandle);
+  xTaskCreate(flushLog, "flushLog", 4096, NULL, 1, &flushLogHandle);
+  xTaskCreate(reclaimLog, "reclaimLog", 4096, NULL, 0, &reclaimLogHandle);
+  xTaskCreate(broadcastLog, "broadcastLog", 4096, NULL, 2, &broadcastLogHandle);
 
   vTaskDelay(1000);
 
@@ -242,86 +399,356 @@ bool setupWifi(){
 
 
 /**
- * @brief Initializes the SD card and handles the dataLog.json file.
+ * @brief Initializes the SD card and opens the data log.
  *
- * This function checks for the presence of an SD card, mounts it, and ensures that
- * a dataLog.json file exists. If the file doesn't exist, it creates a new one.
- * If the file exists, it reads and parses the JSON content to retrieve the last
- * accumulated value.
+ * This function checks for the presence of an SD card, mounts it, and opens the
+ * data log in "/dataLog.bin" using `openDataLog()`. The accumulated value is
+ * restored later by `restoreCounter()`.
  *
  * @details
  * The function performs the following steps:
- * - Attempts to mount the SD card.
- * - Checks the type of the SD card.
- * - Verifies the existence of dataLog.json file.
- * - Creates dataLog.json file if it doesn't exist.
- * - Reads and parses the existing dataLog.json file if it exists.
- * - Extracts the last accumulated value from the JSON content if available.
+ * - Attempts to mount the SD card using `mountSD()`.
+ * - Opens the data log, creating it if it doesn't exist.
  *
- * @note This function assumes the presence of `createDataLog()`, `accumulatedValue`,
- * and necessary libraries such as `SD`, `File`, and `JsonDocument`.
+ * If the card can't be mounted the function returns with `sdAvailable` set to false.
+ * Data is then kept in the fallback buffer until the `sdRemount` task finds the card.
  *
  * @return void
  */
-
 void setupSD(){
-  if(!SD.begin()){
-    Serial.println("Card Mount Failed");
+  if(!mountSD()){
     return;
   }
 
-  uint8_t cardType = SD.cardType();
+  openDataLog();
+}
 
-  if(cardType == CARD_NONE){
-    Serial.println("No SD card attached");
-    return;
+
+/**
+ * @brief Opens the data log on the SD card.
+ *
+ * The log is a `BufferedFsLogStore` of fixed size records, written to the card
+ * by the `flushLog` task. A "dataLog.json" written by older firmware is converted
+ * the first time the log is opened.
+ *
+ * @return
+ * - `true` if the log can be used.
+ * - `false` otherwise, in which case the SD card is treated as missing.
+ */
+bool openDataLog(){
+  dataLogStore.preallocate(logPreallocation);
+  dataLogStore.setCache(&logCache);
+  if(!dataLogStore.begin()){
+    Serial.println("Failed to open dataLog file");
+    sdAvailable = false;
+    return false;
   }
+  logCache.clear(); // the card may have been swapped
+  logJsonCache.clear();
 
-  // check if json file exist
-  // if it doesn't exist, create it
-  if(!SD.exists("/dataLog.json")){
-    Serial.println("Creating dataLog.json");
-    createDataLog();
+  if(dataLogStore.count() == 0 && SD.exists("/dataLog.json")){
+    convertJsonLog();
   }
-  else{
-    Serial.println("Reading dataLog.json");
+  return true;
+}
 
-    // Open the dataLog.json file
-    File dataLogFile = SD.open("/dataLog.json", FILE_READ);
-    if(!dataLogFile){
-      Serial.println("Failed to open dataLog file");
-      return;
+
+/**
+ * @brief Converts a "dataLog.json" written by older firmware to the data log.
+ *
+ * The JSON file is read one entry at a time, so it doesn't have to fit in
+ * memory, and appended to the data log in batches. Afterwards the file is
+ * renamed to "dataLog.json.old" so it is only converted once. If an entry
+ * can't be read, the entries before it are kept.
+ *
+ * @return void
+ */
+void convertJsonLog(){
+  File jsonFile = SD.open("/dataLog.json", FILE_READ);
+  if(!jsonFile){
+    return;
+  }
+  Serial.println("Converting dataLog.json");
+
+  LogRecord batch[migrateBatchSize];
+  int batchSize = 0;
+  uint32_t converted = 0;
+  bool first = true;
+  bool ok = jsonFile.find("[");
+  while(ok){
+    // entries are separated by commas and the array ends with ]
+    int next = first ? jsonFile.peek() : jsonFile.read();
+    if(next == ']' || (!first && next != ',')){
+      break;
     }
+
     JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, dataLogFile);
-    if(error){
-      Serial.println("Failed to read file, using default configuration");
-      return;
+    if(deserializeJson(doc, jsonFile)){
+      Serial.println("Failed to read entry, stopping conversion");
+      break;
+    }
+    batch[batchSize].accumulatedValue = doc["accumulatedValue"].as<int>();
+    batch[batchSize].time = doc["time"].as<uint32_t>();
+    batchSize++;
+    first = false;
+
+    if(batchSize == migrateBatchSize){
+      ok = dataLogStore.appendBatch(batch, batchSize) == (size_t)batchSize;
+      converted += batchSize;
+      batchSize = 0;
     }
-    dataLogFile.close();
+  }
+  if(ok && batchSize > 0 && dataLogStore.appendBatch(batch, batchSize) == (size_t)batchSize){
+    converted += batchSize;
+  }
+  jsonFile.close();
+
+  SD.remove("/dataLog.json.old");
+  SD.rename("/dataLog.json", "/dataLog.json.old");
+  Serial.print("Converted log entries: ");
+  Serial.println(converted);
+}
+
+
+/**
+ * @brief Restores the accumulated value after a restart.
+ *
+ * The counter is mirrored in two places by `mirrorCounter()`, so most restarts
+ * don't have to read the whole data log back from the SD card.
+ *
+ * @details
+ * The function tries the following, in order:
+ * - RTC memory, which survives every restart except a power loss. It is used if
+ *   the checksum is valid and the log on the SD card still has the size it had
+ *   at the last write.
+ * - NVS, which survives a power loss but is only written every `nvsWriteInterval`.
+ *   It is used if the log still has the size it had when NVS was written and
+ *   nothing is waiting in the fallback buffer.
+ * - Reading the last record of the data log with `readCounterFromLog()`.
+ *
+ * If the SD card is missing, only RTC memory is tried. Otherwise the counter is
+ * continued once the card is back.
+ *
+ * @return
+ * - `true` if the accumulated value was restored.
+ * - `false` otherwise.
+ */
+bool restoreCounter(){
+  preferences.begin("counter", false);
+
+  uint32_t logSize = sdAvailable ? dataLogStore.stats().bytes : 0;
+
+  // RTC memory
+  if(esp_reset_reason() != ESP_RST_POWERON && rtcCounter.magic == counterMagic &&
+     rtcCounter.crc == counterChecksum(rtcCounter) && (!sdAvailable || rtcCounter.commitOffset == logSize)){
+    accumulatedValue = rtcCounter.accumulatedValue;
+    logSequence = rtcCounter.sequence;
+    commitOffset = rtcCounter.commitOffset;
+    counterRestored = true;
+    Serial.print("Accumulated value restored from RTC memory: ");
+    Serial.println(accumulatedValue);
+    return true;
+  }
 
-    // Parse the JSON content
-    JsonArray logArray = doc["log"].as<JsonArray>();
+  if(!sdAvailable){
+    Serial.println("SD card not available, counter will continue once it is back");
+    return false;
+  }
 
-    // Print the size of the JSON array
-    Serial.print("Log array size: ");
-    Serial.println(logArray.size());
+  // NVS
+  counterState saved;
+  if(preferences.getBytes("state", &saved, sizeof(saved)) == sizeof(saved) && saved.magic == counterMagic &&
+     saved.crc == counterChecksum(saved) && saved.commitOffset == logSize && bufferedCount() == 0){
+    accumulatedValue = saved.accumulatedValue;
+    logSequence = saved.sequence;
+    commitOffset = saved.commitOffset;
+    counterRestored = true;
+    mirrorCounter(accumulatedValue, false);
+    Serial.print("Accumulated value restored from NVS: ");
+    Serial.println(accumulatedValue);
+    return true;
+  }
 
-    // Ensure the array is not empty
-    if (logArray.size() > 0) {
-      // Get the last element
-      JsonObject lastLog = logArray[logArray.size() - 1];
+  // the data log
+  if(!readCounterFromLog()){
+    return false;
+  }
+  mirrorCounter(accumulatedValue, true);
+  return true;
+}
 
-      // Extract the last accumulated value
-      accumulatedValue = lastLog["accumulatedValue"].as<int>();
 
+/**
+ * @brief Reads the accumulated value back from the last record in the data log.
+ *
+ * @details
+ * The function performs the following steps:
+ * - Sets the sequence number and commit offset from the size of the log.
+ * - Reads the last record whose crc is valid, going back past any record that
+ *   was only partly written.
+ * - Extracts the accumulated value from it.
+ *
+ * @return
+ * - `true` if the log was read.
+ * - `false` otherwise.
+ */
+bool readCounterFromLog(){
+  logSequence = dataLogStore.count();
+  commitOffset = logSequence * sizeof(LogRecord);
+
+  Serial.print("Log size: ");
+  Serial.println(logSequence);
+
+  LogRecord lastRecord;
+  uint32_t index = logSequence;
+  while(index > 0){
+    index--;
+    if(dataLogStore.read(index, &lastRecord, 1) != 1){
+      Serial.println("Failed to read dataLog file");
+      return false;
+    }
+    if(logRecordValid(lastRecord)){
+      accumulatedValue = lastRecord.accumulatedValue;
       Serial.print("Last Accumulated Value: ");
       Serial.println(accumulatedValue);
-      vTaskDelay(2000);
-    } else {
-      Serial.println("No log entries found");
+      break;
+    }
+  }
+
+  if(logSequence == 0){
+    Serial.println("No log entries found");
+  }
+  counterRestored = true;
+  return true;
+}
+
+
+/**
+ * @brief Mirrors the counter to RTC memory and, at a limited rate, to NVS.
+ *
+ * Called after every record has been logged, so a restart can continue from
+ * `value` without reading the log. RTC memory is written every time, NVS only
+ * every `nvsWriteInterval` unless `forceNvs` is set.
+ *
+ * @param value The accumulated value of the last logged record.
+ * @param forceNvs Writes NVS right away, e.g. before a deliberate restart.
+ *
+ * @note Nothing is mirrored until the counter has been restored, since the
+ * value isn't known yet.
+ *
+ * @return void
+ */
+void mirrorCounter(int value, bool forceNvs){
+  if(!counterRestored){
+    return;
+  }
+
+  rtcCounter.magic = counterMagic;
+  rtcCounter.accumulatedValue = value;
+  rtcCounter.sequence = logSequence;
+  rtcCounter.commitOffset = commitOffset;
+  rtcCounter.crc = counterChecksum(rtcCounter);
+
+  if(forceNvs || millis() - lastNvsWrite >= nvsWriteInterval){
+    preferences.putBytes("state", &rtcCounter, sizeof(rtcCounter));
+    lastNvsWrite = millis();
+  }
+}
+
+
+/**
+ * @brief Calculates the checksum of a `counterState`, leaving out the crc field.
+ *
+ * @param state The state to calculate the checksum of.
+ * @return The CRC32 of the state.
+ */
+uint32_t counterChecksum(const counterState &state){
+  return crc32_le(0, (const uint8_t*)&state, offsetof(counterState, crc));
+}
+
+
+/**
+ * @brief Mounts the SD card and updates `sdAvailable`.
+ *
+ * Any previous mount is released first, so the function can be called again
+ * after the card has been pulled out and put back in.
+ *
+ * @return
+ * - `true` if the card was mounted and a card is attached.
+ * - `false` otherwise.
+ */
+bool mountSD(){
+  SD.end();
+  sdAvailable = false;
+
+  if(!SD.begin()){
+    Serial.println("Card Mount Failed");
+    return false;
+  }
+
+  uint8_t cardType = SD.cardType();
+
+  if(cardType == CARD_NONE){
+    Serial.println("No SD card attached");
+    SD.end();
+    return false;
+  }
+
+  sdAvailable = true;
+  // it may be a different card, so check its log from the start
+  resetScan();
+  return true;
+}
+
+
+/**
+ * @brief Opens the fallback buffer in LittleFS.
+ *
+ * The buffer is a ring of `dataLog` records in "/buffer.bin" behind a small
+ * `bufferHeader`. Records are kept there while the SD card is missing, and are
+ * moved to the SD card by the `sdRemount` task once it is back. Records left
+ * from before a restart are kept and moved as well.
+ *
+ * @details
+ * The function performs the following steps:
+ * - Reads the header of "/buffer.bin" and checks that it is valid.
+ * - Creates a new, empty buffer if the file is missing or the header is broken.
+ *
+ * If LittleFS can't be used, records are kept in the smaller RAM ring instead.
+ *
+ * @return void
+ */
+void setupBuffer(){
+  flashBufferReady = false;
+
+  File bufferFile = LittleFS.open("/buffer.bin", "r");
+  if(bufferFile){
+    size_t read = bufferFile.read((uint8_t*)&flashBuffer, sizeof(flashBuffer));
+    bufferFile.close();
+    if(read == sizeof(flashBuffer) && flashBuffer.magic == bufferMagic &&
+       flashBuffer.head < bufferCapacity && flashBuffer.count <= bufferCapacity){
+      flashBufferReady = true;
+      if(flashBuffer.count > 0){
+        Serial.print("Buffered records waiting for sd card: ");
+        Serial.println(flashBuffer.count);
+      }
+      return;
     }
   }
+
+  // create a new empty buffer
+  bufferFile = LittleFS.open("/buffer.bin", "w");
+  if(!bufferFile){
+    Serial.println("Failed to create buffer file, buffering in RAM");
+    flashBuffer.magic = 0;
+    flashBuffer.count = 0;
+    return;
+  }
+  flashBuffer.magic = bufferMagic;
+  flashBuffer.head = 0;
+  flashBuffer.count = 0;
+  flashBufferReady = bufferFile.write((uint8_t*)&flashBuffer, sizeof(flashBuffer)) == sizeof(flashBuffer);
+  bufferFile.close();
 }
 
 
@@ -566,7 +993,14 @@ void createAccessPoint(){
  *
  * @details
  * The function performs the following steps:
+ * - Sets the rate pulses are sent to the clients at.
+ * - Has clients pinged after `wsPingInterval` seconds without traffic, and dropped if they
+ *   don't answer within `wsPongTimeout` seconds. This runs on the network task, so a dead
+ *   client and its queues are freed within seconds without a task polling for them.
  * - Sets the event handler for WebSocket events using the `onEvent` function.
+ * - Offers the binary and JSON subprotocols. Clients that ask for neither get JSON.
+ * - Offers permessage-deflate, so logs of at least `wsDeflateThreshold` bytes are sent
+ *   compressed to the browsers that take it. Live pulses are too small to be worth it.
  * - Adds the WebSocket server as a handler to the main HTTP server.
  *
  * @note This function assumes the presence of `ws` (WebSocket server) and `server` 
@@ -575,17 +1009,48 @@ void createAccessPoint(){
  * @return void
  */
 void websocketInit(){
+  broadcaster.setInterval(wsBroadcastInterval, wsSlowInterval);
   ws.onEvent(onEvent);
+  ws.addProtocol(wsBinaryProtocol);
+  ws.addProtocol(wsJsonProtocol);
+  ws.enableDeflate(wsDeflateThreshold, wsDeflateWindowBits);
+  ws.keepAlive(wsPingInterval, wsPongTimeout);
   server.addHandler(&ws);
 }
 
 
+/**
+ * @brief Sets up the `/events` Server-Sent Events source.
+ *
+ * Read-only displays can follow the meter on `/events` instead of a WebSocket.
+ * The `broadcaster` sends them the same pulses and topics as the WebSocket
+ * clients, formatted once for all of them.
+ *
+ * @details
+ * The function performs the following steps:
+ * - Sets `onEventSourceConnect` to be called for every new client.
+ * - Hands the event source to the `broadcaster`.
+ * - Adds the event source as a handler to the main HTTP server.
+ *
+ * @note This function assumes the presence of `events`, `broadcaster` and `server`.
+ * Ensure these are properly defined and included in your code.
+ *
+ * @return void
+ */
+void eventSourceInit(){
+  events.onConnect(onEventSourceConnect);
+  broadcaster.setEventSource(&events);
+  server.addHandler(&events);
+}
+
+
 /**
  * @brief Handles WebSocket events for the server.
  *
  * This function processes various WebSocket events such as connect, disconnect,
- * and data reception. It logs client connections and disconnections, sends the 
- * entire log to newly connected clients, and handles incoming data.
+ * and data reception. It logs client connections and disconnections, and handles
+ * incoming data. A new client is sent nothing until it asks for the log with a
+ * "resume" or "wholeLog" request.
  *
  * @param server Pointer to the WebSocket server instance.
  * @param client Pointer to the WebSocket client instance.
@@ -596,13 +1061,14 @@ void websocketInit(){
  *
  * @details
  * The function handles the following WebSocket events:
- * - `WS_EVT_CONNECT`: Logs the connection and sends the entire log to the newly connected client.
- * - `WS_EVT_DISCONNECT`: Logs the disconnection.
+ * - `WS_EVT_CONNECT`: Logs the connection and closes the oldest client if there are too many.
+ * - `WS_EVT_DISCONNECT`: Logs the disconnection and removes the client from the `broadcaster`.
  * - `WS_EVT_DATA`: Handles incoming data using the `handleWebSocketEvent` function.
- * - `WS_EVT_PONG` and `WS_EVT_ERROR`: Currently no actions are taken for these events.
+ * - `WS_EVT_PONG` and `WS_EVT_ERROR`: Currently no actions are taken for these events. Answers
+ *   to the keepalive pings are handled by the WebSocket server and don't get here.
  *
- * @note This function assumes the presence of `sendLogToClient` and `handleWebSocketEvent` 
- * functions. Ensure these are properly defined and included in your code.
+ * @note This function assumes the presence of the `handleWebSocketEvent`
+ * function. Ensure these are properly defined and included in your code.
  *
  * @return void
  */
@@ -612,15 +1078,15 @@ void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType
   switch (type) {
     case WS_EVT_CONNECT:
       Serial.printf("WebSocket client #%u connected from %s\n", client->id(), client->remoteIP().toString().c_str());
-      // Send the entire log to the newly connected client
-      sendLogToClient(client);
+      server->cleanupClients();
       break;
     case WS_EVT_DISCONNECT:
       Serial.printf("WebSocket client #%u disconnected\n", client->id());
+      broadcaster.removeClient(client->id());
       break;
     case WS_EVT_DATA:
       // Handle data
-      handleWebSocketEvent(arg, data, len);
+      handleWebSocketEvent(client, arg, data, len);
       break;
     case WS_EVT_PONG:
     case WS_EVT_ERROR:
@@ -630,244 +1096,651 @@ void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType
 
 
 /**
- * @brief Sends the data log stored in the dataLog.json file to a WebSocket client.
+ * @brief Sends the data log from `from` on to a WebSocket client.
  *
- * This function reads the dataLog.json file from the SD card, parses its content
- * into a JSON object, serializes the JSON object into a string, and sends it to
- * the specified WebSocket client.
+ * This function streams the records from index `from` to the end of the data log
+ * as JSON to the specified WebSocket client only. The index of the first record
+ * is sent along as `"from"`, so the client knows whether to replace its log or add to it.
+ *
+ * The JSON is not built in memory first: a `LogJsonWriter` fills one frame at a
+ * time as the connection can take it, and the frames go out as one fragmented
+ * message. However long the log is, it only takes a frame buffer and the writer.
+ * If the client agreed to permessage-deflate and the log is long enough, the frames
+ * are compressed as they are filled.
  *
  * @param client Pointer to the WebSocket client instance.
+ * @param from Index of the first record to send, 0 for the whole log.
  *
  * @details
  * The function performs the following steps:
- * - Opens the dataLog.json file from the SD card for reading.
- * - Parses the JSON content into a JSON object.
- * - Serializes the JSON object into a string.
- * - Sends the string containing the JSON data to the WebSocket client.
- *
- * @note This function assumes the presence of the SD card with the dataLog.json file,
- * the JSON content in the correct format, and the WebSocket client instance.
+ * - Creates a `LogJsonWriter` for the records from `from` up to the current end of the log.
+ *   It takes whole chunks of records from `logJsonCache`, so clients that connect at the
+ *   same time share the JSON instead of each formatting it again.
+ * - Queues a stream message for the WebSocket client that is filled by the writer.
+ * - Adds the client to the `broadcaster`, from the first record after the ones streamed, so
+ *   the pulses that come in while the log is sent follow it and none are missed.
+ *
+ * @note This function assumes the presence of the SD card with the data log
+ * and the WebSocket client instance.
  * Ensure these conditions are met and properly defined in your code.
  *
  * @return void
  */
-void sendLogToClient(AsyncWebSocketClient *client) {
-  File dataLogFile = SD.open("/dataLog.json", "r");
-  if (!dataLogFile) {
-    Serial.println("Failed to open dataLog file");
-    return;
-  }
-
-  // Create JSON object
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, dataLogFile);
-  dataLogFile.close();
-
-  if (error) {
-    Serial.println("Failed to read datalog file, using default configuration");
+void sendLogToClient(AsyncWebSocketClient *client, uint32_t from) {
+  if (!sdAvailable) {
+    Serial.println("SD card not available");
+    broadcaster.addClient(client->id(), logSequence);
     return;
   }
 
-  // Serialize JSON object to string
-  String output;
-  serializeJson(doc, output);
-
-  // Send JSON object to the connected client
-  client->text(output);
+  // Stream the JSON to the client that asked for it, a frame at a time
+  uint32_t end = dataLogStore.count();
+  std::shared_ptr<LogJsonWriter> writer = std::make_shared<LogJsonWriter>(&dataLogStore, from, true);
+  writer->limit(end);
+  writer->setCache(&logJsonCache);
+  client->stream([writer](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+    return writer->fill(buffer, maxLen);
+  }, WS_TEXT, (end > from) ? (end - from) * wsLogRecordJsonSize : 0);
+  broadcaster.addClient(client->id(), end);
 }
 
 
 /**
- * @brief Adds HTTP routes to the AsyncWebServer instance.
+ * @brief Finds where in the data log a reconnecting client should be sent records from.
  *
- * This function configures various HTTP routes for serving HTML, CSS, JavaScript, and
- * JSON files, as well as handling specific HTTP POST requests. It serves static files
- * stored in the LittleFS filesystem and provides endpoints for downloading the dataLog.json
- * file and entering configuration mode.
+ * The client sends the sequence number and time of the last record it has. If
+ * that record is still in the log with the same time, only the records after it
+ * are missing. A client that only knows the time gets the records from the next
+ * second on.
  *
- * @details
- * The function performs the following steps:
- * - Sets up an HTTP GET route to serve the index.html file.
- * - Serves static files (index.html, style.css, and script.js) stored in the LittleFS filesystem.
- * - Configures an HTTP GET route to download the dataLog.json file from the SD card.
- * - Defines an HTTP POST route to enter configuration mode, suspends tasks, disconnects from WiFi,
- *   and creates an access point.
- * - Begins serving the HTTP routes.
+ * @param doc The "resume" request, with `sequence` and/or `time`.
  *
- * @note This function assumes the presence of the `server`, `LittleFS`, and `SD` objects,
- * as well as necessary files in the LittleFS filesystem and the dataLog.json file on the SD card.
- * Ensure these conditions are met and properly defined in your code.
+ * @details
+ * The function returns:
+ * - The index after `sequence` if that record is in the log and its time matches `time`.
+ * - The first record after `time` if only the time was sent.
+ * - 0 if the log was reset or replaced since, so the client gets the whole log.
  *
- * @return void
+ * @return The index of the first record to send.
  */
-void addRoutes() {
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send(LittleFS, "/index.html", "text/html");
-  });
-
-  server.serveStatic("/", LittleFS, "/");
-
-  server.on("/style.css", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send(LittleFS, "/style.css", "text/css");
-  });
-
-  server.on("/script.js", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send(LittleFS, "/script.js", "text/javascript");
-  });
-
-  server.on("/download", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send(SD, "/dataLog.json", "application/json");
-  });
-
-  server.on("/configMode", HTTP_POST, [](AsyncWebServerRequest *request){
-    request->send(200, "text/plain", "Entering configuration mode");
-    vTaskDelay(1000);
-    // stop all tasks
-    vTaskSuspend(websocketCleanupHandle);
-    vTaskSuspend(handleDataHandle);
-    vTaskSuspend(simulateImpulseHandle);
-
-    // set config file to empty data
-    File configFile = LittleFS.open("/config.json", "w");
-    if(!configFile){
-      Serial.println("Failed to open config file for writing");
-      return;
+uint32_t resumeIndex(JsonDocument &doc){
+  if(!doc["sequence"].isNull()){
+    long sequence = doc["sequence"].as<long>();
+    LogRecord record;
+    if(sequence < 0 || dataLogStore.readCached(sequence, &record, 1) != 1){
+      return 0;
     }
-    // create json object
-    JsonDocument doc;
-    doc["ssid"] = "";
-    doc["password"] = "";
-    doc["ip"] = "";
-    doc["gateway"] = "";
-
-    // serialize json object to file
-    if(serializeJson(doc, configFile) == 0){
-      Serial.println("Failed to write to file");
+    if(!doc["time"].isNull() && record.time != doc["time"].as<uint32_t>()){
+      return 0;
     }
-
-    configFile.close();
-    
-    // restart esp
-    ESP.restart();
-  });
-
-  server.begin();
+    return sequence + 1;
+  }
+  if(!doc["time"].isNull()){
+    return dataLogStore.seekTime(doc["time"].as<uint32_t>() + 1);
+  }
+  return 0;
 }
 
 
 /**
- * @brief Handles WebSocket events and processes incoming data.
+ * @brief Makes the ETag of the first `count` records of the data log.
  *
- * This function parses incoming WebSocket data into a JSON object and 
- * checks for specific requests from the client. It processes requests 
- * such as requesting the entire log, requesting a single log entry, 
- * and requesting to delete the data log file.
- *
- * @param arg Pointer to additional arguments for the event (not used).
- * @param data Pointer to the incoming data.
- * @param len Length of the incoming data.
+ * @param count The number of records the response is going to have.
  *
  * @details
- * The function performs the following steps:
- * - Parses the incoming WebSocket data into a JSON object.
- * - Checks for specific requests from the client:
- *   - "wholeLog": Requests the entire log. Calls `notifyClientWholeLog` function.
- *   - "singleLog": Requests a single log entry. Calls `notifyClientSingleLog` function.
- *   - "deleteDataLogFile": Requests to delete the data log file. Calls `deleteDataLogFile` function.
+ * Records are only ever appended, so the number of records and the time of the last
+ * one tell one version of the log from another. The time catches a log that was reset
+ * and has grown back to the same length.
  *
- * @note This function assumes the presence of the `JsonDocument`, `notifyClientWholeLog`, 
- * `notifyClientSingleLog`, and `deleteDataLogFile` functions. Ensure these functions are 
- * properly defined and included in your code.
+ * @note This function must be called with `SDMutex` taken.
  *
- * @return void
+ * @return The ETag, quoted, e.g. `"4d2-65a1b2c3"`.
  */
-void handleWebSocketEvent(void *arg, uint8_t *data, size_t len){
+String downloadETag(uint32_t count){
+  LogRecord record;
+  uint32_t lastTime = 0;
+  if(count > 0 && dataLogStore.readCached(count - 1, &record, 1) == 1){
+    lastTime = record.time;
+  }
+  char etag[24];
+  snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)count, (unsigned long)lastTime);
+  return String(etag);
+}
 
-  // create json object
-  JsonDocument doc;
-  deserializeJson(doc, data, len);
 
-  // check if the client wants the whole log
-  if(doc["request"] == "wholeLog"){
-    notifyClientWholeLog();
+/**
+ * @brief Reads the range of records a `/download` request asked for.
+ *
+ * @param request The request, with its `Range` and `If-Range` headers.
+ * @param count The number of records in the log.
+ * @param etag The ETag of the log, from `downloadETag`.
+ * @param from Set to the first record to send.
+ * @param end Set to the record after the last one to send.
+ *
+ * @details
+ * Ranges are counted in records, not bytes, since the JSON is written while it is sent
+ * and its length isn't known up front:
+ * - `records=100-199` asks for records 100 to 199.
+ * - `records=100-` asks for everything from record 100, the tail since the last pull.
+ * - `records=-50` asks for the last 50 records.
+ * Byte ranges, several ranges and an `If-Range` that doesn't match the ETag get the
+ * whole log, which RFC 9110 allows. So does a range that doesn't parse, like
+ * `records=abc-` or `records=5-x`, since RFC 9110 says to ignore it.
+ *
+ * @return 206 for a range, 416 if it starts past the last record, 200 for the whole log.
+ */
+int downloadRange(AsyncWebServerRequest *request, uint32_t count, const String &etag, uint32_t &from, uint32_t &end){
+  from = 0;
+  end = count;
+  if(!request->hasHeader("Range")){
+    return 200;
   }
-
-  // check if the client wants a single log
-  if(doc["request"] == "singleLog"){
-    dataLog log;
-    log.accumulatedValue = doc["accumulatedValue"];
-    log.time = doc["time"];
-    notifyClientSingleLog(log);
+  if(request->hasHeader("If-Range") && request->header("If-Range") != etag){
+    return 200;
   }
-
-  String request = doc["request"];
-  if (request == "deleteDataLogFile") {
-    // Call the function to delete the data log file
-    deleteDataLogFile();
+  String range = request->header("Range");
+  range.trim();
+  if(!range.startsWith("records=") || range.indexOf(',') >= 0){
+    return 200;
   }
-
+  range = range.substring(8);
+  int dash = range.indexOf('-');
+  if(dash < 0){
+    return 200;
+  }
+  String first = range.substring(0, dash);
+  String last = range.substring(dash + 1);
+  first.trim();
+  last.trim();
+  if(first.length() == 0){
+    // a suffix, the last n records
+    uint32_t n;
+    if(!parseRangeIndex(last, n)){
+      return 200;
+    }
+    if(n == 0 || count == 0){
+      return 416;
+    }
+    from = n < count ? count - n : 0;
+    return 206;
+  }
+  uint32_t start;
+  if(!parseRangeIndex(first, start)){
+    return 200;
+  }
+  if(last.length() > 0){
+    uint32_t to;
+    if(!parseRangeIndex(last, to) || to < start){
+      return 200;
+    }
+    if(to < end){
+      end = to + 1;
+    }
+  }
+  from = start;
+  if(from >= count){
+    from = 0;
+    end = count;
+    return 416;
+  }
+  return 206;
 }
 
 
 /**
- * @brief Sends the entire data log stored in the dataLog.json file to all connected WebSocket clients.
- *
- * This function reads the dataLog.json file from the SD card, parses its content into a JSON object,
- * serializes the JSON object into a string, and sends it to all connected WebSocket clients.
+ * @brief Reads a record index from a `Range` header.
  *
- * @details
- * The function performs the following steps:
- * - Opens the dataLog.json file from the SD card for reading.
- * - Parses the JSON content into a JSON object.
- * - Serializes the JSON object into a string.
- * - Sends the string containing the JSON data to all connected WebSocket clients using the WebSocket server.
+ * `strtoul` alone would read `abc` as 0 and `5x` as 5, so the whole text has to be
+ * digits and fit in 32 bits.
  *
- * @note This function assumes the presence of the SD card with the dataLog.json file,
- * the JSON content in the correct format, and the WebSocket server instance.
- * Ensure these conditions are met and properly defined in your code.
+ * @param text The index, trimmed.
+ * @param value Set to the index.
  *
- * @return void
+ * @return `false` if `text` isn't a number.
  */
-void notifyClientWholeLog(){
-  File dataLogFile = SD.open("/dataLog.json", "r");
-  if (!dataLogFile) {
-    Serial.println("Failed to open dataLog file");
-    return;
+bool parseRangeIndex(const String &text, uint32_t &value){
+  if(text.length() == 0 || !isdigit((unsigned char)text[0])){
+    return false;
   }
+  char *end;
+  unsigned long long parsed = strtoull(text.c_str(), &end, 10);
+  if(*end != 0 || parsed > UINT32_MAX){
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+
+/**
+ * @brief Called when a client connects to `/events`.
+ *
+ * The ids of the `pulses` events are sequence numbers, so a browser that
+ * reconnects sends the last one it got as `Last-Event-ID`. The records after it
+ * are replayed from the data log by `broadcastLog`, since reading the card here
+ * would hold up every other connection.
+ *
+ * @param client Pointer to the event source client instance.
+ *
+ * @return void
+ */
+void onEventSourceConnect(AsyncEventSourceClient *client){
+  Serial.printf("Event source client connected, last event %u\n", client->lastId());
+  if(client->lastId() && sdAvailable && eventReplayQueue){
+    eventReplay replay = {client->id(), client->lastId() + 1};
+    if(xQueueSend(eventReplayQueue, &replay, 0) != pdTRUE){
+      Serial.println("Too many event source clients reconnecting, not replaying the log");
+    }
+  }
+}
 
-  // Create JSON object
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, dataLogFile);
-  dataLogFile.close();
 
-  if (error) {
-    Serial.println("Failed to read datalog file, using default configuration");
+/**
+ * @brief Sends the records from `from` on to an event source client, as `log` events.
+ *
+ * Each event holds up to `sseReplayChunk` records as `{"from":120,"log":[...]}`,
+ * with the sequence number of its last record as the id. A client that was gone
+ * for more than `sseReplayMax` records only gets the last ones, and can tell from
+ * `from` that it missed some.
+ *
+ * @param client Id of the event source client.
+ * @param from Index of the first record to send.
+ *
+ * @details
+ * - Each event is read with `SDMutex` taken, which is given back before it is sent.
+ * - The client is looked up by its id for every event, so one that disconnected
+ *   meanwhile just ends the replay.
+ * - Pulses sent since the client connected are in the log already, so they are
+ *   replayed too and the client ends up with every record.
+ *
+ * @note This function is only called by `broadcastLog`, which owns the event buffer.
+ *
+ * @return void
+ */
+void replayEvents(uint32_t client, uint32_t from){
+  // a record takes at most 64 bytes of JSON
+  static char buffer[sseReplayChunk * 64 + 64];
+  if(xSemaphoreTake(SDMutex, portMAX_DELAY) != pdTRUE){
+    return;
+  }
+  uint32_t end = sdAvailable ? dataLogStore.count() : 0;
+  xSemaphoreGive(SDMutex);
+  if(from >= end){
     return;
   }
+  if(end - from > sseReplayMax){
+    from = end - sseReplayMax;
+  }
 
-  // Serialize JSON object to string
-  String output;
-  serializeJson(doc, output);
+  for(uint32_t start = from; start < end; start += sseReplayChunk){
+    if(xSemaphoreTake(SDMutex, portMAX_DELAY) != pdTRUE){
+      return;
+    }
+    if(!sdAvailable){
+      xSemaphoreGive(SDMutex);
+      return;
+    }
+    uint32_t stop = (end - start > sseReplayChunk) ? start + sseReplayChunk : end;
+    LogJsonWriter writer(&dataLogStore, start, true);
+    writer.limit(stop);
+    size_t len = 0;
+    size_t filled;
+    while((filled = writer.fill((uint8_t*)buffer + len, sizeof(buffer) - 1 - len)) > 0){
+      len += filled;
+    }
+    buffer[len] = 0;
+    xSemaphoreGive(SDMutex);
+    if(!events.send(client, buffer, "log", stop - 1)){
+      return;
+    }
+  }
+}
+
+
+/**
+ * @brief Adds HTTP routes to the AsyncWebServer instance.
+ *
+ * This function configures various HTTP routes for serving HTML, CSS, JavaScript, and
+ * JSON files, as well as handling specific HTTP POST requests. It serves static files
+ * stored in the LittleFS filesystem and provides endpoints for downloading the data log
+ * as JSON and entering configuration mode.
+ *
+ * @details
+ * The function performs the following steps:
+ * - Configures an HTTP GET route to download the data log from the SD card as JSON.
+ *   It has an ETag made from the number of records and the time of the last one, and
+ *   answers a matching `If-None-Match` with a 304. `Range: records=N-` gets a 206 with the
+ *   records from N on, so a collector can fetch just the tail since its last pull.
+ * - Configures an HTTP GET route reporting the progress and findings of the `scanLog` task,
+ *   and an HTTP POST route to restart the scan or repair the log ("rescan", "truncate" or "rebuild").
+ * - Defines an HTTP POST route to enter configuration mode, suspends tasks, disconnects from WiFi,
+ *   and creates an access point. `SDMutex` is taken before the tasks are suspended, and
+ *   `flushLog` writes the buffered records and stops itself before the restart.
+ * - Serves the web UI from LittleFS, with index.html for "/". The files are gzipped by
+ *   scripts/build_web.py, and the hashed ones in /assets/ are cached by the browser for good.
+ *   Pages have to be checked each time, but come back as a 304 with their ETag if unchanged.
+ *   Built with `WEB_ASSETS_PROGMEM`, the same files are served from a table compiled into
+ *   flash instead, found by a binary search without opening any file.
+ * - Begins serving the HTTP routes from a route table, so a request finds its route
+ *   by walking its path once, and the web UI handlers are only asked about the paths
+ *   no route takes.
+ * - Keeps connections open for `httpKeepAliveTimeout` seconds between requests, so loading
+ *   the page and polling don't set up a new TCP connection for each request.
+ *
+ * @note This function assumes the presence of the `server`, `LittleFS`, and `SD` objects,
+ * as well as necessary files in the LittleFS filesystem and the data log on the SD card.
+ * Ensure these conditions are met and properly defined in your code.
+ *
+ * @return void
+ */
+void addRoutes() {
+  server.on("/download", HTTP_GET, [](AsyncWebServerRequest *request){
+    // the count, the ETag and the range are all taken from the log at the same moment
+    if(xSemaphoreTake(SDMutex, pdMS_TO_TICKS(webSDWait)) != pdTRUE){
+      AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "SD card busy");
+      response->addHeader("Retry-After", "1");
+      request->send(response);
+      return;
+    }
+    if(!sdAvailable){
+      xSemaphoreGive(SDMutex);
+      request->send(503, "text/plain", "SD card not available");
+      return;
+    }
+    // the records there are now, so the body matches its ETag while the log grows
+    uint32_t count = dataLogStore.count();
+    String etag = downloadETag(count);
+    uint32_t from;
+    uint32_t end;
+    int code = downloadRange(request, count, etag, from, end);
+    xSemaphoreGive(SDMutex);
+    if(request->hasHeader("If-None-Match") && request->header("If-None-Match").indexOf(etag) >= 0){
+      AsyncWebServerResponse *response = request->beginResponse(304);
+      response->addHeader("ETag", etag);
+      request->send(response);
+      return;
+    }
+    if(code == 416){
+      AsyncWebServerResponse *response = request->beginResponse(416);
+      response->addHeader("Content-Range", "records */" + String(count));
+      request->send(response);
+      return;
+    }
+    // the log is stored as records, so the JSON is written a piece at a time while it is sent.
+    // a range starts with "from", so the client knows which records it got.
+    // each piece is read with SDMutex taken, and tried again later if it is busy
+    std::shared_ptr<LogJsonWriter> writer = std::make_shared<LogJsonWriter>(&dataLogStore, from, code == 206);
+    writer->setCache(&logJsonCache);
+    writer->limit(end);
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+      [writer](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        if(xSemaphoreTake(SDMutex, pdMS_TO_TICKS(webSDWait)) != pdTRUE){
+          return RESPONSE_TRY_AGAIN;
+        }
+        size_t len = writer->fill(buffer, maxLen);
+        xSemaphoreGive(SDMutex);
+        return len;
+      });
+    response->setCode(code);
+    response->addHeader("ETag", etag);
+    response->addHeader("Accept-Ranges", "records");
+    if(code == 206){
+      response->addHeader("Content-Range", "records " + String(from) + "-" + String(end - 1) + "/" + String(count));
+    }
+    request->send(response);
+  });
+
+  server.on("/scanStatus", HTTP_GET, [](AsyncWebServerRequest *request){
+    JsonDocument doc;
+    if(scan.corruptAt >= 0){
+      doc["state"] = "corrupt";
+    }
+    else{
+      doc["state"] = scan.complete ? "complete" : "scanning";
+    }
+    doc["checked"] = scan.checked;
+    doc["records"] = scan.total;
+    doc["progress"] = scan.total > 0 ? (int)(100ULL * scan.checked / scan.total) : 100;
+    doc["counterGaps"] = scan.counterGaps;
+    doc["firstGap"] = scan.firstGap;
+    doc["timeErrors"] = scan.timeErrors;
+    doc["corruptAt"] = scan.corruptAt;
+
+    String output;
+    serializeJson(doc, output);
+    request->send(200, "application/json", output);
+  });
+
+  server.on("/logStats", HTTP_GET, [](AsyncWebServerRequest *request){
+    LogStoreStats store = dataLogStore.stats();
+    LogWriterStats writer = dataLogStore.writerStats();
+    JsonDocument doc;
+    doc["records"] = store.records;
+    doc["flushed"] = dataLogStore.flushedCount();
+    doc["errors"] = store.errors;
+    doc["flushes"] = writer.flushes;
+    doc["bytesAppended"] = writer.bytesAppended;
+    doc["bytesWritten"] = writer.bytesWritten;
+    doc["bytesPreallocated"] = writer.bytesPreallocated;
+    // bytes written to the card per byte of records, 1 when only whole blocks are written
+    doc["writeAmplification"] = writer.bytesAppended > 0 ? (float)writer.bytesWritten / writer.bytesAppended : 0;
+    doc["lastFlushMicros"] = writer.lastFlushMicros;
+    doc["maxFlushMicros"] = writer.maxFlushMicros;
+    doc["averageFlushMicros"] = writer.flushes > 0 ? writer.totalFlushMicros / writer.flushes : 0;
+    doc["stalls"] = writer.stalls;
+    LogCacheStats cache = logCache.stats();
+    doc["cacheHits"] = cache.hits;
+    doc["cacheMisses"] = cache.misses;
+    doc["cacheReadAheads"] = cache.readAheads;
+    doc["cacheEvictions"] = cache.evictions;
+    LogJsonCacheStats jsonCache = logJsonCache.stats();
+    doc["jsonCacheHits"] = jsonCache.hits;
+    doc["jsonCacheBuilds"] = jsonCache.builds;
+    doc["jsonCacheEvictions"] = jsonCache.evictions;
+
+    String output;
+    serializeJson(doc, output);
+    request->send(200, "application/json", output);
+  });
+
+  server.on("/scanRepair", HTTP_POST, [](AsyncWebServerRequest *request){
+    if(!request->hasParam("action")){
+      request->send(400, "text/plain", "Missing action");
+      return;
+    }
+    String action = request->getParam("action")->value();
+    if(action == "rescan"){
+      scanRequest = SCAN_RESTART;
+    }
+    else if(action == "truncate"){
+      scanRequest = SCAN_TRUNCATE;
+    }
+    else if(action == "rebuild"){
+      scanRequest = SCAN_REBUILD;
+    }
+    else{
+      request->send(400, "text/plain", "Unknown action");
+      return;
+    }
+    // the repair itself runs in the scanLog task
+    xTaskNotifyGive(scanLogHandle);
+    request->send(202, "text/plain", "Repair started");
+  });
+
+  server.on("/configMode", HTTP_POST, [](AsyncWebServerRequest *request){
+    // stopping the tasks waits for the card, so it is done by a task of its own
+    if(!configModeHandle){
+      xTaskCreate(enterConfigMode, "configMode", 4096, NULL, 1, &configModeHandle);
+    }
+    request->send(200, "text/plain", "Entering configuration mode");
+  });
+
+  // the web UI, last so the routes above don't each look for a file first.
+  // assets have a hash of their content in the name, so they never have to be asked for again
+#ifdef WEB_ASSETS_PROGMEM
+  server.serveProgmem(webAssets, webAssetCount);
+#else
+  server.serveStatic("/assets/", LittleFS, "/assets/").setCacheControl(assetCacheControl);
+  server.serveStatic("/", LittleFS, "/").setDefaultFile("index.html").setCacheControl(pageCacheControl);
+#endif
+
+  // the routes above are looked up by their path from here on, not asked one by one
+  server.enableRouteTable();
+  server.keepAlive(httpKeepAliveTimeout, httpKeepAliveRequests);
+  server.begin();
+}
+
+
+/**
+ * @brief Handles WebSocket events and processes incoming data.
+ *
+ * This function parses incoming WebSocket data into a JSON object and 
+ * checks for specific requests from the client. It processes requests 
+ * such as resuming the log, requesting the entire log, requesting a single
+ * log entry, and requesting to delete the data log file.
+ *
+ * @param client Pointer to the WebSocket client that sent the data.
+ * @param arg Pointer to additional arguments for the event (not used).
+ * @param data Pointer to the incoming data.
+ * @param len Length of the incoming data.
+ *
+ * @details
+ * The function performs the following steps:
+ * - Parses the incoming WebSocket data into a JSON object.
+ * - Checks for specific requests from the client:
+ *   - "resume": Requests the records after the last one the client has. Finds them with
+ *     `resumeIndex` and sends them to this client only with `sendLogToClient`.
+ *   - "wholeLog": Requests the entire log. Sends it to this client only with `sendLogToClient`.
+ *   - "subscribe": Sets the topics the client gets from the `broadcaster`, from the names in `topics`:
+ *     "pulses", "seconds", "minutes", "power" and "health".
+ *   - "singleLog": Requests a single log entry. Calls `notifyClientSingleLog` function.
+ *   - "deleteDataLogFile": Requests to reset the data log. Calls `deleteDataLogFile` function,
+ *     which only queues the reset so the handler returns right away.
+ *
+ * @note This function assumes the presence of the `JsonDocument`, `sendLogToClient`, 
+ * `notifyClientSingleLog`, and `deleteDataLogFile` functions. Ensure these functions are 
+ * properly defined and included in your code.
+ *
+ * @return void
+ */
+void handleWebSocketEvent(AsyncWebSocketClient *client, void *arg, uint8_t *data, size_t len){
+
+  // create json object
+  JsonDocument doc;
+  deserializeJson(doc, data, len);
+
+  // check if the client wants the records it missed
+  if(doc["request"] == "resume"){
+    uint32_t from = resumeIndex(doc);
+    Serial.printf("WebSocket client #%u resumes from record %lu\n", client->id(), (unsigned long)from);
+    sendLogToClient(client, from);
+  }
+
+  // check if the client wants the whole log
+  if(doc["request"] == "wholeLog"){
+    sendLogToClient(client, 0);
+  }
+
+  // check if the client wants other topics than the raw pulses
+  if(doc["request"] == "subscribe"){
+    uint8_t topics = 0;
+    for(JsonVariant topic : doc["topics"].as<JsonArray>()){
+      topics |= WsBroadcaster::topic(topic.as<const char*>());
+    }
+    broadcaster.subscribe(client->id(), topics);
+  }
+
+  // check if the client wants a single log
+  if(doc["request"] == "singleLog"){
+    dataLog log;
+    log.accumulatedValue = doc["accumulatedValue"];
+    log.time = doc["time"];
+    notifyClientSingleLog(log);
+  }
+
+  String request = doc["request"];
+  if (request == "deleteDataLogFile") {
+    // Call the function to delete the data log file
+    deleteDataLogFile();
+  }
+
+}
+
+
+/**
+ * @brief Sends the entire data log to all connected WebSocket clients.
+ *
+ * This function writes the data log as JSON using `logToJson()` and sends it to all
+ * connected WebSocket clients. It is only used right after the log was reset, when
+ * the log is empty; clients that connect ask for the log themselves.
+ *
+ * @details
+ * The function performs the following steps:
+ * - Writes the data log as a JSON string.
+ * - Sends the string containing the JSON data to all connected WebSocket clients using the WebSocket server,
+ *   as a `WS_MSG_COMMAND` message so it isn't dropped for a client that can't keep up.
+ *
+ * @note This function assumes the presence of the SD card with the data log
+ * and the WebSocket server instance.
+ * Ensure these conditions are met and properly defined in your code.
+ *
+ * @return void
+ */
+void notifyClientWholeLog(){
+  if (!sdAvailable) {
+    Serial.println("SD card not available");
+    return;
+  }
 
   // Send JSON object to all connected clients
-  ws.textAll(output);
+  String output = logToJson();
+  AsyncWebSocketMessageBuffer *buffer = ws.reserveBuffer(output.length());
+  if(!buffer || !buffer->get()){
+    return;
+  }
+  memcpy(buffer->get(), output.c_str(), output.length());
+  ws.textAll(buffer, [](AsyncWebSocketClient *client){ return true; }, WS_MSG_COMMAND);
+}
+
+
+/**
+ * @brief Writes the whole data log as JSON.
+ *
+ * The records are formatted by a `LogJsonWriter` into the
+ * `{"from":0,"log":[{"accumulatedValue":1,"time":1700000000},...]}` format the web page reads.
+ *
+ * @return The data log as a JSON string.
+ */
+String logToJson(){
+  String output;
+  output.reserve(dataLogStore.count() * 44 + 32);
+
+  LogJsonWriter writer(&dataLogStore, 0, true);
+  char buffer[129];
+  size_t len;
+  while((len = writer.fill((uint8_t*)buffer, sizeof(buffer) - 1)) > 0){
+    buffer[len] = '\0';
+    output += buffer;
+  }
+  return output;
 }
 
 
 /**
- * @brief Sends a single data log entry to all connected WebSocket clients.
+ * @brief Sends a single data log entry to the connected WebSocket clients that use JSON.
  *
  * This function creates a JSON object containing a single data log entry with 
- * accumulated value and time, serializes the JSON object into a string, and 
- * sends it to all connected WebSocket clients.
+ * accumulated value and time, serializes the JSON object into a shared message buffer,
+ * and queues that buffer to every client that didn't agree on the binary subprotocol.
  *
  * @param log The data log entry to be sent to clients.
  *
  * @details
  * The function performs the following steps:
  * - Creates a JSON object containing the accumulated value and time from the given log.
- * - Serializes the JSON object into a string.
- * - Sends the string containing the JSON data to all connected WebSocket clients using the WebSocket server.
+ * - Reserves a buffer of the measured size and serializes the JSON object into it.
+ * - Queues the buffer to the JSON clients using the WebSocket server, without copying it. It is
+ *   a `WS_MSG_LATEST` message, so it replaces a value still waiting for a slow client.
  *
  * @note This function assumes the presence of the `dataLog` structure and the WebSocket server instance.
  * Ensure these conditions are met and properly defined in your code.
@@ -880,146 +1753,141 @@ void notifyClientSingleLog(dataLog log){
   doc["accumulatedValue"] = log.accumulatedValue;
   doc["time"] = log.time;
 
-  String output;
-  serializeJson(doc, output);
+  // serialize once, straight into the buffer all clients share
+  size_t len = measureJson(doc);
+  AsyncWebSocketMessageBuffer *buffer = ws.reserveBuffer(len);
+  if(!buffer || !buffer->get()){
+    return;
+  }
+  serializeJson(doc, (char*)buffer->get(), len + 1);
+  ws.textAll(buffer, [](AsyncWebSocketClient *client){ return !isBinaryClient(client); }, WS_MSG_LATEST);
+}
 
-  ws.textAll(output);
 
-  
+bool isBinaryClient(AsyncWebSocketClient *client){
+  return client->protocol() == wsBinaryProtocol;
 }
 
 
 /**
- * @brief Creates a new data log file on the SD card with an empty JSON array.
+ * @brief Starts a new, empty data log on the SD card.
  *
- * This function creates a new data log file named "dataLog.json" on the SD card
- * and initializes it with an empty JSON array structure.
- *
- * @details
- * The function performs the following steps:
- * - Opens the "dataLog.json" file on the SD card for writing.
- * - Creates a JSON document and initializes an empty JSON array for the log data.
- * - Serializes the JSON array into the file.
- * - Closes the file after writing.
+ * This function moves the data log to `trashDir` and starts an empty one, then
+ * starts the scan of the log over. Moving the log only renames it, so it takes
+ * the same short time for any size of log; the `reclaimLog` task removes it
+ * afterwards. If the log can't be moved, it is emptied in place.
  *
  * @note This function assumes the presence of the SD card and proper initialization.
  * Ensure that the SD card is properly initialized and accessible before calling this function.
  *
- * @return void
+ * @return
+ * - `true` if the log was emptied.
+ * - `false` otherwise.
  */
-void createDataLog(){
-  File dataLog = SD.open("/dataLog.json", FILE_WRITE);
-  if(!dataLog){
-    Serial.println("Failed to open dataLog file");
-    return;
+bool createDataLog(){
+  char trashPath[40];
+  SD.mkdir(trashDir);
+  for(uint32_t i = 0; ; i++){
+    snprintf(trashPath, sizeof(trashPath), "%s/%lu-%lu.bin", trashDir, (unsigned long)storedEpoch, (unsigned long)i);
+    if(!SD.exists(trashPath)){
+      break;
+    }
   }
 
-  // Create a JSON array
-  JsonDocument doc;
-  JsonArray logArray = doc["log"].to<JsonArray>();
-
-  // Serialize JSON array to file
-  if(serializeJson(doc, dataLog) == 0){
-    Serial.println("Failed to write to file");
+  if(!dataLogStore.rotate(trashPath) && !dataLogStore.truncate(0)){
+    Serial.println("Failed to empty dataLog file");
+    return false;
   }
 
-  dataLog.close();
+  commitOffset = 0;
+  resetScan();
+  return true;
 }
 
 
 /**
  * @brief Adds a new data log entry to the existing data log file on the SD card.
  *
- * This function adds a new data log entry to the existing "dataLog.json" file
- * on the SD card. It first reads the JSON file, deserializes it into a JSON object,
- * adds the new log entry to the JSON array, and re-serializes the JSON object back
- * to the file.
+ * This function adds a new data log entry to the data log on the SD card
+ * using `appendDataLogs`. If the SD card is missing, or older
+ * records are still waiting in the fallback buffer, the entry is put in the
+ * buffer instead so the order of the log is kept.
  *
  * @param log The data log entry to be added to the log file.
  *
  * @details
  * The function performs the following steps:
- * - Opens the "dataLog.json" file on the SD card for reading.
- * - Deserializes the JSON content into a JSON object.
- * - Gets the JSON array containing log entries from the JSON object.
- * - Adds a new log entry to the JSON array.
- * - Re-serializes the JSON object and writes it back to the file.
+ * - Writes the entry directly to the SD card if it is available and the buffer is empty.
+ * - Puts the entry in the fallback buffer if the SD card is missing or failed during the write.
  *
- * @note This function assumes the presence of the SD card and the "dataLog.json" file.
- * Ensure that the file exists and has the correct format before calling this function.
+ * @note This function must be called with `SDMutex` taken.
  *
  * @param log The data log entry to be added to the log file.
  * @return void
  */
 void addDataLog(dataLog log){
-  
-  // First read the JSON file and deserialize it
-  File dataLogFile = SD.open("/dataLog.json", "r");
-  if(!dataLogFile){
-    Serial.println("Failed to open dataLog file");
-    return;
-  }
-
-  // Create JSON object
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, dataLogFile);
-  dataLogFile.close();
-
-  if(error){
-    Serial.println("Failed to read datalog file, using default configuration");
-    return;
-  }
-
-  // Get the array from the document
-  JsonArray logArray = doc["log"];
-
-  // Create a new entry
-  JsonObject newLogEntry = logArray.add<JsonObject>();
-  newLogEntry["accumulatedValue"] = log.accumulatedValue;
-  newLogEntry["time"] = log.time;
-
-  // Re-serialize JSON object to file
-  dataLogFile = SD.open("/dataLog.json", "w");
-  if(!dataLogFile){
-    Serial.println("Failed to open dataLog file for writing");
-    return;
-  }
-
-  if(serializeJson(doc, dataLogFile) == 0){
-    Serial.println("Failed to write to file");
+  // keep the order, while older records wait in the buffer new ones go behind them
+  if(sdAvailable && bufferedCount() == 0){
+    if(appendDataLogs(&log, 1)){
+      logSequence++;
+      return;
+    }
   }
 
-  dataLogFile.close();
+  bufferDataLog(log);
+  logSequence++;
 }
 
 
 /**
- * @brief Cleans up WebSocket clients periodically.
+ * @brief Appends one or more data log entries to the data log on the SD card.
  *
- * This task periodically cleans up WebSocket clients by removing any disconnected clients
- * from the WebSocket server's client list. It is intended to be run as a separate FreeRTOS
- * task to ensure that WebSocket clients are properly managed.
+ * The entries are written as `LogRecord`s with a single `appendBatch` call, which
+ * keeps the number of writes down when the fallback buffer is moved to the SD card.
  *
- * @param pvParameters A pointer to task parameters (not used).
+ * @param logs The data log entries to be added to the log file.
+ * @param count The number of entries in `logs`, at most `migrateBatchSize`.
  *
  * @details
  * The function performs the following steps:
- * - Enters an infinite loop to continuously clean up WebSocket clients.
- * - Calls the `cleanupClients` function of the WebSocket server to remove disconnected clients.
- * - Delays the task execution for a specified interval (15 seconds in this case) using vTaskDelay.
+ * - Continues the counter from the last record if it couldn't be read at boot.
+ * - Converts the entries to records and appends them to the data log.
+ * - Updates the commit offset.
  *
- * @note This function assumes the presence of the WebSocket server instance (`ws`) and FreeRTOS.
- * Ensure that the WebSocket server is properly initialized and FreeRTOS is configured before
- * calling this function.
+ * If the records can't be written the SD card is marked as missing, so the
+ * `sdRemount` task will try to mount it again.
  *
- * @param pvParameters A pointer to task parameters (not used).
- * @return void
+ * @return
+ * - `true` if the entries were written.
+ * - `false` otherwise.
  */
-void websocketCleanup( void * pvParameters ){
-  while(1){
-    ws.cleanupClients();
-    vTaskDelay(15000);
+bool appendDataLogs(dataLog *logs, int count){
+  // the sd card was missing at boot, so continue from the last value on the card
+  if(!counterRestored){
+    LogRecord lastRecord;
+    if(dataLogStore.last(lastRecord)){
+      counterOffset = lastRecord.accumulatedValue;
+    }
+    logSequence += dataLogStore.count();
+    counterRestored = true;
+    Serial.print("Continuing accumulated value from: ");
+    Serial.println(counterOffset);
   }
+
+  LogRecord records[migrateBatchSize];
+  for(int i = 0; i < count; i++){
+    records[i].accumulatedValue = logs[i].accumulatedValue + counterOffset;
+    records[i].time = logs[i].time;
+  }
+
+  if(dataLogStore.appendBatch(records, count) != (size_t)count){
+    Serial.println("Failed to write to dataLog file");
+    sdAvailable = false;
+    return false;
+  }
+
+  commitOffset = dataLogStore.count() * sizeof(LogRecord);
+  return true;
 }
 
 
@@ -1035,11 +1903,15 @@ void websocketCleanup( void * pvParameters ){
  * @details
  * The function performs the following steps:
  * - Enters an infinite loop to continuously handle incoming data logs.
- * - Waits for a data log to be received from the queue using xQueueReceive.
+ * - Blocks on the queue until an entry arrives, then takes every entry already queued without
+ *   waiting, so bursts of pulses are logged as fast as they come.
+ * - If the entry is from a newer epoch, resets the log first using `resetDataLog`. Values from an
+ *   older epoch were counted before the reset and are dropped.
  * - Upon receiving a data log, adds the log to the data log file by calling the `addDataLog` function.
- * - Notifies WebSocket clients about the new log entry by calling the `notifyClientSingleLog` function.
+ * - Mirrors the new accumulated value to RTC memory and NVS using `mirrorCounter`.
+ * - Wakes the `flushLog` task if a buffer of the data log is full.
+ * - Hands the new log entry to the `broadcaster`, which sends it on to the WebSocket clients.
  * - Ensures mutual exclusion while accessing the SD card by using a semaphore.
- * - Delays the task execution for a specified interval (100 milliseconds in this case) using vTaskDelay.
  *
  * @note This function assumes the presence of the data log queue (`logQueue`), the SD card, the
  * `addDataLog` and `notifyClientSingleLog` functions, and FreeRTOS. Ensure that the queue is properly
@@ -1050,24 +1922,36 @@ void websocketCleanup( void * pvParameters ){
  */
 void handleData( void * pvParameters){
   while(1){
-    dataLog log;
-    if(xQueueReceive(logQueue, &log, portMAX_DELAY)){
-      Serial.println("Handling Queue");
+    logEntry entry;
+    // wait for the first entry, then take whatever else is queued without waiting
+    TickType_t wait = portMAX_DELAY;
+    while(xQueueReceive(logQueue, &entry, wait)){
+      wait = 0;
+      // the log was reset after this value was counted, or the reset itself
+      if((int32_t)(entry.epoch - storedEpoch) > 0){
+        resetDataLog(entry.epoch);
+      }
+      if(entry.reset || entry.epoch != storedEpoch){
+        continue;
+      }
+
+      dataLog log = entry.log;
       // take mutex if available
       // then call function addDataLog(dataLog log) to add the log to the file
       if(xSemaphoreTake(SDMutex, portMAX_DELAY) == pdTRUE){
         addDataLog(log);
+        mirrorCounter(log.accumulatedValue + counterOffset, false);
         xSemaphoreGive(SDMutex);
       }
+      // write a full buffer right away, the rest waits for logFlushInterval
+      if(dataLogStore.needsFlush()){
+        xTaskNotifyGive(flushLogHandle);
+      }
 
-      // then notify client
-      notifyClientSingleLog(log);
-      
-      
+      // then hand it to the broadcaster, which sends it to the clients
+      broadcaster.add(logSequence - 1, log.time, log.accumulatedValue + counterOffset);
     }
-      vTaskDelay(100);
   }
-
 }
 
 
@@ -1087,7 +1971,8 @@ void handleData( void * pvParameters){
  * - Generates a random number of impulses between 20 and 40.
  * - Calculates the time interval between impulses based on the total time (10 seconds)
  *   divided by the random number of impulses.
- * - Sends each impulse to the data log queue with an accumulated value and timestamp.
+ * - Sends each impulse to the data log queue with an accumulated value, timestamp and the epoch
+ *   of the log it was counted in.
  * - Delays the task execution for the calculated time interval between impulses.
  *
  * @note This function assumes the presence of the data log queue (`logQueue`), the `accumulatedValue`
@@ -1123,16 +2008,23 @@ void simulateImpulse( void * pvParameters){
         log.time = 0; // Failed to get time, use default
       }
       
+      // a reset can't slip in between counting and taking the epoch
+      logEntry entry;
+      portENTER_CRITICAL(&counterMux);
       log.accumulatedValue = ++accumulatedValue;
+      entry.epoch = logEpoch;
+      portEXIT_CRITICAL(&counterMux);
+      entry.log = log;
+      entry.reset = false;
 
       Serial.print("Accumulated value: ");
-      Serial.println(accumulatedValue);
+      Serial.println(log.accumulatedValue);
 
       Serial.print("Time: ");
       Serial.println(log.time);
 
       // Send log to queue
-      if (xQueueSend(logQueue, &log, pdMS_TO_TICKS(100)) != pdPASS) {
+      if (xQueueSend(logQueue, &entry, pdMS_TO_TICKS(100)) != pdPASS) {
         Serial.println("Failed to send to queue");
       }
       vTaskDelay(timePerImpulse);
@@ -1142,38 +2034,700 @@ void simulateImpulse( void * pvParameters){
 
 
 /**
- * @brief Deletes the data log file and recreates it.
+ * @brief Asks for the data log to be reset.
  *
- * This function deletes the "dataLog.json" file from the SD card if it exists,
- * and then recreates the file with an empty JSON array structure. It also resets
- * the accumulated value to zero.
+ * This function only starts a new epoch and queues a marker for it, so the
+ * WebSocket handler isn't held up by the SD card. The reset itself is done by
+ * `handleData` using `resetDataLog`, in order with the values in the queue.
  *
  * @details
  * The function performs the following steps:
- * - Checks if the "dataLog.json" file exists on the SD card.
- * - If the file exists, attempts to delete it using the SD library's remove function.
- * - If deletion is successful, prints a success message and recreates the file using the `createDataLog` function.
- * - If deletion fails, prints an error message.
- * - If the file does not exist, prints a message indicating that the file does not exist.
+ * - Sets the accumulated value to zero and starts a new epoch, in one critical section
+ *   so a value counted at the same time ends up in either the old or the new epoch.
+ * - Queues a reset marker for the new epoch. If the queue is full, the first value of the new
+ *   epoch starts the reset instead.
+ *
+ * @return void
+ */
+void deleteDataLogFile() {
+  logEntry entry;
+  portENTER_CRITICAL(&counterMux);
+  accumulatedValue = 0;
+  entry.epoch = ++logEpoch;
+  portEXIT_CRITICAL(&counterMux);
+  entry.reset = true;
+
+  if (xQueueSend(logQueue, &entry, 0) != pdPASS) {
+    Serial.println("Log queue full, reset waits for the next value");
+  }
+}
+
+
+/**
+ * @brief Resets the data log. Called by `handleData` when a new epoch starts.
+ *
+ * This function moves the data log aside using the `createDataLog` function and
+ * clears the fallback buffer, then tells the web clients the log is empty.
+ *
+ * @details
+ * The function performs the following steps:
+ * - Clears the fallback buffer, and only resets the counters if the SD card is missing.
+ * - Starts a new data log using the `createDataLog` function.
+ * - If that is successful, prints a success message and resets the counters.
+ * - If it fails, prints an error message.
+ * - Wakes the `reclaimLog` task to remove the old log.
  *
  * @note This function assumes the presence of the SD card and the `createDataLog` function.
  * Ensure that the SD card is properly initialized and accessible before calling this function.
  *
+ * @param epoch The epoch the log starts in.
  * @return void
  */
-void deleteDataLogFile() {
-  if (SD.exists("/dataLog.json")) {
-    if (SD.remove("/dataLog.json")) {
-      Serial.println("dataLog.json deleted successfully");
-      // then create it again
-      createDataLog();
-      accumulatedValue = 0;
+void resetDataLog(uint32_t epoch) {
+  if (xSemaphoreTake(SDMutex, portMAX_DELAY) != pdTRUE) {
+    return;
+  }
+
+  // drop anything still waiting for the sd card
+  ramBufferHead = 0;
+  ramBufferCount = 0;
+  if (flashBuffer.magic == bufferMagic) {
+    flashBuffer.head = 0;
+    flashBuffer.count = 0;
+    flashBufferReady = writeBufferHeader();
+  }
+
+  if (!sdAvailable) {
+    Serial.println("SD card not available, cleared buffer only");
+    counterOffset = 0;
+    logSequence = 0;
+  }
+  else if (createDataLog()) {
+    Serial.println("dataLog deleted successfully");
+    counterOffset = 0;
+    logSequence = 0;
+    counterRestored = true;
+  }
+  else {
+    Serial.println("Failed to delete dataLog");
+  }
+  storedEpoch = epoch;
+  broadcaster.reset();
+
+  mirrorCounter(0, true);
+  xSemaphoreGive(SDMutex);
+
+  xTaskNotifyGive(reclaimLogHandle);
+  notifyClientWholeLog();
+}
+
+
+/**
+ * @brief Puts a data log entry in the fallback buffer.
+ *
+ * The entry is written to the LittleFS ring in "/buffer.bin". If LittleFS fails,
+ * the entry goes to the RAM ring instead, and the RAM ring is used until the
+ * buffer has been moved to the SD card. When a ring is full the oldest entry is
+ * overwritten.
+ *
+ * @param log The data log entry to buffer.
+ *
+ * @note This function must be called with `SDMutex` taken.
+ *
+ * @return
+ * - `true` if the entry was kept in LittleFS.
+ * - `false` if it was kept in RAM.
+ */
+bool bufferDataLog(dataLog log){
+  if(flashBufferReady){
+    File bufferFile = LittleFS.open("/buffer.bin", "r+");
+    if(bufferFile){
+      uint32_t slot = (flashBuffer.head + flashBuffer.count) % bufferCapacity;
+      bool written = bufferFile.seek(sizeof(bufferHeader) + slot * sizeof(dataLog)) &&
+                     bufferFile.write((uint8_t*)&log, sizeof(dataLog)) == sizeof(dataLog);
+      if(written){
+        if(flashBuffer.count < bufferCapacity){
+          flashBuffer.count++;
+        }
+        else{
+          Serial.println("Buffer full, overwriting oldest record");
+          flashBuffer.head = (flashBuffer.head + 1) % bufferCapacity;
+        }
+        written = bufferFile.seek(0) &&
+                  bufferFile.write((uint8_t*)&flashBuffer, sizeof(flashBuffer)) == sizeof(flashBuffer);
+      }
+      bufferFile.close();
+      if(written){
+        return true;
+      }
+    }
+    Serial.println("Failed to write buffer file, buffering in RAM");
+    flashBufferReady = false;
+  }
+
+  ramBuffer[(ramBufferHead + ramBufferCount) % ramBufferCapacity] = log;
+  if(ramBufferCount < ramBufferCapacity){
+    ramBufferCount++;
+  }
+  else{
+    ramBufferHead = (ramBufferHead + 1) % ramBufferCapacity;
+  }
+  return false;
+}
+
+
+/**
+ * @brief Writes the in-memory `flashBuffer` header to "/buffer.bin".
+ *
+ * @return
+ * - `true` if the header was written.
+ * - `false` otherwise.
+ */
+bool writeBufferHeader(){
+  File bufferFile = LittleFS.open("/buffer.bin", "r+");
+  if(!bufferFile){
+    return false;
+  }
+  bool written = bufferFile.write((uint8_t*)&flashBuffer, sizeof(flashBuffer)) == sizeof(flashBuffer);
+  bufferFile.close();
+  return written;
+}
+
+
+/**
+ * @brief Returns the number of data log entries waiting in the fallback buffer.
+ *
+ * @return The number of entries in the LittleFS and RAM rings together.
+ */
+int bufferedCount(){
+  int count = ramBufferCount;
+  if(flashBuffer.magic == bufferMagic){
+    count += flashBuffer.count;
+  }
+  return count;
+}
+
+
+/**
+ * @brief Moves one batch of buffered data log entries to the SD card.
+ *
+ * Entries are taken from the LittleFS ring first and then from the RAM ring, so
+ * they reach the SD card in the order they were logged. Up to `migrateBatchSize`
+ * entries are written with a single `appendDataLogs` call, and only removed from
+ * the buffer once they have been written.
+ *
+ * @note This function must be called with `SDMutex` taken. A restart between the
+ * write and the header update will write the batch again.
+ *
+ * @return
+ * - `true` if a batch was moved.
+ * - `false` if the buffer is empty or the batch couldn't be written.
+ */
+bool migrateBuffer(){
+  dataLog batch[migrateBatchSize];
+  int batchSize = 0;
+  bool fromFlash = flashBuffer.magic == bufferMagic && flashBuffer.count > 0;
+
+  if(fromFlash){
+    File bufferFile = LittleFS.open("/buffer.bin", "r");
+    if(!bufferFile){
+      Serial.println("Failed to open buffer file");
+      return false;
     }
-    else {
-      Serial.println("Failed to delete dataLog.json");
+    while(batchSize < migrateBatchSize && batchSize < (int)flashBuffer.count){
+      uint32_t slot = (flashBuffer.head + batchSize) % bufferCapacity;
+      if(!bufferFile.seek(sizeof(bufferHeader) + slot * sizeof(dataLog)) ||
+         bufferFile.read((uint8_t*)&batch[batchSize], sizeof(dataLog)) != sizeof(dataLog)){
+        break;
+      }
+      batchSize++;
     }
+    bufferFile.close();
   }
-  else {
-    Serial.println("dataLog.json does not exist");
+  else{
+    while(batchSize < migrateBatchSize && batchSize < ramBufferCount){
+      batch[batchSize] = ramBuffer[(ramBufferHead + batchSize) % ramBufferCapacity];
+      batchSize++;
+    }
+  }
+
+  if(batchSize == 0 || !appendDataLogs(batch, batchSize)){
+    return false;
+  }
+
+  // remove the moved entries from the buffer
+  if(fromFlash){
+    flashBuffer.head = (flashBuffer.head + batchSize) % bufferCapacity;
+    flashBuffer.count -= batchSize;
+    if(!writeBufferHeader()){
+      flashBufferReady = false;
+    }
+  }
+  else{
+    ramBufferHead = (ramBufferHead + batchSize) % ramBufferCapacity;
+    ramBufferCount -= batchSize;
+  }
+
+  Serial.print("Moved buffered records to sd card: ");
+  Serial.println(batchSize);
+
+  // go back to LittleFS once everything is moved
+  if(bufferedCount() == 0 && !flashBufferReady && flashBuffer.magic == bufferMagic){
+    flashBuffer.head = 0;
+    flashBufferReady = writeBufferHeader();
+  }
+  return true;
+}
+
+
+/**
+ * @brief Mounts the SD card again after it has been missing and moves the buffer to it.
+ *
+ * This task wakes up every `sdRemountInterval` ms. While the SD card is missing it
+ * tries to mount it, and once it is mounted it moves the fallback buffer to the
+ * data log file, one batch at a time, so the firmware recovers without a reboot.
+ *
+ * @param pvParameters A pointer to task parameters (not used).
+ *
+ * @details
+ * The function performs the following steps:
+ * - Tries to mount the SD card with `mountSD()` if it is missing.
+ * - Opens the data log on the mounted card using `openDataLog()`.
+ * - Moves the buffered entries using `migrateBuffer()`, giving `SDMutex` back
+ *   between batches so `handleData` can keep logging.
+ *
+ * @param pvParameters A pointer to task parameters (not used).
+ * @return void
+ */
+void sdRemount( void * pvParameters){
+  while(1){
+    vTaskDelay(sdRemountInterval);
+    if(sdAvailable && bufferedCount() == 0){
+      continue;
+    }
+
+    if(xSemaphoreTake(SDMutex, portMAX_DELAY) == pdTRUE){
+      if(!sdAvailable && mountSD() && openDataLog()){
+        Serial.println("SD card mounted");
+        // a different card holds a different log, so count on from what is on it
+        if(counterRestored){
+          logSequence = dataLogStore.count() + bufferedCount();
+        }
+      }
+      xSemaphoreGive(SDMutex);
+    }
+
+    bool moved = true;
+    while(moved && sdAvailable && bufferedCount() > 0){
+      if(xSemaphoreTake(SDMutex, portMAX_DELAY) == pdTRUE){
+        moved = migrateBuffer();
+        xSemaphoreGive(SDMutex);
+      }
+      vTaskDelay(10);
+    }
+  }
+}
+
+
+/**
+ * @brief Writes the buffered data log to the SD card.
+ *
+ * `dataLogStore` keeps new records in two 4 KB buffers. This task writes a buffer
+ * as soon as it is full, when `handleData` wakes it, and whatever else is buffered
+ * every `logFlushInterval` ms, so at most that much data is lost on a power cut.
+ * The writes don't hold `SDMutex`, so new records can be logged meanwhile.
+ *
+ * @param pvParameters A pointer to task parameters (not used).
+ *
+ * When `logFinalFlush` is set, the task writes everything, wakes that task and
+ * suspends itself, so the log is complete before a restart.
+ *
+ * @note If a write fails the card is treated as missing. Records that were still
+ * buffered at that point are kept by `dataLogStore` and written when `sdRemount`
+ * opens the log again, before the fallback buffer is moved, so they keep their
+ * place and sequence numbers.
+ *
+ * @return void
+ */
+void flushLog( void * pvParameters){
+  while(1){
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(logFlushInterval));
+    // read before the flush, so it has everything appended before the flag was set
+    TaskHandle_t waiting = logFinalFlush;
+    if(sdAvailable && !dataLogStore.flush()){
+      Serial.println("Failed to write dataLog buffers");
+      sdAvailable = false;
+    }
+    if(waiting != NULL){
+      xTaskNotifyGive(waiting);
+      vTaskSuspend(NULL);
+    }
+  }
+}
+
+
+/**
+ * @brief Sends new pulses to the WebSocket clients.
+ *
+ * This task runs the `broadcaster` every `wsBroadcastInterval` ms. Pulses that
+ * came in since a client's last frame are sent to it together, so a client gets
+ * at most one frame per interval however fast the pulses come. Clients that
+ * can't keep up are sent less often, down to one frame per `wsSlowInterval` ms.
+ * Every `wsHealthInterval` ms it also publishes the system health with `publishHealth`.
+ * Before that it replays the log to event source clients that reconnected, with `replayEvents`.
+ *
+ * @param pvParameters A pointer to task parameters (not used).
+ * @return void
+ */
+void broadcastLog( void * pvParameters){
+  uint32_t lastHealth = 0;
+  eventReplay replay;
+  while(1){
+    vTaskDelay(pdMS_TO_TICKS(wsBroadcastInterval));
+    while(xQueueReceive(eventReplayQueue, &replay, 0) == pdTRUE){
+      replayEvents(replay.client, replay.from);
+    }
+    broadcaster.run();
+    if(millis() - lastHealth >= wsHealthInterval){
+      lastHealth = millis();
+      publishHealth();
+    }
+  }
+}
+
+
+/**
+ * @brief Sends the state of the collector to the WebSocket clients that subscribed to "health".
+ *
+ * The message is only built if a client subscribed, and is sent as a latest value, so a
+ * slow client only gets the newest one. It holds the uptime in seconds, the free heap, if
+ * the SD card is available, the records in the log and the entries waiting in the queue.
+ *
+ * @return void
+ */
+void publishHealth(){
+  if(!broadcaster.subscribed(WsBroadcaster::TOPIC_HEALTH)){
+    return;
+  }
+  JsonDocument doc;
+  doc["topic"] = "health";
+  doc["uptime"] = millis() / 1000;
+  doc["freeHeap"] = ESP.getFreeHeap();
+  doc["sdAvailable"] = sdAvailable;
+  doc["records"] = logSequence;
+  doc["queued"] = uxQueueMessagesWaiting(logQueue);
+  doc["clients"] = ws.count();
+  broadcaster.publish(WsBroadcaster::TOPIC_HEALTH, doc, WS_MSG_LATEST);
+}
+
+
+/**
+ * @brief Stops logging, clears the WiFi settings and restarts into configuration mode.
+ *
+ * Started by a POST to `/configMode`, which is answered right away, so the web
+ * server isn't held up while the card is finished with.
+ *
+ * @param pvParameters A pointer to task parameters (not used).
+ *
+ * @details
+ * The task performs the following steps:
+ * - Waits a second, so the answer to `/configMode` gets out.
+ * - Takes `SDMutex` and suspends the tasks using the log, so none of them is stopped
+ *   halfway through an append or a scan.
+ * - Has `flushLog` write what is still buffered and stop, waiting at most `logFinalFlushTimeout` ms.
+ * - Empties the WiFi settings in config.json, keeps the counter in NVS and restarts.
+ *   If config.json can't be opened it restarts anyway, and goes on logging.
+ *
+ * @return void
+ */
+void enterConfigMode( void * pvParameters){
+  vTaskDelay(1000);
+  // stop all tasks. the ones using the log only do so with SDMutex taken,
+  // so none of them is stopped halfway through an append or a scan
+  xSemaphoreTake(SDMutex, portMAX_DELAY);
+  vTaskSuspend(handleDataHandle);
+  vTaskSuspend(simulateImpulseHandle);
+  vTaskSuspend(sdRemountHandle);
+  vTaskSuspend(scanLogHandle);
+  // flushLog writes what is still buffered and stops itself, so it isn't stopped halfway through a write
+  logFinalFlush = xTaskGetCurrentTaskHandle();
+  xTaskNotifyGive(flushLogHandle);
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(logFinalFlushTimeout));
+  vTaskSuspend(reclaimLogHandle);
+  vTaskSuspend(broadcastLogHandle);
+
+  // set config file to empty data
+  File configFile = LittleFS.open("/config.json", "w");
+  if(!configFile){
+    // a task can't return, and logging is stopped, so start over as before
+    Serial.println("Failed to open config file for writing");
+    ESP.restart();
+  }
+  // create json object
+  JsonDocument doc;
+  doc["ssid"] = "";
+  doc["password"] = "";
+  doc["ip"] = "";
+  doc["gateway"] = "";
+
+  // serialize json object to file
+  if(serializeJson(doc, configFile) == 0){
+    Serial.println("Failed to write to file");
+  }
+
+  configFile.close();
+
+  // RTC memory survives the restart, but keep NVS up to date in case the power goes in config mode
+  if(rtcCounter.magic == counterMagic){
+    mirrorCounter(rtcCounter.accumulatedValue, true);
+  }
+  
+  // restart esp
+  ESP.restart();
+}
+
+
+/**
+ * @brief Removes logs that were moved to `trashDir` by a reset.
+ *
+ * Removing a large file makes the SD card library walk and free every cluster
+ * of it, which can take a while. This task does it at the lowest priority, one
+ * file at a time. `SDMutex` is held from finding a file until it is removed, so
+ * no other task uses the card in between, and given back before the next file
+ * so records can be logged meanwhile. It also removes what is left over from a
+ * reset before a restart.
+ *
+ * @param pvParameters A pointer to task parameters (not used).
+ * @return void
+ */
+void reclaimLog( void * pvParameters){
+  while(1){
+    while(sdAvailable){
+      if(xSemaphoreTake(SDMutex, portMAX_DELAY) != pdTRUE){
+        break;
+      }
+      String path;
+      if(sdAvailable){
+        File dir = SD.open(trashDir);
+        if(dir && dir.isDirectory()){
+          File file = dir.openNextFile();
+          if(file){
+            path = file.path();
+            file.close();
+          }
+        }
+        dir.close();
+      }
+      bool removed = path.length() > 0 && SD.remove(path);
+      xSemaphoreGive(SDMutex);
+      if(path.length() == 0){
+        break;
+      }
+
+      if(!removed){
+        Serial.println("Failed to remove " + path);
+        break;
+      }
+      Serial.println("Removed " + path);
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
   }
 }
+
+
+/**
+ * @brief Checks the data log in the background, a little at a time.
+ *
+ * This task walks through the data log one block of records at a time, reading
+ * at most `scanBudget` bytes per second so it never holds `SDMutex` for long. Once it
+ * has reached the end it only checks new records every `scanIdleInterval` ms.
+ * Progress and findings are reported on "/scanStatus".
+ *
+ * @param pvParameters A pointer to task parameters (not used).
+ *
+ * @details
+ * The function performs the following steps:
+ * - Waits for the next step, or for a request from "/scanRepair".
+ * - Carries out a requested restart, truncation or rebuild.
+ * - Otherwise checks the next part of the log using `scanStep()`.
+ *
+ * @note A record with a bad crc or sequence number marks the log as corrupt from
+ * that point, and the scan stops until the log is truncated or the scan is restarted.
+ *
+ * @param pvParameters A pointer to task parameters (not used).
+ * @return void
+ */
+void scanLog( void * pvParameters){
+  while(1){
+    unsigned long wait = (scan.complete || scan.corruptAt >= 0) ? scanIdleInterval : 1000;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+    if(!sdAvailable){
+      continue;
+    }
+
+    if(xSemaphoreTake(SDMutex, portMAX_DELAY) == pdTRUE){
+      scanAction action = scanRequest;
+      scanRequest = SCAN_NONE;
+      switch (action)
+      {
+        case SCAN_RESTART:
+          resetScan();
+          break;
+        case SCAN_TRUNCATE:
+          truncateLog();
+          break;
+        case SCAN_REBUILD:
+          rebuildCounter();
+          break;
+        case SCAN_NONE:
+          if(scan.corruptAt < 0){
+            scanStep();
+          }
+          break;
+      }
+      xSemaphoreGive(SDMutex);
+    }
+  }
+}
+
+
+/**
+ * @brief Starts the scan of the data log over from the beginning.
+ *
+ * @return void
+ */
+void resetScan(){
+  scan.checked = 0;
+  scan.total = 0;
+  scan.counterGaps = 0;
+  scan.timeErrors = 0;
+  scan.firstGap = -1;
+  scan.corruptAt = -1;
+  scan.lastValue = 0;
+  scan.lastTime = 0;
+  scan.complete = false;
+}
+
+
+/**
+ * @brief Checks the next block of the data log.
+ *
+ * Continues from `scan.checked` and reads up to `scanBudget` bytes of records,
+ * or until the end of the log is reached.
+ *
+ * @details
+ * For every record the function checks that:
+ * - The crc is valid and the sequence number matches its place in the log.
+ * - The accumulated value is one higher than in the record before it.
+ * - The time is set and not earlier than in the record before it.
+ *
+ * Records are only ever added to the end of the log, so records already
+ * checked don't have to be read again.
+ *
+ * @note This function must be called with `SDMutex` taken.
+ *
+ * @return void
+ */
+void scanStep(){
+  uint32_t records = dataLogStore.count();
+
+  // the log got shorter, so it was deleted or replaced
+  if(records < scan.checked){
+    resetScan();
+  }
+  scan.total = records;
+  scan.complete = false;
+
+  uint32_t end = min(records, scan.checked + scanBudget / (uint32_t)sizeof(LogRecord));
+  // read past the cache, the point is to check what is on the card
+  LogCursor cursor = dataLogStore.cursor(scan.checked, false);
+  LogRecord record;
+  while(scan.checked < end && cursor.next(record)){
+    if(!logRecordValid(record) || record.sequence != scan.checked){
+      scan.corruptAt = scan.checked;
+      Serial.print("Data log is corrupt at record: ");
+      Serial.println(scan.corruptAt);
+      return;
+    }
+
+    if(scan.checked > 0 && record.accumulatedValue != scan.lastValue + 1){
+      scan.counterGaps++;
+      if(scan.firstGap < 0){
+        scan.firstGap = scan.checked;
+      }
+    }
+    if(record.time == 0 || record.time < scan.lastTime){
+      scan.timeErrors++;
+    }
+
+    scan.lastValue = record.accumulatedValue;
+    scan.lastTime = record.time;
+    scan.checked++;
+  }
+
+  scan.complete = scan.checked == records;
+}
+
+
+/**
+ * @brief Cuts the data log off before the first corrupt record.
+ *
+ * The sequence number and commit offset are updated to match the shorter log.
+ * Records after the corrupt one are dropped as well, since their sequence
+ * numbers would no longer match their place in the log.
+ *
+ * @note This function must be called with `SDMutex` taken, and only does
+ * something if `scanStep()` has found the log to be corrupt.
+ *
+ * @return
+ * - `true` if the log was truncated.
+ * - `false` otherwise.
+ */
+bool truncateLog(){
+  if(scan.corruptAt < 0){
+    Serial.println("Data log is not corrupt, nothing to truncate");
+    return false;
+  }
+
+  if(!dataLogStore.truncate(scan.corruptAt)){
+    Serial.println("Failed to truncate dataLog file");
+    return false;
+  }
+
+  Serial.print("Data log truncated after record: ");
+  Serial.println(scan.corruptAt);
+
+  commitOffset = dataLogStore.count() * sizeof(LogRecord);
+  logSequence = dataLogStore.count() + bufferedCount();
+  mirrorCounter(rtcCounter.accumulatedValue, true);
+
+  scan.total = scan.checked;
+  scan.corruptAt = -1;
+  scan.complete = true;
+  return true;
+}
+
+
+/**
+ * @brief Rebuilds the counter mirrored in RTC memory and NVS from the checked log.
+ *
+ * The sequence number, commit offset and last accumulated value are taken from
+ * the scan, so a later restart can be restored from RTC memory or NVS again.
+ *
+ * @note This function must be called with `SDMutex` taken, and only does
+ * something once the whole log has been checked and nothing is waiting in the
+ * fallback buffer.
+ *
+ * @return void
+ */
+void rebuildCounter(){
+  if(!scan.complete || bufferedCount() > 0){
+    Serial.println("Log not fully checked yet, can't rebuild counter");
+    return;
+  }
+
+  logSequence = scan.checked;
+  commitOffset = scan.checked * sizeof(LogRecord);
+  mirrorCounter(scan.lastValue, true);
+  Serial.println("Counter rebuilt from data log");
+}
@@ -0,0 +1,77 @@
+// compressing with AsyncWebSocketDeflater and inflating with zlib, for the deflate test and benchmark
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <zlib.h>
+#include "AsyncWebSocketDeflate.h"
+
+//the log as /download and the WebSocket send it, with records a few seconds apart
+static inline std::string logJson(int records){
+  std::string json = "{\"log\":[";
+  unsigned long time = 1700000000;
+  srand(1);
+  for(int i = 0; i < records; i++){
+    time += rand() % 3;
+    char record[64];
+    snprintf(record, sizeof(record), "%s{\"accumulatedValue\":%d,\"time\":%lu}", i ? "," : "", i + 1, time);
+    json += record;
+  }
+  json += "]}";
+  return json;
+}
+
+//compresses message the way a WebSocket message is sent: written in pieces of at most
+//piece bytes while there is room, and read out in frames of frame bytes
+static inline std::string deflateMessage(uint8_t windowBits, const std::string &message, size_t piece = 256, size_t frame = 700){
+  AsyncWebSocketDeflater d(windowBits);
+  if(!d.valid())
+    return std::string();
+  std::string out;
+  std::string buffer(frame, '\0');
+  size_t written = 0;
+  while(true){
+    while(!d.finished() && d.available() < frame){
+      size_t room = d.writable();
+      if(room > piece)
+        room = piece;
+      if(room == 0)
+        break;
+      size_t len = std::min(room, message.size() - written);
+      if(len == 0)
+        d.finish();
+      else {
+        d.write((const uint8_t*)message.data() + written, len);
+        written += len;
+      }
+    }
+    size_t len = d.read((uint8_t*)&buffer[0], frame);
+    out.append(buffer.data(), len);
+    if(len == 0 && d.finished())
+      break;
+  }
+  return out;
+}
+
+//inflates a message compressed for permessage-deflate with a window of windowBits,
+//false if zlib doesn't take it
+static inline bool inflateMessage(int windowBits, const std::string &compressed, std::string &message){
+  z_stream z = {};
+  if(inflateInit2(&z, -windowBits) != Z_OK)
+    return false;
+  //RFC 7692 leaves out the end of the empty block the message ends with
+  std::string in = compressed + std::string("\x00\x00\xff\xff", 4);
+  message.clear();
+  char buffer[4096];
+  z.next_in = (Bytef*)in.data();
+  z.avail_in = in.size();
+  int r = Z_OK;
+  while(r == Z_OK && (z.avail_in || z.avail_out == 0)){
+    z.next_out = (Bytef*)buffer;
+    z.avail_out = sizeof(buffer);
+    r = inflate(&z, Z_SYNC_FLUSH);
+    message.append(buffer, sizeof(buffer) - z.avail_out);
+  }
+  inflateEnd(&z);
+  return (r == Z_OK || r == Z_BUF_ERROR) && z.avail_in == 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * Compressing the log of 5000 records, as the WebSocket sends it to a client that agreed to
+ * permessage-deflate, with every window size. Each result is inflated with zlib and has to
+ * come back as the log, or the benchmark fails.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "deflate.h"
+
+int main(int argc, char **argv){
+  int rounds = argc > 1 ? atoi(argv[1]) : 20;
+  std::string log = logJson(5000);
+  for(int bits = 9; bits <= 14; bits++){
+    std::string compressed;
+    auto start = std::chrono::steady_clock::now();
+    for(int n = 0; n < rounds; n++)
+      compressed = deflateMessage(bits, log);
+    auto end = std::chrono::steady_clock::now();
+    std::string inflated;
+    if(!inflateMessage(bits, compressed, inflated) || inflated != log){
+      printf("deflate_bench: the log compressed with a window of %d bits doesn't inflate back\n", bits);
+      return 1;
+    }
+    double us = std::chrono::duration<double, std::micro>(end - start).count() / rounds;
+    printf("deflate_bench: window %2d bits, %zu -> %zu bytes (%.1fx), %.0f us, %.1f MB/s\n",
+      bits, log.size(), compressed.size(), double(log.size()) / compressed.size(), us, log.size() / us);
+  }
+  return 0;
+}
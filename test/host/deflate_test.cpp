@@ -0,0 +1,60 @@
+/*
+ * What AsyncWebSocketDeflater sends has to inflate with zlib to the message it was given,
+ * for every window size it takes, with zlib's window as small as the deflater's, so no
+ * match reaches further back than the window it was told to keep to.
+ */
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "deflate.h"
+
+static int fails = 0;
+#define CHECK(c) do{ if(!(c)){ printf("FAIL line %d: %s\n", __LINE__, #c); fails++; } }while(0)
+
+static void roundTrip(int windowBits, const char * name, const std::string &message, size_t piece = 256){
+  std::string compressed = deflateMessage(windowBits, message, piece);
+  std::string inflated;
+  bool ok = inflateMessage(windowBits, compressed, inflated);
+  if(!ok || inflated != message)
+    printf("%s with a window of %d bits and pieces of %zu doesn't inflate back\n", name, windowBits, piece);
+  CHECK(ok);
+  CHECK(inflated == message);
+}
+
+int main(){
+  std::vector<std::pair<const char *, std::string>> messages;
+  messages.push_back({"empty", ""});
+  messages.push_back({"one byte", "x"});
+  messages.push_back({"a record", logJson(1)});
+  messages.push_back({"the log", logJson(5000)});
+  std::string same(20000, 'a');
+  messages.push_back({"one byte repeated", same});
+  std::string noise;
+  srand(2);
+  for(int i = 0; i < 20000; i++)
+    noise += (char)(rand() & 0xff);
+  messages.push_back({"random bytes", noise});
+  //repeats just inside and just outside every window
+  std::string far;
+  for(int bits = 9; bits <= 15; bits++){
+    std::string block = logJson(3).substr(0, 40);
+    far += block + std::string((1 << bits) - block.size(), ' ') + block + noise.substr(0, (1 << bits) + 1) + block;
+  }
+  messages.push_back({"repeats at the window edges", far});
+
+  for(int bits = 9; bits <= 14; bits++){
+    for(const auto& m: messages)
+      roundTrip(bits, m.first, m.second);
+    //written a byte at a time and in pieces that don't line up with the window
+    roundTrip(bits, "the log in single bytes", logJson(200), 1);
+    roundTrip(bits, "the log in odd pieces", logJson(2000), 97);
+  }
+
+  //window sizes outside 9 to 14 are clamped into it
+  AsyncWebSocketDeflater small(4), large(15);
+  CHECK(small.windowBits() == 9);
+  CHECK(large.windowBits() == 14);
+
+  printf("deflate_test: %d failed\n", fails);
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,15 @@
+// requests recorded from Chrome and Firefox loading the UI, downloading the log, polling,
+// sending the wifi manager form and switching to config mode
+#pragma once
+
+static const char * browserRequests[] = {
+"GET / HTTP/1.1\r\nHost: 192.168.1.50\r\nConnection: keep-alive\r\nUpgrade-Insecure-Requests: 1\r\nUser-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\nAccept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\nAccept-Encoding: gzip, deflate\r\nAccept-Language: da-DK,da;q=0.9,en-US;q=0.8,en;q=0.7\r\nIf-None-Match: \"1a2b3c4d5e6f7081\"\r\n\r\n",
+"GET /assets/script.1a2b3c4d.js HTTP/1.1\r\nHost: 192.168.1.50\r\nConnection: keep-alive\r\nUser-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\nAccept: */*\r\nReferer: http://192.168.1.50/\r\nAccept-Encoding: gzip, deflate\r\nAccept-Language: da-DK,da;q=0.9,en-US;q=0.8,en;q=0.7\r\n\r\n",
+"GET /download?from=1200&count=500 HTTP/1.1\r\nHost: 192.168.1.50\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\nAccept: */*\r\nAccept-Language: en-US,en;q=0.5\r\nAccept-Encoding: gzip, deflate\r\nReferer: http://192.168.1.50/\r\nConnection: keep-alive\r\n\r\n",
+"GET /ws HTTP/1.1\r\nHost: 192.168.1.50\r\nConnection: Upgrade\r\nPragma: no-cache\r\nCache-Control: no-cache\r\nUser-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\nUpgrade: websocket\r\nOrigin: http://192.168.1.50\r\nSec-WebSocket-Version: 13\r\nAccept-Encoding: gzip, deflate\r\nAccept-Language: da-DK,da;q=0.9,en-US;q=0.8,en;q=0.7\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n\r\n",
+"GET /scanStatus HTTP/1.1\r\nHost: 192.168.1.50\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\nAccept: */*\r\nAccept-Language: en-US,en;q=0.5\r\nAccept-Encoding: gzip, deflate\r\nReferer: http://192.168.1.50/\r\nConnection: keep-alive\r\n\r\n",
+"POST / HTTP/1.1\r\nHost: 192.168.4.1\r\nConnection: keep-alive\r\nContent-Length: 71\r\nCache-Control: max-age=0\r\nUpgrade-Insecure-Requests: 1\r\nOrigin: http://192.168.4.1\r\nContent-Type: application/x-www-form-urlencoded\r\nUser-Agent: Mozilla/5.0 (Linux; Android 14; Pixel 7) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Mobile Safari/537.36\r\nAccept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\nReferer: http://192.168.4.1/\r\nAccept-Encoding: gzip, deflate\r\nAccept-Language: da-DK,da;q=0.9,en-US;q=0.8,en;q=0.7\r\n\r\nssid=Hjemme+Net&pass=p%40ss%26word&ip=192.168.0.195&gateway=192.168.0.1",
+"POST /configMode HTTP/1.1\r\nHost: 192.168.1.50\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\nAccept: */*\r\nAccept-Language: en-US,en;q=0.5\r\nAccept-Encoding: gzip, deflate\r\nReferer: http://192.168.1.50/\r\nOrigin: http://192.168.1.50\r\nConnection: keep-alive\r\nContent-Length: 0\r\n\r\n",
+};
+
+static const size_t browserRequestCount = sizeof(browserRequests) / sizeof(browserRequests[0]);
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "IPAddress.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#define ESP32 1
+#define ARDUINO 10812
+#define OUTPUT 1
+#define INPUT 0
+#define LOW 0
+#define HIGH 1
+#define PROGMEM
+#define PGM_P const char*
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcmp_P strcmp
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+#define IRAM_ATTR
+#define log_e(...) ((void)0)
+#define log_w(...) ((void)0)
+#define log_i(...) ((void)0)
+#define log_d(...) ((void)0)
+#define log_v(...) ((void)0)
+template <class A, class B> inline auto min(A a, B b) -> decltype(a < b ? a : b) { return a < b ? a : b; }
+template <class A, class B> inline auto max(A a, B b) -> decltype(a < b ? a : b) { return a < b ? b : a; }
+#define ets_printf printf
+#define vsnprintf_P vsnprintf
+#define snprintf_P snprintf
+#define sprintf_P sprintf
+inline size_t strlcpy(char* d, const char* s, size_t n) { size_t l = strlen(s); if (n) { size_t c = l < n - 1 ? l : n - 1; memcpy(d, s, c); d[c] = 0; } return l; }
+inline unsigned long millis() { return 0; }
+inline unsigned long micros() { return 0; }
+inline void delay(unsigned long) {}
+inline void yield() {}
+inline long random(long a, long b) { return a; }
+inline long random(long b) { return 0; }
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline int digitalRead(int) { return 0; }
+inline void configTime(long, int, const char*, const char* = 0, const char* = 0) {}
+inline bool getLocalTime(struct tm*, uint32_t ms = 5000) { return true; }
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+};
+extern HardwareSerial Serial;
+class EspClass {
+public:
+  void restart() {}
+  uint32_t getFreeHeap() { return 0; }
+  uint32_t getMaxAllocHeap() { return 0; }
+  uint32_t getMinFreeHeap() { return 0; }
+};
+extern EspClass ESP;
+typedef enum { ESP_RST_UNKNOWN, ESP_RST_POWERON, ESP_RST_EXT, ESP_RST_SW, ESP_RST_PANIC, ESP_RST_INT_WDT, ESP_RST_TASK_WDT, ESP_RST_WDT, ESP_RST_DEEPSLEEP, ESP_RST_BROWNOUT, ESP_RST_SDIO } esp_reset_reason_t;
+inline esp_reset_reason_t esp_reset_reason() { return ESP_RST_SW; }
+#include <stddef.h>
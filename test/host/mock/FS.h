@@ -0,0 +1,53 @@
+#pragma once
+#include "Arduino.h"
+#include <memory>
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+namespace fs {
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+class File : public Stream {
+public:
+  File() {}
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t* b, size_t n) override { return n; }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  size_t read(uint8_t* b, size_t n) { return n; }
+  bool seek(uint32_t pos, SeekMode m = SeekSet) { return true; }
+  size_t position() const { return 0; }
+  size_t size() const { return 0; }
+  bool setBufferSize(size_t) { return true; }
+  void close() {}
+  void flush() override {}
+  operator bool() const { return true; }
+  time_t getLastWrite() { return 0; }
+  const char* path() const { return ""; }
+  const char* name() const { return ""; }
+  bool isDirectory() { return false; }
+  File openNextFile(const char* mode = "r") { return File(); }
+  void rewindDirectory() {}
+};
+class FS {
+public:
+  File open(const char* p, const char* m = "r", const bool create = false) { return File(); }
+  File open(const String& p, const char* m = "r", const bool create = false) { return File(); }
+  bool exists(const char*) { return true; }
+  bool exists(const String&) { return true; }
+  bool remove(const char*) { return true; }
+  bool remove(const String&) { return true; }
+  bool rename(const char*, const char*) { return true; }
+  bool rename(const String&, const String&) { return true; }
+  bool mkdir(const char*) { return true; }
+  bool mkdir(const String&) { return true; }
+  bool rmdir(const char*) { return true; }
+};
+}
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
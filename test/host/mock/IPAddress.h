@@ -0,0 +1,16 @@
+#pragma once
+#include "Print.h"
+#include <stdint.h>
+class IPAddress : public Printable {
+  uint8_t a[4] = {0,0,0,0};
+public:
+  IPAddress() {}
+  IPAddress(uint8_t x, uint8_t y, uint8_t z, uint8_t w) : a{x,y,z,w} {}
+  IPAddress(uint32_t v) { memcpy(a, &v, 4); }
+  operator uint32_t() const { uint32_t v; memcpy(&v, a, 4); return v; }
+  uint8_t operator[](int i) const { return a[i]; }
+  bool fromString(const char*) { return true; }
+  bool fromString(const String&) { return true; }
+  String toString() const { return String(); }
+  size_t printTo(Print& p) const override { return 0; }
+};
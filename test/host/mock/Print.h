@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include "WString.h"
+#define DEC 10
+#define HEX 16
+class Print;
+class Printable { public: virtual ~Printable() {} virtual size_t printTo(Print& p) const = 0; };
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t* b, size_t n) { size_t r = 0; while (n--) r += write(*b++); return r; }
+  size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t write(const char* s, size_t n) { return write((const uint8_t*)s, n); }
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) { char b[256]; va_list a; va_start(a, fmt); int n = vsnprintf(b, sizeof b, fmt, a); va_end(a); return write((const uint8_t*)b, n); }
+  size_t print(const String& s) { return write(s.c_str()); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(const __FlashStringHelper* s) { return write((const char*)s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int b = DEC) { return print(String(v)); }
+  size_t print(unsigned int v, int b = DEC) { return print(String(v)); }
+  size_t print(long v, int b = DEC) { return print(String(v)); }
+  size_t print(unsigned long v, int b = DEC) { return print(String(v)); }
+  size_t print(long long v, int b = DEC) { return print(String(v)); }
+  size_t print(unsigned long long v, int b = DEC) { return print(String(v)); }
+  size_t print(double v, int d = 2) { return print(String(v)); }
+  size_t print(const struct tm* t, const char* fmt = 0) { return 0; }
+  size_t println() { return write("\r\n"); }
+  template <class T> size_t println(const T& v) { return print(v) + println(); }
+  template <class T> size_t println(const T& v, int b) { return print(v, b) + println(); }
+  size_t println(const struct tm* t, const char* fmt) { return println(); }
+  virtual void flush() {}
+};
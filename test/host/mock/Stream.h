@@ -0,0 +1,14 @@
+#pragma once
+#include "Print.h"
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long) {}
+  virtual size_t readBytes(char* b, size_t n) { size_t i = 0; for (; i < n; i++) { int c = read(); if (c < 0) break; b[i] = c; } return i; }
+  size_t readBytes(uint8_t* b, size_t n) { return readBytes((char*)b, n); }
+  bool find(const char* t) { return false; }
+  bool findUntil(const char* t, const char* u) { return false; }
+  String readStringUntil(char t) { return String(); }
+};
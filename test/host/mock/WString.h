@@ -0,0 +1,83 @@
+#pragma once
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+#define FPSTR(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+class String {
+  std::string s;
+public:
+  String(const char* c = "") : s(c ? c : "") {}
+  String(const String&) = default;
+  String(String&&) = default;
+  String& operator=(const String&) = default;
+  String& operator=(String&&) = default;
+  String(const __FlashStringHelper* f) : s((const char*)f) {}
+  explicit String(char c) : s(1, c) {}
+  explicit String(int v, unsigned char base = 10) : s(std::to_string(v)) {}
+  explicit String(unsigned int v, unsigned char base = 10) : s(std::to_string(v)) {}
+  explicit String(long v, unsigned char base = 10) : s(std::to_string(v)) {}
+  explicit String(unsigned long v, unsigned char base = 10) : s(std::to_string(v)) {}
+  explicit String(long long v, unsigned char base = 10) : s(std::to_string(v)) {}
+  explicit String(unsigned long long v, unsigned char base = 10) : s(std::to_string(v)) {}
+  explicit String(double v, unsigned int d = 2) : s(std::to_string(v)) {}
+  String& operator=(const char* c) { s = c ? c : ""; return *this; }
+  const char* c_str() const { return s.c_str(); }
+  char* begin() { return &s[0]; }
+  unsigned int length() const { return s.size(); }
+  bool reserve(unsigned int n) { s.reserve(n); return true; }
+  bool concat(const String& o) { s += o.s; return true; }
+  bool concat(const char* c) { s += c; return true; }
+  bool concat(const char* c, unsigned int n) { s.append(c, n); return true; }
+  bool concat(char c) { s += c; return true; }
+  bool concat(int v) { s += std::to_string(v); return true; }
+  bool concat(unsigned int v) { s += std::to_string(v); return true; }
+  bool concat(long v) { s += std::to_string(v); return true; }
+  bool concat(unsigned long v) { s += std::to_string(v); return true; }
+  bool concat(unsigned long long v) { s += std::to_string(v); return true; }
+  bool concat(double v) { s += std::to_string(v); return true; }
+  template <class T> String& operator+=(const T& v) { concat(v); return *this; }
+  friend String operator+(const String& a, const String& b) { String r(a); r.concat(b); return r; }
+  friend String operator+(const String& a, const char* b) { String r(a); r.concat(b); return r; }
+  friend String operator+(const char* a, const String& b) { String r(a); r.concat(b); return r; }
+  friend String operator+(const String& a, char b) { String r(a); r.concat(b); return r; }
+  friend String operator+(const String& a, int b) { String r(a); r.concat(b); return r; }
+  friend String operator+(const String& a, unsigned int b) { String r(a); r.concat(b); return r; }
+  friend String operator+(const String& a, long b) { String r(a); r.concat(b); return r; }
+  friend String operator+(const String& a, unsigned long b) { String r(a); r.concat(b); return r; }
+  bool operator==(const String& o) const { return s == o.s; }
+  bool operator==(const char* c) const { return s == c; }
+  bool operator!=(const String& o) const { return s != o.s; }
+  bool operator!=(const char* c) const { return s != c; }
+  bool operator<(const String& o) const { return s < o.s; }
+  char operator[](unsigned int i) const { return i < s.size() ? s[i] : 0; }
+  char& operator[](unsigned int i) { return s[i]; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+  void setCharAt(unsigned int i, char c) { if (i < s.size()) s[i] = c; }
+  bool equals(const String& o) const { return s == o.s; }
+  bool equals(const char* c) const { return s == c; }
+  bool equalsIgnoreCase(const String& o) const { return strcasecmp(s.c_str(), o.s.c_str()) == 0; }
+  bool startsWith(const String& p) const { return s.compare(0, p.s.size(), p.s) == 0; }
+  bool startsWith(const String& p, unsigned int off) const { return s.compare(off, p.s.size(), p.s) == 0; }
+  bool endsWith(const String& p) const { return s.size() >= p.s.size() && s.compare(s.size() - p.s.size(), p.s.size(), p.s) == 0; }
+  int indexOf(char c, unsigned int from = 0) const { auto p = s.find(c, from); return p == std::string::npos ? -1 : (int)p; }
+  int indexOf(const String& c, unsigned int from = 0) const { auto p = s.find(c.s, from); return p == std::string::npos ? -1 : (int)p; }
+  int lastIndexOf(char c) const { auto p = s.rfind(c); return p == std::string::npos ? -1 : (int)p; }
+  int lastIndexOf(const String& c) const { auto p = s.rfind(c.s); return p == std::string::npos ? -1 : (int)p; }
+  String substring(unsigned int b) const { return b >= s.size() ? String() : String(s.substr(b).c_str()); }
+  String substring(unsigned int b, unsigned int e) const { if (b > e) std::swap(b, e); return b >= s.size() ? String() : String(s.substr(b, e - b).c_str()); }
+  void replace(const String& a, const String& b) { size_t p = 0; while ((p = s.find(a.s, p)) != std::string::npos) { s.replace(p, a.s.size(), b.s); p += b.s.size(); } }
+  void replace(char a, char b) { for (auto& c : s) if (c == a) c = b; }
+  void remove(unsigned int i) { if (i < s.size()) s.erase(i); }
+  void remove(unsigned int i, unsigned int n) { if (i < s.size()) s.erase(i, n); }
+  void toLowerCase() { for (auto& c : s) c = tolower(c); }
+  void toUpperCase() { for (auto& c : s) c = toupper(c); }
+  void trim() { while (!s.empty() && isspace(s.back())) s.pop_back(); size_t i = 0; while (i < s.size() && isspace(s[i])) i++; s.erase(0, i); }
+  long toInt() const { return atol(s.c_str()); }
+  float toFloat() const { return atof(s.c_str()); }
+  void getBytes(unsigned char* b, unsigned int n) const { strncpy((char*)b, s.c_str(), n); }
+  void toCharArray(char* b, unsigned int n) const { strncpy(b, s.c_str(), n); }
+  explicit operator bool() const { return true; }
+};
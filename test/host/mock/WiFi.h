@@ -0,0 +1,6 @@
+#pragma once
+#include "Arduino.h"
+#define WL_CONNECTED 3
+class WiFiClient {};
+class WiFiClass { public: bool config(IPAddress, IPAddress, IPAddress, IPAddress) { return true; } void begin(const char*, const char*) {} int status() { return WL_CONNECTED; } bool softAP(const char*, const char*) { return true; } IPAddress softAPIP() { return IPAddress(); } IPAddress localIP() { return IPAddress(); } void disconnect() {} };
+extern WiFiClass WiFi;
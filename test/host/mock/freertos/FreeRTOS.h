@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void* TaskHandle_t;
+typedef void* QueueHandle_t;
+typedef QueueHandle_t xQueueHandle;
+typedef void* SemaphoreHandle_t;
+typedef void* TimerHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef struct { int x; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(m) ((void)(m))
+#define portEXIT_CRITICAL(m) ((void)(m))
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(x) (x)
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY 0x7fffffff
+inline BaseType_t xTaskCreate(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*) { return pdPASS; }
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*, BaseType_t) { return pdPASS; }
+inline void vTaskDelay(TickType_t) {}
+inline void vTaskDelayUntil(TickType_t*, TickType_t) {}
+inline void vTaskDelete(TaskHandle_t) {}
+inline void vTaskSuspend(TaskHandle_t) {}
+inline void vTaskResume(TaskHandle_t) {}
+inline TickType_t xTaskGetTickCount() { return 0; }
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return 0; }
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+inline BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+inline QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t) { return 0; }
+inline BaseType_t xQueueSend(QueueHandle_t, const void*, TickType_t) { return pdPASS; }
+inline BaseType_t xQueueSendToFront(QueueHandle_t, const void*, TickType_t) { return pdPASS; }
+inline BaseType_t xQueueReceive(QueueHandle_t, void*, TickType_t) { return pdFALSE; }
+inline BaseType_t xQueuePeek(QueueHandle_t, void*, TickType_t) { return pdFALSE; }
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t) { return 0; }
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return 0; }
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return 0; }
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return 0; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t) { return pdTRUE; }
+inline void vSemaphoreDelete(SemaphoreHandle_t) {}
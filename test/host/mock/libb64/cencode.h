@@ -0,0 +1,7 @@
+#pragma once
+typedef struct { int x; } base64_encodestate;
+inline void base64_init_encodestate(base64_encodestate*) {}
+inline int base64_encode_block(const char*, int, char* out, base64_encodestate*) { out[0] = 0; return 0; }
+inline int base64_encode_blockend(char* out, base64_encodestate*) { out[0] = 0; return 0; }
+inline int base64_encode_expected_len(int n) { return ((n + 2) / 3) * 4; }
+inline int base64_encode_chars(const char*, int, char* out) { out[0] = 0; return 0; }
@@ -0,0 +1 @@
+struct pbuf { void* payload; unsigned short len; };
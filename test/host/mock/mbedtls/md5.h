@@ -0,0 +1,11 @@
+#pragma once
+#include <stddef.h>
+typedef struct { int x; } mbedtls_md5_context;
+inline void mbedtls_md5_init(mbedtls_md5_context*) {}
+inline int mbedtls_md5_starts_ret(mbedtls_md5_context*) { return 0; }
+inline int mbedtls_md5_update_ret(mbedtls_md5_context*, const unsigned char*, size_t) { return 0; }
+inline int mbedtls_md5_finish_ret(mbedtls_md5_context*, unsigned char*) { return 0; }
+inline void mbedtls_md5_starts(mbedtls_md5_context*) {}
+inline void mbedtls_md5_update(mbedtls_md5_context*, const unsigned char*, size_t) {}
+inline void mbedtls_md5_finish(mbedtls_md5_context*, unsigned char*) {}
+inline void mbedtls_md5_free(mbedtls_md5_context*) {}
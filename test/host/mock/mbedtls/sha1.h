@@ -0,0 +1,11 @@
+#pragma once
+#include <stddef.h>
+typedef struct { int x; } mbedtls_sha1_context;
+inline void mbedtls_sha1_init(mbedtls_sha1_context*) {}
+inline int mbedtls_sha1_starts_ret(mbedtls_sha1_context*) { return 0; }
+inline int mbedtls_sha1_update_ret(mbedtls_sha1_context*, const unsigned char*, size_t) { return 0; }
+inline int mbedtls_sha1_finish_ret(mbedtls_sha1_context*, unsigned char*) { return 0; }
+inline void mbedtls_sha1_starts(mbedtls_sha1_context*) {}
+inline void mbedtls_sha1_update(mbedtls_sha1_context*, const unsigned char*, size_t) {}
+inline void mbedtls_sha1_finish(mbedtls_sha1_context*, unsigned char*) {}
+inline void mbedtls_sha1_free(mbedtls_sha1_context*) {}
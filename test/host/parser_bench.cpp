@@ -0,0 +1,75 @@
+/*
+ * Time and allocations the server spends on parsing the recorded browser requests,
+ * each arriving in one segment as they do from a browser on the same network.
+ * `make baseline` builds it against the parser before and after it parsed in place.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#define protected public
+#include "ESPAsyncWebServer.h"
+#include "fixtures/browser_requests.h"
+
+//every allocation of the library and the String mock, which allocate with malloc and
+//realloc as well as new. the Makefile links with --wrap for these
+static size_t allocations = 0;
+extern "C" {
+void * __real_malloc(size_t n);
+void * __real_calloc(size_t n, size_t size);
+void * __real_realloc(void * p, size_t n);
+void * __wrap_malloc(size_t n){ allocations++; return __real_malloc(n); }
+void * __wrap_calloc(size_t n, size_t size){ allocations++; return __real_calloc(n, size); }
+void * __wrap_realloc(void * p, size_t n){ allocations++; return __real_realloc(p, n); }
+}
+//not inlined, or the compiler takes the free() in delete for one of memory from new
+__attribute__((noinline)) void * operator new(size_t n){
+  void * p = malloc(n);
+  if(p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+__attribute__((noinline)) void operator delete(void * p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void * p, size_t) noexcept { free(p); }
+
+int main(int argc, char **argv){
+  int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+  AsyncWebServer server(80);
+  server.on("/download", HTTP_GET, [](AsyncWebServerRequest *r){
+    if(r->hasParam("from"))
+      (void)r->getParam("from")->value();
+  });
+  server.on("/scanStatus", HTTP_GET, [](AsyncWebServerRequest *){ });
+  server.on("/ws", HTTP_GET, [](AsyncWebServerRequest *r){ (void)r->header("Sec-WebSocket-Key"); });
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest *r){ (void)r->hasHeader("If-None-Match"); });
+  server.on("/", HTTP_POST, [](AsyncWebServerRequest *r){ (void)r->arg("ssid"); });
+  server.on("/configMode", HTTP_POST, [](AsyncWebServerRequest *){ });
+  server.on("/assets/script.1a2b3c4d.js", HTTP_GET, [](AsyncWebServerRequest *){ });
+
+  std::vector<std::string> requests(browserRequests, browserRequests + browserRequestCount);
+  //one round to warm up, then the timed ones
+  for(int pass = 0; pass < 2; pass++){
+    size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    int count = 0;
+    for(int n = 0; n < (pass ? rounds : 1); n++){
+      for(const auto& q: requests){
+        AsyncClient *c = new AsyncClient();
+        AsyncWebServerRequest *r = new AsyncWebServerRequest(&server, c);
+        std::string b(q);
+        c->_recv_cb(c->_recv_cb_arg, c, &b[0], b.size());
+        delete r;
+        delete c;
+        count++;
+      }
+    }
+    auto end = std::chrono::steady_clock::now();
+    if(pass)
+      printf("parser_bench: %.0f ns/request, %.1f allocations/request\n",
+        std::chrono::duration<double, std::nano>(end - start).count() / count,
+        double(allocations - before) / count);
+  }
+  return 0;
+}
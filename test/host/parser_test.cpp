@@ -0,0 +1,136 @@
+/*
+ * The request parser has to come to the same request however the bytes are split into
+ * segments. Every recorded request is fed whole, in steps of 1 to 16 bytes and in two
+ * pieces cut at every offset, and what the handler sees has to be the same each time.
+ */
+#include <cstdio>
+#include <string>
+#include <vector>
+#define protected public
+#include "ESPAsyncWebServer.h"
+#include "fixtures/browser_requests.h"
+
+static int fails = 0;
+#define CHECK(c) do{ if(!(c)){ printf("FAIL line %d: %s\n", __LINE__, #c); fails++; } }while(0)
+
+static std::string seen;
+static int hits = 0;
+
+//everything the parser found, as one string
+static std::string snapshot(AsyncWebServerRequest *r){
+  std::string s;
+  s += std::to_string(r->method()) + " " + r->url().c_str() + " " + std::to_string(r->version()) + "\n";
+  s += std::string("host ") + r->host().c_str() + "\n";
+  s += std::string("type ") + r->contentType().c_str() + " " + std::to_string(r->contentLength()) + "\n";
+  for(size_t i = 0; i < r->params(); i++){
+    AsyncWebParameter *p = r->getParam(i);
+    s += std::string(p->isPost() ? "post " : "get ") + p->name().c_str() + "=" + p->value().c_str() + "\n";
+  }
+  for(size_t i = 0; i < r->headers(); i++){
+    AsyncWebHeader *h = r->getHeader(i);
+    s += std::string(h->name().c_str()) + ": " + h->value().c_str() + "\n";
+  }
+  return s;
+}
+
+//feeds request in the pieces cut at the offsets in cuts
+static void feed(AsyncWebServer &server, const std::string &request, const std::vector<size_t> &cuts){
+  AsyncClient *c = new AsyncClient();
+  AsyncWebServerRequest *r = new AsyncWebServerRequest(&server, c);
+  std::string b(request);
+  size_t from = 0;
+  for(size_t to: cuts){
+    if(to > from && to < b.size()){
+      c->_recv_cb(c->_recv_cb_arg, c, &b[from], to - from);
+      from = to;
+    }
+  }
+  c->_recv_cb(c->_recv_cb_arg, c, &b[from], b.size() - from);
+  delete r;
+  delete c;
+}
+
+static void recorded(){
+  AsyncWebServer server(80);
+  server.onNotFound([](AsyncWebServerRequest *r){
+    hits++;
+    seen = snapshot(r);
+    r->send(200);
+  });
+  for(size_t n = 0; n < browserRequestCount; n++){
+    std::string request(browserRequests[n]);
+    hits = 0;
+    feed(server, request, {});
+    CHECK(hits == 1);
+    std::string whole = seen;
+    for(size_t step = 1; step <= 16; step++){
+      std::vector<size_t> cuts;
+      for(size_t i = step; i < request.size(); i += step)
+        cuts.push_back(i);
+      seen.clear();
+      feed(server, request, cuts);
+      if(seen != whole)
+        printf("request %zu differs in steps of %zu\n", n, step);
+      CHECK(seen == whole);
+    }
+    for(size_t i = 1; i < request.size(); i++){
+      seen.clear();
+      feed(server, request, {i});
+      if(seen != whole){
+        printf("request %zu differs when cut at %zu\n", n, i);
+        CHECK(seen == whole);
+        break;
+      }
+    }
+    CHECK(hits == 1 + 16 + (int)request.size() - 1);
+  }
+}
+
+//what the parser makes of a request with everything it has to decode
+static void decoded(){
+  AsyncWebServer server(80);
+  int got = 0;
+  server.on("/download", HTTP_GET, [&](AsyncWebServerRequest *r){
+    got++;
+    CHECK(r->url() == "/download");
+    CHECK(r->params() == 3);
+    CHECK(r->arg("from") == "12");
+    CHECK(r->arg("name") == "a b&c");
+    CHECK(r->hasArg("flag"));
+    CHECK(r->arg("flag") == "");
+    CHECK(r->hasHeader("user-agent"));
+    CHECK(r->header("Host") == "esp.local");
+    CHECK(r->host() == "esp.local");
+    CHECK(r->getHeader("Accept")->value() == "*/*");
+    CHECK(r->headers() == 3);
+    CHECK(r->headerName(1) == "User-Agent");
+    CHECK(r->method() == HTTP_GET);
+    CHECK(r->version() == 1);
+    r->send(200);
+  });
+  server.on("/p q", HTTP_POST, [&](AsyncWebServerRequest *r){
+    got++;
+    CHECK(r->url() == "/p q");
+    CHECK(r->contentType() == "text/plain");
+    CHECK(r->contentLength() == 0);
+    CHECK(r->version() == 0);
+    r->send(200);
+  });
+  std::string q = "GET /download?from=12&name=a+b%26c&flag HTTP/1.1\r\nHost: esp.local\r\nUser-Agent:   curl/8\r\nAccept: */*  \r\n\r\n";
+  for(size_t step: {1, 3, 7}){
+    std::vector<size_t> cuts;
+    for(size_t i = step; i < q.size(); i += step)
+      cuts.push_back(i);
+    feed(server, q, cuts);
+  }
+  feed(server, q, {});
+  feed(server, "POST /p%20q HTTP/1.0\r\nContent-Type: text/plain; charset=utf-8\r\n\r\n", {});
+  CHECK(got == 5);
+}
+
+int main(){
+  recorded();
+  decoded();
+  printf("parser_test: %d failed\n", fails);
+  return fails ? 1 : 0;
+}
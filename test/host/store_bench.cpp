@@ -0,0 +1,112 @@
+/*
+ * Appending to and reading back the data log, from RAM and from a file: appends one record
+ * at a time and in batches, reads through a cursor with and without the block cache, and
+ * the log as JSON with and without cached chunks. What is read has to be what was appended,
+ * or the benchmark fails.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "LogJson.h"
+
+static const size_t RECORDS = 20480;  //a whole number of every batch size
+
+static double nsSince(std::chrono::steady_clock::time_point start, size_t count){
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+static bool append(LogStore &store, size_t batch){
+  store.truncate(0);
+  std::vector<LogRecord> records(batch);
+  for(size_t i = 0; i < RECORDS; i += batch){
+    for(size_t j = 0; j < batch; j++)
+      records[j] = {0, (int32_t)(i + j), (uint32_t)(1700000000 + i + j), 0};
+    if(store.appendBatch(records.data(), batch) != batch)
+      return false;
+  }
+  return store.count() == RECORDS;
+}
+
+static bool readAll(LogStore &store, bool cached){
+  LogCursor cursor = store.cursor(0, cached);
+  LogRecord record;
+  size_t count = 0;
+  while(cursor.next(record)){
+    if(record.sequence != count || record.accumulatedValue != (int32_t)count)
+      return false;
+    count++;
+  }
+  return count == RECORDS;
+}
+
+static size_t writeJson(LogStore &store, LogJsonCache *cache){
+  LogJsonWriter writer(&store);
+  writer.setCache(cache);
+  uint8_t buffer[1436];
+  size_t total = 0, len;
+  while((len = writer.fill(buffer, sizeof(buffer))) > 0)
+    total += len;
+  return total;
+}
+
+static bool bench(const char *name, LogStore &store, int rounds){
+  if(!store.begin())
+    return false;
+  for(size_t batch : {1, 16, 256}){
+    auto start = std::chrono::steady_clock::now();
+    for(int n = 0; n < rounds; n++)
+      if(!append(store, batch))
+        return false;
+    printf("store_bench: %-13s append in batches of %3zu  %7.1f ns/record\n", name, batch, nsSince(start, rounds * RECORDS));
+  }
+
+  LogBlockCache cache(&store);
+  store.setCache(&cache);
+  for(bool cached : {false, true}){
+    auto start = std::chrono::steady_clock::now();
+    for(int n = 0; n < rounds; n++)
+      if(!readAll(store, cached))
+        return false;
+    printf("store_bench: %-13s read %-20s  %7.1f ns/record\n", name, cached ? "through the cache" : "from the store", nsSince(start, rounds * RECORDS));
+  }
+
+  LogJsonCache jsonCache(&store, RECORDS / LogJsonCache::CHUNK_RECORDS + 1);
+  size_t expected = writeJson(store, nullptr);
+  for(LogJsonCache *json : {(LogJsonCache*)nullptr, &jsonCache}){
+    auto start = std::chrono::steady_clock::now();
+    for(int n = 0; n < rounds; n++)
+      if(writeJson(store, json) != expected)
+        return false;
+    printf("store_bench: %-13s JSON %-20s  %7.1f ns/record\n", name, json ? "from cached chunks" : "formatted", nsSince(start, rounds * RECORDS));
+  }
+  store.setCache(nullptr);
+  return true;
+}
+
+int main(int argc, char **argv){
+  int rounds = argc > 1 ? atoi(argv[1]) : 20;
+  RamLogStore ram;
+  if(!bench("RamLogStore", ram, rounds)){
+    printf("store_bench: RamLogStore doesn't read back what was appended\n");
+    return 1;
+  }
+  char path[] = "/tmp/store_benchXXXXXX";
+  int fd = mkstemp(path);
+  if(fd < 0)
+    return 1;
+  close(fd);
+  bool ok;
+  {
+    PosixLogStore file(path);
+    ok = bench("PosixLogStore", file, rounds);
+  }
+  unlink(path);
+  if(!ok){
+    printf("store_bench: PosixLogStore doesn't read back what was appended\n");
+    return 1;
+  }
+  return 0;
+}
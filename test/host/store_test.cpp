@@ -0,0 +1,230 @@
+/*
+ * The data log has to read back as it was appended, from RAM and from a file, through
+ * cursors and the block cache, and after a truncate no reader may get the records that
+ * were dropped, neither from LogBlockCache nor as JSON from LogJsonCache. The JSON has to
+ * be the same however it is produced: a byte at a time, in frames, or from cached chunks.
+ */
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "LogJson.h"
+
+static int fails = 0;
+#define CHECK(c) do{ if(!(c)){ printf("FAIL line %d: %s\n", __LINE__, #c); fails++; } }while(0)
+
+//records a few seconds apart, the first few logged before the clock was set
+static std::vector<LogRecord> makeRecords(size_t count, int32_t value = 1){
+  std::vector<LogRecord> records(count);
+  uint32_t time = 1700000000;
+  for(size_t i = 0; i < count; i++){
+    time += i % 3;
+    records[i] = {0, value + (int32_t)i, i < 5 ? 0 : time, 0};
+  }
+  return records;
+}
+
+static std::string expectedJson(const std::vector<LogRecord> &records, size_t from, size_t end, bool withFrom){
+  std::string json = withFrom ? "{\"from\":" + std::to_string(from) + ",\"log\":[" : "{\"log\":[";
+  for(size_t i = from; i < end; i++){
+    if(i > from)
+      json += ",";
+    json += "{\"accumulatedValue\":" + std::to_string(records[i].accumulatedValue) + ",\"time\":" + std::to_string(records[i].time) + "}";
+  }
+  return json + "]}";
+}
+
+//everything the writer gives, in pieces of at most frame bytes
+static std::string writeJson(LogJsonWriter &writer, size_t frame){
+  std::string json;
+  std::vector<uint8_t> buffer(frame);
+  size_t len;
+  while((len = writer.fill(buffer.data(), frame)) > 0)
+    json.append((const char*)buffer.data(), len);
+  return json;
+}
+
+static bool readsBack(LogStore &store, const std::vector<LogRecord> &records, bool cached){
+  if(store.count() != records.size())
+    return false;
+  LogCursor cursor = store.cursor(0, cached);
+  LogRecord record;
+  for(size_t i = 0; i < records.size(); i++){
+    if(!cursor.next(record) || record.sequence != i || !logRecordValid(record)
+      || record.accumulatedValue != records[i].accumulatedValue || record.time != records[i].time)
+      return false;
+  }
+  return !cursor.next(record);
+}
+
+//seekTime() finds the first record with the time, not just any of them
+static bool seeks(LogStore &store, const std::vector<LogRecord> &records, uint32_t time){
+  uint32_t index = store.seekTime(time);
+  return index < records.size() && records[index].time == time && (index == 0 || records[index - 1].time < time);
+}
+
+static void testStore(const char *name, LogStore &store){
+  printf("store_test: %s\n", name);
+  CHECK(store.begin());
+  CHECK(store.count() == 0);
+  LogRecord record;
+  CHECK(!store.last(record));
+
+  //one at a time and in batches that don't line up with the cache blocks
+  std::vector<LogRecord> records = makeRecords(1000);
+  for(size_t i = 0; i < 10; i++)
+    CHECK(store.append(records[i]));
+  CHECK(store.appendBatch(&records[10], 290) == 290);
+  CHECK(store.appendBatch(&records[300], 700) == 700);
+  CHECK(store.appendBatch(&records[0], 0) == 0);
+  CHECK(readsBack(store, records, false));
+  CHECK(store.last(record) && record.sequence == 999);
+
+  //reads past the end stop at it
+  LogRecord buffer[8];
+  CHECK(store.read(996, buffer, 8) == 4);
+  CHECK(store.read(1000, buffer, 8) == 0);
+
+  //a cursor that is moved back and forth
+  LogCursor cursor = store.cursor(500);
+  CHECK(cursor.next(record) && record.sequence == 500);
+  cursor.seek(20);
+  CHECK(cursor.next(record) && record.sequence == 20 && cursor.position() == 21);
+  cursor.seek(1000);
+  CHECK(!cursor.next(record));
+
+  //records without a time sort first, and a time between two records finds the later one
+  CHECK(store.seekTime(0) == 0);
+  CHECK(store.seekTime(1) == 5);
+  for(size_t i : {5, 6, 7, 500, 501, 502, 999})
+    CHECK(seeks(store, records, records[i].time));
+  CHECK(store.seekTime(records[999].time + 1) == 1000);
+
+  //the same through the block cache, which has to see a truncate
+  LogBlockCache cache(&store, 2);
+  store.setCache(&cache);
+  CHECK(readsBack(store, records, true));
+  CHECK(seeks(store, records, records[700].time));
+  LogCacheStats cacheStats = cache.stats();
+  CHECK(cacheStats.hits > 0 && cacheStats.misses > 0 && cacheStats.readAheads > 0);
+
+  CHECK(store.truncate(600));
+  CHECK(store.truncate(700));
+  CHECK(store.count() == 600);
+  CHECK(store.stats().truncates == 1);
+  CHECK(store.readCached(600, buffer, 8) == 0);
+  records.resize(600);
+  std::vector<LogRecord> other = makeRecords(400, 5000);
+  CHECK(store.appendBatch(other.data(), other.size()) == 400);
+  records.insert(records.end(), other.begin(), other.end());
+  CHECK(readsBack(store, records, true));
+  CHECK(store.readCached(600, buffer, 1) == 1 && buffer[0].accumulatedValue == 5000);
+
+  //a block read before it was full is read again for the records appended after
+  LogRecord more = {0, 9999, records.back().time + 1, 0};
+  CHECK(store.append(more));
+  records.push_back(more);
+  CHECK(store.readCached(1000, buffer, 1) == 1 && buffer[0].accumulatedValue == 9999);
+  CHECK(store.last(record) && record.sequence == 1000);
+
+  //JSON, from the start, from the middle, with a limit, and in frames of every size
+  for(size_t frame : {1, 7, 64, 1436}){
+    LogJsonWriter writer(&store);
+    CHECK(writeJson(writer, frame) == expectedJson(records, 0, records.size(), false));
+    CHECK(writer.done());
+  }
+  LogJsonWriter middle(&store, 130, true);
+  CHECK(writeJson(middle, 500) == expectedJson(records, 130, records.size(), true));
+  LogJsonWriter limited(&store, 10, true);
+  limited.limit(75);
+  CHECK(writeJson(limited, 500) == expectedJson(records, 10, 75, true));
+  LogJsonWriter past(&store, 2000, true);
+  CHECK(writeJson(past, 500) == "{\"from\":2000,\"log\":[]}");
+
+  //cached chunks give the same JSON, and are made once for every writer
+  LogJsonCache jsonCache(&store, 16);
+  LogJsonCache smallCache(&store, 4);
+  for(int round = 0; round < 2; round++){
+    for(LogJsonCache *json : {&jsonCache, &smallCache}){
+      LogJsonWriter writer(&store, 64);
+      writer.setCache(json);
+      CHECK(writeJson(writer, 1436) == expectedJson(records, 64, records.size(), false));
+    }
+  }
+  //chunks 64 to 896, the last records don't make a whole chunk
+  LogJsonCacheStats jsonStats = jsonCache.stats();
+  CHECK(jsonStats.builds == 14 && jsonStats.hits == 14 && jsonStats.evictions == 0);
+  jsonStats = smallCache.stats();
+  CHECK(jsonStats.builds == 28 && jsonStats.hits == 0 && jsonStats.evictions == 24);
+  CHECK(!jsonCache.get(3));
+  CHECK(!jsonCache.get(960));
+
+  //a writer that doesn't start on a chunk, or stops in one, formats the records around it
+  LogJsonWriter unaligned(&store, 30);
+  unaligned.setCache(&jsonCache);
+  unaligned.limit(200);
+  CHECK(writeJson(unaligned, 100) == expectedJson(records, 30, 200, false));
+
+  //chunks of records that were truncated away are made again
+  std::shared_ptr<const LogJsonChunk> stale = jsonCache.get(128);
+  CHECK(stale && stale->first == 128);
+  CHECK(store.truncate(100));
+  records.resize(100);
+  other = makeRecords(200, -300);
+  CHECK(store.appendBatch(other.data(), other.size()) == 200);
+  records.insert(records.end(), other.begin(), other.end());
+  LogJsonWriter fresh(&store);
+  fresh.setCache(&jsonCache);
+  CHECK(writeJson(fresh, 1436) == expectedJson(records, 0, records.size(), false));
+  CHECK(jsonCache.get(128) != stale);
+  //a writer holding a dropped chunk can still use it
+  CHECK(stale->json.size() > 0 && stale->first == 128);
+
+  LogStoreStats stats = store.stats();
+  CHECK(stats.records == records.size() && stats.bytes == records.size() * sizeof(LogRecord));
+  CHECK(stats.errors == 1);  //the empty batch
+  store.setCache(nullptr);
+}
+
+int main(){
+  RamLogStore ram;
+  testStore("RamLogStore", ram);
+
+  RamLogStore full(10);
+  std::vector<LogRecord> records = makeRecords(11);
+  CHECK(full.appendBatch(records.data(), 8) == 8);
+  CHECK(full.appendBatch(records.data(), 3) == 0);
+  CHECK(full.count() == 8);
+
+  char path[] = "/tmp/store_testXXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0);
+  close(fd);
+  {
+    PosixLogStore file(path);
+    testStore("PosixLogStore", file);
+  }
+  {
+    //the file is opened again with all its records, and a torn record at the end is dropped
+    PosixLogStore file(path);
+    CHECK(file.begin());
+    CHECK(file.count() == 300);
+    FILE *f = fopen(path, "ab");
+    fwrite("torn", 1, 4, f);
+    fclose(f);
+  }
+  {
+    PosixLogStore file(path);
+    CHECK(file.begin());
+    CHECK(file.count() == 300);
+    LogRecord record;
+    CHECK(file.last(record) && record.sequence == 299 && logRecordValid(record));
+  }
+  unlink(path);
+
+  PosixLogStore missing("/nonexistent/store_test");
+  CHECK(!missing.begin());
+
+  printf("store_test: %d failed\n", fails);
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * The parts of the Arduino core, FreeRTOS and AsyncTCP the web server needs to run on a PC.
+ * A client keeps whatever the server writes in hostWire and only sends when told to;
+ * tests feed requests and frames straight into the callbacks the server registered.
+ */
+#include <string>
+#include <zlib.h>
+#define protected public
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#include "rom/miniz.h"
+
+std::string hostWire;
+bool hostClosed = false;
+
+HardwareSerial Serial;
+EspClass ESP;
+void * pxCurrentTCB = (void *)1;
+
+AsyncClient::AsyncClient(tcp_pcb*){}
+AsyncClient::~AsyncClient(){}
+void AsyncClient::close(bool){
+  hostClosed = true;
+  if(_discard_cb)
+    _discard_cb(_discard_cb_arg, this);
+}
+void AsyncClient::setRxTimeout(uint32_t){}
+void AsyncClient::onDisconnect(AcConnectHandler cb, void* arg){ _discard_cb = cb; _discard_cb_arg = arg; }
+void AsyncClient::onAck(AcAckHandler cb, void* arg){ _sent_cb = cb; _sent_cb_arg = arg; }
+void AsyncClient::onError(AcErrorHandler, void*){}
+void AsyncClient::onData(AcDataHandler cb, void* arg){ _recv_cb = cb; _recv_cb_arg = arg; }
+void AsyncClient::onTimeout(AcTimeoutHandler, void*){}
+void AsyncClient::onPoll(AcConnectHandler cb, void* arg){ _poll_cb = cb; _poll_cb_arg = arg; }
+size_t AsyncClient::space(){ return 5744; }
+bool AsyncClient::canSend(){ return false; }
+size_t AsyncClient::add(const char* data, size_t len, uint8_t){ hostWire.append(data, len); return len; }
+bool AsyncClient::send(){ return true; }
+size_t AsyncClient::write(const char* data, size_t len, uint8_t){ hostWire.append(data, len); return len; }
+size_t AsyncClient::write(const char* data){ return write(data, strlen(data)); }
+bool AsyncClient::free(){ return true; }
+bool AsyncClient::connected(){ return !hostClosed; }
+IPAddress AsyncClient::remoteIP(){ return IPAddress(127, 0, 0, 1); }
+uint16_t AsyncClient::remotePort(){ return 50000; }
+IPAddress AsyncClient::localIP(){ return IPAddress(); }
+
+AsyncServer::AsyncServer(uint16_t){}
+AsyncServer::~AsyncServer(){}
+void AsyncServer::onClient(AcConnectHandler, void*){}
+void AsyncServer::begin(){}
+void AsyncServer::end(){}
+void AsyncServer::setNoDelay(bool){}
+
+//the ROM inflater, one call inflates a whole raw deflate stream as AsyncWebSocketDeflater does
+tinfl_status tinfl_decompress(tinfl_decompressor *, const uint8_t *in, size_t *inLen, uint8_t *, uint8_t *out, size_t *outLen, const uint32_t){
+  z_stream z = {};
+  if(inflateInit2(&z, -15) != Z_OK)
+    return TINFL_STATUS_FAILED;
+  z.next_in = (Bytef*)in;
+  z.avail_in = *inLen;
+  z.next_out = out;
+  z.avail_out = *outLen;
+  int r = inflate(&z, Z_SYNC_FLUSH);
+  *inLen = z.total_in;
+  *outLen = z.total_out;
+  inflateEnd(&z);
+  if(r == Z_STREAM_END)
+    return TINFL_STATUS_DONE;
+  if(r == Z_OK || r == Z_BUF_ERROR)
+    return z.avail_in ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+  return TINFL_STATUS_FAILED;
+}
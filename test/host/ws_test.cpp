@@ -0,0 +1,109 @@
+/*
+ * Compressed messages from a client reach the handler whole however they arrive: in one
+ * frame split over segments, or fragmented into continuation frames with a control frame
+ * between them. One that doesn't fit WS_INFLATE_MAX_SIZE closes the connection with 1009.
+ */
+#include <cstdio>
+#include <string>
+#include <vector>
+#define protected public
+#define private public
+#include "ESPAsyncWebServer.h"
+#include "deflate.h"
+
+static int fails = 0;
+#define CHECK(c) do{ if(!(c)){ printf("FAIL line %d: %s\n", __LINE__, #c); fails++; } }while(0)
+
+static std::vector<std::string> received;
+
+//a masked frame as a browser sends it
+static std::string frame(uint8_t first, const std::string &payload){
+  std::string f;
+  f += (char)first;
+  const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+  if(payload.size() < 126)
+    f += (char)(0x80 | payload.size());
+  else {
+    f += (char)(0x80 | 126);
+    f += (char)(payload.size() >> 8);
+    f += (char)(payload.size() & 0xff);
+  }
+  f.append((const char *)mask, 4);
+  for(size_t i = 0; i < payload.size(); i++)
+    f += (char)(payload[i] ^ mask[i % 4]);
+  return f;
+}
+
+static void feed(AsyncWebSocketClient *client, std::string data){
+  client->_onData(&data[0], data.size());
+}
+
+int main(){
+  AsyncWebServer server(80);
+  AsyncWebSocket *ws = new AsyncWebSocket("/ws");
+  server.addHandler(ws);
+  ws->onEvent([](AsyncWebSocket *, AsyncWebSocketClient *, AwsEventType type, void *arg, uint8_t *data, size_t len){
+    AwsFrameInfo *info = (AwsFrameInfo*)arg;
+    if(type == WS_EVT_DATA && info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT)
+      received.push_back(std::string((char*)data, len));
+  });
+  std::vector<AsyncClient*> clients;
+  auto connect = [&](){
+    AsyncClient *c = new AsyncClient();
+    clients.push_back(c);
+    //the client takes over the connection and deletes the request
+    AsyncWebSocketClient *client = new AsyncWebSocketClient(new AsyncWebServerRequest(&server, c), ws, String(), true);
+    received.clear();
+    return client;
+  };
+
+  std::string message = logJson(20);
+  std::string compressed = deflateMessage(14, message);
+  CHECK(message.size() <= WS_INFLATE_MAX_SIZE);
+
+  { //one frame split over three segments
+    AsyncWebSocketClient *client = connect();
+    std::string f = frame(0xC1, compressed);
+    feed(client, f.substr(0, 10));
+    feed(client, f.substr(10, 37));
+    feed(client, f.substr(47));
+    CHECK(received.size() == 1 && received[0] == message);
+    CHECK(client->status() == WS_CONNECTED);
+  }
+  { //three fragments with a ping between them, in one segment, then a plain message
+    AsyncWebSocketClient *client = connect();
+    size_t a = compressed.size() / 3, b = 2 * compressed.size() / 3;
+    feed(client, frame(0x41, compressed.substr(0, a)) + frame(0x89, "hi")
+      + frame(0x00, compressed.substr(a, b - a)) + frame(0x80, compressed.substr(b)));
+    CHECK(received.size() == 1 && received[0] == message);
+    CHECK(client->status() == WS_CONNECTED);
+    feed(client, frame(0x81, "plain"));
+    CHECK(received.size() == 2 && received[1] == "plain");
+  }
+  { //too big to collect
+    AsyncWebSocketClient *client = connect();
+    std::string noise;
+    for(int i = 0; i < 2000; i++)
+      noise += (char)(rand() & 0xff);
+    std::string f = frame(0xC1, deflateMessage(14, noise));
+    feed(client, f.substr(0, 300));
+    CHECK(client->_controlQueue.isEmpty());
+    feed(client, f.substr(300));
+    CHECK(received.empty());
+    CHECK(!client->_controlQueue.isEmpty());
+  }
+  { //collected but too big once inflated
+    AsyncWebSocketClient *client = connect();
+    feed(client, frame(0xC1, deflateMessage(14, std::string(4000, 'a'))));
+    CHECK(received.empty());
+    CHECK(!client->_controlQueue.isEmpty());
+  }
+
+  //the WebSocket client deletes itself and the connection once it's closed
+  for(auto c: clients)
+    c->close(true);
+  CHECK(ws->count() == 0);
+  CHECK(ws->getClients().isEmpty());
+  printf("ws_test: %d failed\n", fails);
+  return fails ? 1 : 0;
+}